@@ -0,0 +1,172 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/annotation_util.h"
+
+#include <google/protobuf/arena.h>
+
+#include <algorithm>
+
+#include "client/cpp/proto_reader.h"
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+namespace {
+
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingAnnotateVideoResponse;
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingVideoAnnotationResults;
+using ::google::protobuf::Arena;
+using ::google::protobuf::ArenaOptions;
+using ::google::protobuf::Duration;
+
+constexpr int32_t kNanosPerSecond = 1000000000;
+
+void ShiftDuration(int64_t offset_us, Duration* duration) {
+  int64_t seconds = duration->seconds() + offset_us / 1000000;
+  int64_t nanos = duration->nanos() + (offset_us % 1000000) * 1000;
+  if (nanos >= kNanosPerSecond) {
+    nanos -= kNanosPerSecond;
+    ++seconds;
+  } else if (nanos < 0) {
+    nanos += kNanosPerSecond;
+    --seconds;
+  }
+  duration->set_seconds(seconds);
+  duration->set_nanos(static_cast<int32_t>(nanos));
+}
+
+int64_t DurationToMicros(const Duration& duration) {
+  return duration.seconds() * 1000000 + duration.nanos() / 1000;
+}
+
+}  // namespace
+
+std::shared_ptr<StreamingAnnotateVideoResponse> NewArenaResponse() {
+  // Object tracking responses with many boxes take tens of KBytes.
+  ArenaOptions options;
+  options.start_block_size = 4 * 1024;
+  options.max_block_size = 64 * 1024;
+  std::shared_ptr<Arena> arena = std::make_shared<Arena>(options);
+  StreamingAnnotateVideoResponse* resp =
+      Arena::CreateMessage<StreamingAnnotateVideoResponse>(arena.get());
+  // Shares ownership of the arena, which owns the message.
+  return std::shared_ptr<StreamingAnnotateVideoResponse>(arena, resp);
+}
+
+void ShiftTimeOffsets(int64_t offset_us,
+                      StreamingVideoAnnotationResults* results) {
+  if (offset_us == 0) {
+    return;
+  }
+  for (auto& shot : *results->mutable_shot_annotations()) {
+    ShiftDuration(offset_us, shot.mutable_start_time_offset());
+    ShiftDuration(offset_us, shot.mutable_end_time_offset());
+  }
+  for (auto& label : *results->mutable_label_annotations()) {
+    for (auto& segment : *label.mutable_segments()) {
+      ShiftDuration(offset_us,
+                    segment.mutable_segment()->mutable_start_time_offset());
+      ShiftDuration(offset_us,
+                    segment.mutable_segment()->mutable_end_time_offset());
+    }
+    for (auto& frame : *label.mutable_frames()) {
+      ShiftDuration(offset_us, frame.mutable_time_offset());
+    }
+  }
+  if (results->has_explicit_annotation()) {
+    for (auto& frame :
+         *results->mutable_explicit_annotation()->mutable_frames()) {
+      ShiftDuration(offset_us, frame.mutable_time_offset());
+    }
+  }
+  for (auto& object : *results->mutable_object_annotations()) {
+    if (object.has_segment()) {
+      ShiftDuration(offset_us,
+                    object.mutable_segment()->mutable_start_time_offset());
+      ShiftDuration(offset_us,
+                    object.mutable_segment()->mutable_end_time_offset());
+    }
+    for (auto& frame : *object.mutable_frames()) {
+      ShiftDuration(offset_us, frame.mutable_time_offset());
+    }
+  }
+}
+
+int64_t GetLatestTimeOffsetUs(
+    const StreamingVideoAnnotationResults& results) {
+  int64_t latest_us = -1;
+  auto update = [&latest_us](const Duration& duration) {
+    latest_us = std::max(latest_us, DurationToMicros(duration));
+  };
+  for (const auto& shot : results.shot_annotations()) {
+    update(shot.end_time_offset());
+  }
+  for (const auto& label : results.label_annotations()) {
+    for (const auto& segment : label.segments()) {
+      update(segment.segment().end_time_offset());
+    }
+    for (const auto& frame : label.frames()) {
+      update(frame.time_offset());
+    }
+  }
+  for (const auto& frame : results.explicit_annotation().frames()) {
+    update(frame.time_offset());
+  }
+  for (const auto& object : results.object_annotations()) {
+    if (object.has_segment()) {
+      update(object.segment().end_time_offset());
+    }
+    for (const auto& frame : object.frames()) {
+      update(frame.time_offset());
+    }
+  }
+  return latest_us;
+}
+
+bool ReadResultsInRange(
+    const std::string& path, int64_t start_time_us, int64_t end_time_us,
+    const std::function<bool(const StreamingVideoAnnotationResults& results)>&
+        callback) {
+  ProtoReader reader(path);
+  if (!reader.Open()) {
+    return false;
+  }
+  if (!reader.SeekToTime(start_time_us)) {
+    LOG(INFO) << "Reading " << path << " from the start";
+  }
+  StreamingVideoAnnotationResults results;
+  while (reader.ReadProto(&results)) {
+    int64_t time_us = GetLatestTimeOffsetUs(results);
+    if (time_us >= end_time_us) {
+      break;
+    }
+    if (time_us >= start_time_us && !callback(results)) {
+      break;
+    }
+  }
+  return true;
+}
+
+}  // namespace video
+}  // namespace api
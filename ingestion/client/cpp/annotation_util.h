@@ -0,0 +1,67 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_ANNOTATION_UTIL_H_
+#define API_VIDEO_CLIENT_CPP_ANNOTATION_UTIL_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "proto/video_intelligence_streaming.pb.h"
+
+namespace api {
+namespace video {
+
+// Creates an empty response on its own protobuf arena, so that parsing it
+// takes a few block allocations instead of one per message and string. The
+// arena is freed with the last handle, which lets one parsed response be
+// shared read-only by all consumers instead of being copied.
+std::shared_ptr<
+    google::cloud::videointelligence::v1p3beta1::StreamingAnnotateVideoResponse>
+NewArenaResponse();
+
+// Shifts every time offset in `results` by `offset_us` microseconds. It is
+// used to place results of consecutive streaming sessions on one timeline.
+void ShiftTimeOffsets(int64_t offset_us,
+                      google::cloud::videointelligence::v1p3beta1::
+                          StreamingVideoAnnotationResults* results);
+
+// Gets the latest time offset (in microseconds) in `results`, or -1 if
+// there is none.
+int64_t GetLatestTimeOffsetUs(
+    const google::cloud::videointelligence::v1p3beta1::
+        StreamingVideoAnnotationResults& results);
+
+// Reads the results of the annotation result log at `path` whose latest time
+// offset is in [start_time_us, end_time_us), in log order, until `callback`
+// returns false. The log's time index is used to skip earlier results, if
+// there is one. Returns false if the log can't be read.
+bool ReadResultsInRange(
+    const std::string& path, int64_t start_time_us, int64_t end_time_us,
+    const std::function<bool(const google::cloud::videointelligence::
+                                 v1p3beta1::StreamingVideoAnnotationResults&
+                                     results)>& callback);
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_ANNOTATION_UTIL_H_
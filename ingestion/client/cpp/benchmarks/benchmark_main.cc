@@ -0,0 +1,52 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Main of the client benchmarks. Runs the benchmarks linked in and reports
+// them as JSON, unless another --benchmark_format is given, so that results
+// can be kept and compared across releases, e.g. with Google Benchmark's
+// tools/compare.py. Flags other than Google Benchmark's are parsed with
+// gflags.
+
+#include <cstring>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "gflags/gflags.h"
+
+int main(int argc, char* argv[]) {
+  static char kJsonFormat[] = "--benchmark_format=json";
+  std::vector<char*> args(argv, argv + argc);
+  bool has_format = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--benchmark_format=", 19) == 0) {
+      has_format = true;
+    }
+  }
+  if (!has_format) {
+    args.insert(args.begin() + 1, kJsonFormat);
+  }
+  int num_args = args.size();
+  args.push_back(nullptr);
+  char** args_ptr = args.data();
+  benchmark::Initialize(&num_args, args_ptr);
+  gflags::ParseCommandLineFlags(&num_args, &args_ptr, true);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,349 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Benchmarks the client's readers and writers: FileReader and FileWriter,
+// PipeReader through a local FIFO, ProtoWriter and ProtoReader by record
+// size, and result logs written raw and compressed. Files are written to
+// --benchmark_dir.
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "client/cpp/file_reader.h"
+#include "client/cpp/file_writer.h"
+#include "client/cpp/pipe_reader.h"
+#include "client/cpp/proto_reader.h"
+#include "client/cpp/proto_writer.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "proto/video_intelligence_streaming.grpc.pb.h"
+
+DEFINE_string(benchmark_dir, "/tmp", "Directory of the files written.");
+
+namespace api {
+namespace video {
+namespace {
+
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingAnnotateVideoRequest;
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingVideoAnnotationResults;
+
+// Files are rewritten from the start beyond this size.
+constexpr int64_t kMaxFileBytes = 64 << 20;
+
+// Gets the path of a file named `name`, unique to this process.
+std::string TempPath(const std::string& name) {
+  return FLAGS_benchmark_dir + "/client_benchmark_" + name + "." +
+         std::to_string(getpid());
+}
+
+// Writes chunks of `range(0)` bytes.
+void BM_FileWriter(benchmark::State& state) {
+  std::string path = TempPath("file_writer");
+  std::string chunk(state.range(0), 'x');
+  FileWriter writer(path);
+  CHECK(writer.Open());
+  int64_t size = 0;
+  for (auto _ : state) {
+    if (size >= kMaxFileBytes) {
+      state.PauseTiming();
+      writer.Close();
+      CHECK(writer.Open());
+      size = 0;
+      state.ResumeTiming();
+    }
+    writer.WriteBytes(chunk.size(), &chunk[0]);
+    size += chunk.size();
+  }
+  writer.Close();
+  remove(path.c_str());
+  state.SetBytesProcessed(state.iterations() * chunk.size());
+}
+BENCHMARK(BM_FileWriter)->Arg(8 << 10)->Arg(1 << 20);
+
+// Reads chunks of `range(0)` bytes from a file, which is mostly cached.
+void BM_FileReader(benchmark::State& state) {
+  std::string path = TempPath("file_reader");
+  {
+    std::string chunk(1 << 20, 'x');
+    FileWriter writer(path);
+    CHECK(writer.Open());
+    for (int64_t size = 0; size < kMaxFileBytes; size += chunk.size()) {
+      writer.WriteBytes(chunk.size(), &chunk[0]);
+    }
+    writer.Close();
+  }
+  std::vector<char> buffer(state.range(0));
+  FileReader reader(path);
+  CHECK(reader.Open());
+  for (auto _ : state) {
+    if (reader.ReadBytes(buffer.size(), buffer.data()) < buffer.size()) {
+      state.PauseTiming();
+      CHECK(reader.Seek(0));
+      state.ResumeTiming();
+    }
+  }
+  reader.Close();
+  remove(path.c_str());
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_FileReader)->Arg(8 << 10)->Arg(1 << 20);
+
+// Reads `range(0)` bytes per iteration through a FIFO, written by another
+// thread, with reads of up to 1 MByte like the client's.
+void BM_PipeReader(benchmark::State& state) {
+  const int64_t bytes_per_iteration = state.range(0);
+  std::string path = TempPath("pipe");
+  CHECK_EQ(0, mkfifo(path.c_str(), 0600));
+  PipeReader reader(path);
+  CHECK(reader.Open());
+  int write_fd = open(path.c_str(), O_WRONLY);
+  CHECK_NE(-1, write_fd);
+
+  // The writer stays at most one iteration ahead of the reader.
+  std::atomic<int64_t> allowed{0};
+  std::atomic<bool> done{false};
+  std::thread writer([write_fd, &allowed, &done] {
+    std::string chunk(64 << 10, 'x');
+    int64_t written = 0;
+    while (!done) {
+      int64_t n = std::min<int64_t>(chunk.size(), allowed - written);
+      if (n <= 0) {
+        std::this_thread::yield();
+        continue;
+      }
+      ssize_t res = write(write_fd, chunk.data(), n);
+      CHECK_GT(res, 0);
+      written += res;
+    }
+  });
+
+  std::vector<char> buffer(1 << 20);
+  for (auto _ : state) {
+    allowed += bytes_per_iteration;
+    for (int64_t read = 0; read < bytes_per_iteration;) {
+      read += reader.ReadBytes(buffer.size(), buffer.data());
+    }
+  }
+  done = true;
+  writer.join();
+  close(write_fd);
+  // Waits for the reading thread to see the end of the pipe.
+  while (reader.ReadBytes(buffer.size(), buffer.data()) > 0) {
+  }
+  reader.Close();
+  remove(path.c_str());
+  state.SetBytesProcessed(state.iterations() * bytes_per_iteration);
+}
+BENCHMARK(BM_PipeReader)->Arg(1 << 20)->Arg(16 << 20)->UseRealTime();
+
+// Makes a record of about `size` bytes.
+StreamingAnnotateVideoRequest MakeRecord(size_t size) {
+  StreamingAnnotateVideoRequest record;
+  record.set_input_content(std::string(size, 'x'));
+  return record;
+}
+
+// Writes records of `range(0)` bytes, with a media time. Timed in real time,
+// as the writing itself is done by a background thread.
+void BM_ProtoWriter(benchmark::State& state) {
+  std::string path = TempPath("proto_writer");
+  StreamingAnnotateVideoRequest record = MakeRecord(state.range(0));
+  std::unique_ptr<ProtoWriter> writer(new ProtoWriter(path));
+  CHECK(writer->Open());
+  int64_t time_us = 0;
+  for (auto _ : state) {
+    if (writer->Size() >= kMaxFileBytes) {
+      state.PauseTiming();
+      writer.reset(new ProtoWriter(path));
+      CHECK(writer->Open());
+      state.ResumeTiming();
+    }
+    CHECK(writer->WriteProto(record, time_us += 33333));
+  }
+  writer->Close();
+  remove(path.c_str());
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ProtoWriter)
+    ->RangeMultiplier(16)
+    ->Range(64, 1 << 20)
+    ->UseRealTime();
+
+// Reads records of `range(0)` bytes.
+void BM_ProtoReader(benchmark::State& state) {
+  std::string path = TempPath("proto_reader");
+  {
+    StreamingAnnotateVideoRequest record = MakeRecord(state.range(0));
+    ProtoWriter writer(path);
+    CHECK(writer.Open());
+    while (writer.Size() < kMaxFileBytes) {
+      CHECK(writer.WriteProto(record));
+    }
+    writer.Close();
+  }
+  StreamingAnnotateVideoRequest record;
+  std::unique_ptr<ProtoReader> reader(new ProtoReader(path));
+  CHECK(reader->Open());
+  for (auto _ : state) {
+    if (!reader->ReadProto(&record)) {
+      state.PauseTiming();
+      reader.reset(new ProtoReader(path));
+      CHECK(reader->Open());
+      CHECK(reader->ReadProto(&record));
+      state.ResumeTiming();
+    }
+  }
+  reader->Close();
+  remove(path.c_str());
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ProtoReader)->RangeMultiplier(16)->Range(64, 1 << 20);
+
+// Makes the object tracking results of `num_frames` frames, with 8 objects
+// each: the same entities every frame, with boxes moving slowly.
+std::vector<StreamingVideoAnnotationResults> MakeTrackingResults(
+    int num_frames) {
+  static const char* const kEntities[][2] = {
+      {"/m/0k4j", "car"}, {"/m/01g317", "person"}, {"/m/0199g", "bicycle"}};
+  std::vector<StreamingVideoAnnotationResults> results(num_frames);
+  for (int i = 0; i < num_frames; ++i) {
+    for (int j = 0; j < 8; ++j) {
+      auto* object = results[i].add_object_annotations();
+      object->mutable_entity()->set_entity_id(kEntities[j % 3][0]);
+      object->mutable_entity()->set_description(kEntities[j % 3][1]);
+      object->set_confidence(0.8f + 0.01f * j);
+      object->set_track_id(j);
+      auto* frame = object->add_frames();
+      frame->mutable_time_offset()->set_seconds(i / 30);
+      frame->mutable_time_offset()->set_nanos((i % 30) * 33333333);
+      auto* box = frame->mutable_normalized_bounding_box();
+      float x = j * 0.1f + i * 0.001f;
+      x -= static_cast<int>(x);
+      box->set_left(x * 0.5f);
+      box->set_top(0.1f * (j % 5));
+      box->set_right(x * 0.5f + 0.2f);
+      box->set_bottom(0.1f * (j % 5) + 0.3f);
+    }
+  }
+  return results;
+}
+
+// Closes the result log `writer` at `path`, and adds the bytes of its
+// records and of its file to the totals.
+void CloseResultLog(const std::string& path, ProtoWriter* writer,
+                    int64_t* record_bytes, int64_t* file_bytes) {
+  *record_bytes += writer->Size();
+  writer->Close();
+  struct stat st;
+  CHECK_EQ(0, stat(path.c_str(), &st));
+  *file_bytes += st.st_size;
+}
+
+// Writes object tracking results to a result log, compressed if `range(0)`
+// is 1. Throughputs are of uncompressed bytes, and `ratio` is the size of
+// the file relative to them.
+void BM_ResultLogWriter(benchmark::State& state) {
+  std::string path = TempPath("result_log_writer");
+  const std::vector<StreamingVideoAnnotationResults> results =
+      MakeTrackingResults(3000);
+  ProtoWriter::Options options;
+  options.compress = state.range(0) != 0;
+  std::unique_ptr<ProtoWriter> writer(new ProtoWriter(path, options));
+  CHECK(writer->Open());
+  int64_t record_bytes = 0;
+  int64_t file_bytes = 0;
+  int64_t i = 0;
+  for (auto _ : state) {
+    if (writer->Size() >= kMaxFileBytes) {
+      state.PauseTiming();
+      CloseResultLog(path, writer.get(), &record_bytes, &file_bytes);
+      writer.reset(new ProtoWriter(path, options));
+      CHECK(writer->Open());
+      state.ResumeTiming();
+    }
+    CHECK(writer->WriteProto(results[i % results.size()], i * 33333));
+    ++i;
+  }
+  CloseResultLog(path, writer.get(), &record_bytes, &file_bytes);
+  remove(path.c_str());
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(record_bytes);
+  state.counters["ratio"] = static_cast<double>(file_bytes) / record_bytes;
+}
+BENCHMARK(BM_ResultLogWriter)
+    ->ArgName("compress")
+    ->Arg(0)
+    ->Arg(1)
+    ->UseRealTime();
+
+// Reads object tracking results from a result log, compressed if
+// `range(0)` is 1. Throughputs are of uncompressed bytes.
+void BM_ResultLogReader(benchmark::State& state) {
+  std::string path = TempPath("result_log_reader");
+  const std::vector<StreamingVideoAnnotationResults> results =
+      MakeTrackingResults(3000);
+  int64_t record_bytes = 0;
+  {
+    ProtoWriter::Options options;
+    options.compress = state.range(0) != 0;
+    ProtoWriter writer(path, options);
+    CHECK(writer.Open());
+    for (size_t i = 0; i < results.size(); ++i) {
+      CHECK(writer.WriteProto(results[i], i * 33333));
+    }
+    record_bytes = writer.Size();
+    writer.Close();
+  }
+  StreamingVideoAnnotationResults record;
+  std::unique_ptr<ProtoReader> reader(new ProtoReader(path));
+  CHECK(reader->Open());
+  for (auto _ : state) {
+    if (!reader->ReadProto(&record)) {
+      state.PauseTiming();
+      reader.reset(new ProtoReader(path));
+      CHECK(reader->Open());
+      CHECK(reader->ReadProto(&record));
+      state.ResumeTiming();
+    }
+  }
+  reader->Close();
+  remove(path.c_str());
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * record_bytes / results.size());
+}
+BENCHMARK(BM_ResultLogReader)->ArgName("compress")->Arg(0)->Arg(1);
+
+}  // namespace
+}  // namespace video
+}  // namespace api
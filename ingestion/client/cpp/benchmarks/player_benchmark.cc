@@ -0,0 +1,153 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Benchmarks the media player's hot paths: passing stream data to the
+// demuxer, and drawing annotations with UpdateSDLRendererContent(). SDL runs
+// with its dummy video and audio drivers, so no display is needed.
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "client/cpp/media_player.h"
+#include "client/cpp/visualizer_util.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "proto/video_intelligence_streaming.grpc.pb.h"
+
+#include "SDL2/SDL.h"
+#include "SDL2/SDL_render.h"
+#include "SDL2/SDL_ttf.h"
+
+DEFINE_string(font, "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+              "Font of the annotations drawn.");
+
+namespace api {
+namespace video {
+
+namespace {
+
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingAnnotateVideoResponse;
+
+// Video size.
+constexpr int kVideoWidth = 1280;
+constexpr int kVideoHeight = 720;
+
+void UseDummySdlDrivers() {
+  setenv("SDL_VIDEODRIVER", "dummy", 1);
+  setenv("SDL_AUDIODRIVER", "dummy", 1);
+}
+
+// Inserts a chunk of stream data of `range(0)` bytes, as read from the
+// input, and reads it back as the demuxer does.
+void BM_InsertStreamData(benchmark::State& state) {
+  UseDummySdlDrivers();
+  static MediaPlayer* player = new MediaPlayer(FLAGS_font);
+  auto data = std::make_shared<const std::string>(state.range(0), 'x');
+  std::vector<uint8_t> buffer(MediaPlayer::kDefaultStreamBufferSize);
+  for (auto _ : state) {
+    player->InsertStreamData(data);
+    size_t read = 0;
+    while (read < data->size()) {
+      read += player->ReadStreamData(buffer.data(), buffer.size());
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * data->size());
+}
+BENCHMARK(BM_InsertStreamData)->Arg(64 << 10)->Arg(1 << 20);
+
+// Makes an object tracking response with `num_objects` boxes.
+StreamingAnnotateVideoResponse MakeObjectTrackingResponse(int num_objects) {
+  static const char* const kDescriptions[] = {"car", "person", "bicycle"};
+  StreamingAnnotateVideoResponse resp;
+  for (int i = 0; i < num_objects; ++i) {
+    auto* object = resp.mutable_annotation_results()->add_object_annotations();
+    object->mutable_entity()->set_description(kDescriptions[i % 3]);
+    auto* box = object->add_frames()->mutable_normalized_bounding_box();
+    box->set_left(0.02f * i);
+    box->set_top(0.01f * i);
+    box->set_right(0.02f * i + 0.2f);
+    box->set_bottom(0.01f * i + 0.3f);
+  }
+  return resp;
+}
+
+// Makes a label detection response with `num_labels` labels.
+StreamingAnnotateVideoResponse MakeLabelResponse(int num_labels) {
+  static const char* const kDescriptions[] = {"vehicle", "road", "sky"};
+  StreamingAnnotateVideoResponse resp;
+  for (int i = 0; i < num_labels; ++i) {
+    auto* label = resp.mutable_annotation_results()->add_label_annotations();
+    label->mutable_entity()->set_description(kDescriptions[i % 3]);
+    label->add_frames()->set_confidence(0.5f + 0.01f * i);
+  }
+  return resp;
+}
+
+// Draws `resp` on a software renderer, one frame per iteration.
+void RunRenderer(benchmark::State& state,
+                 const StreamingAnnotateVideoResponse& resp) {
+  UseDummySdlDrivers();
+  CHECK_EQ(0, SDL_Init(SDL_INIT_VIDEO));
+  CHECK_EQ(0, TTF_Init());
+  SDL_Window* window =
+      SDL_CreateWindow("benchmark", SDL_WINDOWPOS_UNDEFINED,
+                       SDL_WINDOWPOS_UNDEFINED, kVideoWidth, kVideoHeight,
+                       SDL_WINDOW_HIDDEN);
+  CHECK(window != nullptr) << SDL_GetError();
+  SDL_Renderer* renderer =
+      SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+  CHECK(renderer != nullptr) << SDL_GetError();
+  TTF_Font* font = TTF_OpenFont(FLAGS_font.c_str(), 20);
+  if (font == nullptr) {
+    state.SkipWithError("Failed to open --font");
+  } else {
+    for (auto _ : state) {
+      SDL_RenderClear(renderer);
+      UpdateSDLRendererContent(resp, kVideoWidth, kVideoHeight, font,
+                               renderer);
+      SDL_RenderPresent(renderer);
+    }
+    TTF_CloseFont(font);
+  }
+  SDL_DestroyRenderer(renderer);
+  SDL_DestroyWindow(window);
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Draws `range(0)` tracked objects.
+void BM_UpdateSDLRendererContentObjects(benchmark::State& state) {
+  RunRenderer(state, MakeObjectTrackingResponse(state.range(0)));
+}
+BENCHMARK(BM_UpdateSDLRendererContentObjects)->Arg(1)->Arg(8)->Arg(32);
+
+// Draws the labels of a response with `range(0)` labels.
+void BM_UpdateSDLRendererContentLabels(benchmark::State& state) {
+  RunRenderer(state, MakeLabelResponse(state.range(0)));
+}
+BENCHMARK(BM_UpdateSDLRendererContentLabels)->Arg(8)->Arg(32);
+
+}  // namespace
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,322 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Runs the whole StreamingClient pipeline against a synthetic annotation
+// service in the same process, over localhost, and reports the sustained
+// throughput, the CPU time per MByte, the peak RSS and the latency of the
+// responses. Needs no network or credentials, e.g.:
+//   streaming_client_bench --sessions=4 --bitrate_mbps=20 --total_mb=64
+// Client flags (e.g. --chunk_size_kb, --local_storage_video) apply as well.
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "client/cpp/file_reader.h"
+#include "client/cpp/io_reader.h"
+#include "client/cpp/queue_stats.h"
+#include "client/cpp/streaming_client.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "grpc++/grpc++.h"
+#include "proto/video_intelligence_streaming.grpc.pb.h"
+
+DEFINE_double(bitrate_mbps, 0,
+              "Bitrate the video of each session is read at, in MBits per "
+              "second (0: as fast as the client reads).");
+DEFINE_string(input_path, "",
+              "Video file sent, repeated up to --total_mb. Random bytes are "
+              "sent if empty.");
+DEFINE_int32(response_interval_kb, 1024,
+             "The service sends a response every this many KBytes of "
+             "content received.");
+DEFINE_int32(sessions, 1, "Number of concurrent client sessions.");
+DEFINE_int32(total_mb, 256, "MBytes of video sent by each session.");
+
+DECLARE_int32(chunk_size_kb);
+DECLARE_string(config);
+
+namespace api {
+namespace video {
+namespace {
+
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingAnnotateVideoRequest;
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingAnnotateVideoResponse;
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingVideoIntelligenceService;
+
+// Makes a response covering the first `bytes` of content. Its time offset
+// in microseconds is the number of bytes, so that the bench can tell when
+// they were read.
+StreamingAnnotateVideoResponse MakeResponse(int64_t bytes) {
+  StreamingAnnotateVideoResponse resp;
+  auto* label = resp.mutable_annotation_results()->add_label_annotations();
+  label->mutable_entity()->set_description("synthetic");
+  auto* frame = label->add_frames();
+  frame->set_confidence(0.9f);
+  frame->mutable_time_offset()->set_seconds(bytes / 1000000);
+  frame->mutable_time_offset()->set_nanos((bytes % 1000000) * 1000);
+  return resp;
+}
+
+// Synthetic annotation service: reads the content and sends a response
+// every --response_interval_kb, and one for the rest at the end.
+class SyntheticService final
+    : public StreamingVideoIntelligenceService::Service {
+ public:
+  grpc::Status StreamingAnnotateVideo(
+      grpc::ServerContext* context,
+      grpc::ServerReaderWriter<StreamingAnnotateVideoResponse,
+                               StreamingAnnotateVideoRequest>* stream)
+      override {
+    const int64_t interval = int64_t{FLAGS_response_interval_kb} << 10;
+    StreamingAnnotateVideoRequest req;
+    int64_t received = 0;
+    int64_t answered = 0;
+    while (stream->Read(&req)) {
+      received += req.input_content().size();
+      if (received - answered >= interval) {
+        stream->Write(MakeResponse(received));
+        answered = received;
+      }
+    }
+    if (received > answered) {
+      stream->Write(MakeResponse(received));
+    }
+    return grpc::Status::OK;
+  }
+};
+
+// Reads `total_bytes` of `content`, repeated, at `bytes_per_sec` (as fast as
+// possible if 0), and records when the bytes were read.
+class BenchReader : public IOReader {
+ public:
+  BenchReader(const std::string& content, int64_t total_bytes,
+              double bytes_per_sec)
+      : IOReader("bench"),
+        content_(content),
+        total_bytes_(total_bytes),
+        bytes_per_sec_(bytes_per_sec) {}
+
+  bool Open() {
+    start_ = std::chrono::steady_clock::now();
+    return true;
+  }
+
+  size_t ReadBytes(size_t max_bytes_read, char* data) {
+    size_t size = std::min<int64_t>(max_bytes_read, total_bytes_ - read_);
+    for (size_t copied = 0; copied < size;) {
+      size_t offset = (read_ + copied) % content_.size();
+      size_t n = std::min(size - copied, content_.size() - offset);
+      memcpy(data + copied, content_.data() + offset, n);
+      copied += n;
+    }
+    if (bytes_per_sec_ > 0) {
+      std::this_thread::sleep_until(
+          start_ + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::duration<double>((read_ + size) /
+                                                     bytes_per_sec_)));
+    }
+    read_ += size;
+    std::lock_guard<std::mutex> lock(m_);
+    read_times_.emplace_back(read_, std::chrono::steady_clock::now());
+    return size;
+  }
+
+  void Close() {}
+
+  // Gets when the first `bytes` had been read.
+  std::chrono::steady_clock::time_point ReadTime(int64_t bytes) {
+    std::lock_guard<std::mutex> lock(m_);
+    auto it = std::lower_bound(
+        read_times_.begin(), read_times_.end(), bytes,
+        [](const std::pair<int64_t, std::chrono::steady_clock::time_point>& a,
+           int64_t b) { return a.first < b; });
+    CHECK(it != read_times_.end()) << "Response for unread content";
+    return it->second;
+  }
+
+ private:
+  const std::string& content_;
+  const int64_t total_bytes_;
+  const double bytes_per_sec_;
+  std::chrono::steady_clock::time_point start_;
+  int64_t read_ = 0;
+  // Bytes read so far, and when, after each read.
+  std::vector<std::pair<int64_t, std::chrono::steady_clock::time_point>>
+      read_times_;
+  std::mutex m_;
+};
+
+// Gets the content sent: the input file, or random bytes.
+std::string LoadContent() {
+  std::string content;
+  if (FLAGS_input_path.empty()) {
+    std::mt19937 random;
+    content.resize(1 << 20);
+    for (char& c : content) {
+      c = static_cast<char>(random());
+    }
+    return content;
+  }
+  FileReader reader(FLAGS_input_path);
+  CHECK(reader.Open()) << "Failed to read " << FLAGS_input_path;
+  std::vector<char> buffer(1 << 20);
+  size_t n;
+  while ((n = reader.ReadBytes(buffer.size(), buffer.data())) > 0) {
+    content.append(buffer.data(), n);
+  }
+  reader.Close();
+  CHECK(!content.empty()) << FLAGS_input_path << " is empty";
+  return content;
+}
+
+double CpuSeconds(const rusage& usage) {
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+int Run(char* argv0) {
+  SyntheticService service;
+  grpc::ServerBuilder builder;
+  int port = 0;
+  builder.AddListeningPort("localhost:0", grpc::InsecureServerCredentials(),
+                           &port);
+  builder.RegisterService(&service);
+  std::unique_ptr<grpc::Server> server = builder.BuildAndStart();
+  CHECK(server != nullptr && port > 0) << "Failed to start the service";
+
+  std::string config_path;
+  if (FLAGS_config.empty()) {
+    config_path = "/tmp/streaming_client_bench." + std::to_string(getpid()) +
+                  ".json";
+    std::ofstream(config_path)
+        << R"({"video_config": {"feature": "STREAMING_LABEL_DETECTION"}})";
+    FLAGS_config = config_path;
+  }
+
+  const std::string content = LoadContent();
+  const int64_t total_bytes = int64_t{FLAGS_total_mb} << 20;
+  LatencyHistogram latency;
+  std::vector<std::unique_ptr<StreamingClient>> clients;
+  for (int i = 0; i < FLAGS_sessions; ++i) {
+    // Each client has its own connection, like separate processes would.
+    std::shared_ptr<grpc::Channel> channel =
+        grpc::CreateChannel("localhost:" + std::to_string(port),
+                            grpc::InsecureChannelCredentials());
+    CHECK(channel->WaitForConnected(std::chrono::system_clock::now() +
+                                    std::chrono::seconds(10)))
+        << "Failed to connect to the service";
+    BenchReader* reader =
+        new BenchReader(content, total_bytes, FLAGS_bitrate_mbps * 1e6 / 8);
+    clients.emplace_back(new StreamingClient());
+    clients.back()->UseChannel(channel);
+    clients.back()->UseInput(std::unique_ptr<IOReader>(reader));
+    clients.back()->AddResultCallback(
+        [reader, &latency](const SharedResponse& resp) {
+          const auto& offset = resp->annotation_results()
+                                   .label_annotations(0)
+                                   .frames(0)
+                                   .time_offset();
+          int64_t bytes = offset.seconds() * 1000000 + offset.nanos() / 1000;
+          latency.Record(std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::steady_clock::now() -
+                             reader->ReadTime(bytes))
+                             .count());
+        },
+        OverflowPolicy::kBlock);
+    // Flags are already parsed.
+    int argc = 1;
+    char** argv = &argv0;
+    CHECK(clients.back()->Init(&argc, &argv));
+  }
+
+  rusage usage_start;
+  getrusage(RUSAGE_SELF, &usage_start);
+  auto start = std::chrono::steady_clock::now();
+  std::atomic<bool> status{true};
+  std::vector<std::thread> threads;
+  for (auto& client : clients) {
+    StreamingClient* c = client.get();
+    threads.emplace_back([c, &status] {
+      if (!c->Run()) {
+        status = false;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  rusage usage_end;
+  getrusage(RUSAGE_SELF, &usage_end);
+  clients.clear();
+  server->Shutdown();
+  if (!config_path.empty()) {
+    unlink(config_path.c_str());
+  }
+
+  double total_mb = static_cast<double>(total_bytes) * FLAGS_sessions / 1e6;
+  printf("sessions          %d x %d MiB in %d KiB chunks, ", FLAGS_sessions,
+         FLAGS_total_mb, FLAGS_chunk_size_kb);
+  if (FLAGS_bitrate_mbps > 0) {
+    printf("%g Mbit/s each\n", FLAGS_bitrate_mbps);
+  } else {
+    printf("unpaced\n");
+  }
+  printf("throughput        %.1f MB/s\n", total_mb / seconds);
+  printf("cpu               %.2f ms/MB (user + system, service included)\n",
+         (CpuSeconds(usage_end) - CpuSeconds(usage_start)) * 1e3 / total_mb);
+  printf("peak rss          %.1f MB\n", usage_end.ru_maxrss / 1024.0);
+  printf("response latency  p50 %lld us, p90 %lld us, p99 %lld us, "
+         "max %lld us (%llu responses)\n",
+         static_cast<long long>(latency.Percentile(50)),
+         static_cast<long long>(latency.Percentile(90)),
+         static_cast<long long>(latency.Percentile(99)),
+         static_cast<long long>(latency.max_us()),
+         static_cast<unsigned long long>(latency.count()));
+  return status ? 0 : 1;
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  return api::video::Run(argv[0]);
+}
@@ -0,0 +1,147 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Benchmarks SyncQueue pushes and pops under contention, and compares it
+// with SpscQueue between one producer and one consumer thread.
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "client/cpp/spsc_queue.h"
+#include "client/cpp/sync_queue.h"
+
+namespace api {
+namespace video {
+namespace {
+
+// Maximum queue length.
+constexpr int kQueueSize = 1024;
+
+// Queue shared by all threads of BM_SyncQueuePushPop. It never holds more
+// elements than there are threads, so it never blocks.
+SyncQueue<int> contended_queue(kQueueSize);
+
+// Pushes and pops from all benchmark threads at once, all contending on the
+// queue's lock.
+void BM_SyncQueuePushPop(benchmark::State& state) {
+  int val = 0;
+  for (auto _ : state) {
+    contended_queue.Push(val);
+    benchmark::DoNotOptimize(val = contended_queue.Pop());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SyncQueuePushPop)->ThreadRange(1, 8)->UseRealTime();
+
+// Pushes from the benchmark thread to a consumer thread, `range(0)`
+// elements at a time with PushBatch() and PopBatch() if more than 1.
+void BM_SyncQueueProducerConsumer(benchmark::State& state) {
+  const size_t batch_size = state.range(0);
+  SyncQueue<int> queue(kQueueSize);
+  std::thread consumer([&queue, batch_size] {
+    std::vector<int> batch;
+    if (batch_size > 1) {
+      while (queue.PopBatch(&batch, batch_size) > 0) {
+      }
+    } else {
+      int val;
+      while (queue.Pop(&val)) {
+      }
+    }
+  });
+  std::vector<int> batch;
+  for (auto _ : state) {
+    if (batch_size > 1) {
+      batch.assign(batch_size, 1);
+      queue.PushBatch(&batch);
+    } else {
+      queue.Push(1);
+    }
+  }
+  queue.Close();
+  consumer.join();
+  state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK(BM_SyncQueueProducerConsumer)->Arg(1)->Arg(64)->UseRealTime();
+
+// Passes chunks of `range(0)` bytes to a consumer thread through a queue
+// bounded by bytes, like the client's content and player queues.
+void BM_SyncQueueChunks(benchmark::State& state) {
+  const std::string chunk(state.range(0), 'x');
+  SyncQueue<std::string, PayloadBytes> queue(64 << 20);
+  std::thread consumer([&queue] {
+    std::string val;
+    while (queue.Pop(&val)) {
+    }
+  });
+  for (auto _ : state) {
+    queue.Emplace(chunk);
+  }
+  queue.Close();
+  consumer.join();
+  state.SetBytesProcessed(state.iterations() * chunk.size());
+}
+BENCHMARK(BM_SyncQueueChunks)->Arg(8 << 10)->Arg(1 << 20)->UseRealTime();
+
+// Like BM_SyncQueueProducerConsumer with single elements, through an
+// SpscQueue. It has no Close(), so a negative element ends the stream.
+void BM_SpscQueueProducerConsumer(benchmark::State& state) {
+  SpscQueue<int> queue(kQueueSize);
+  std::thread consumer([&queue] {
+    while (queue.Pop() >= 0) {
+    }
+  });
+  for (auto _ : state) {
+    int val = 1;
+    queue.Push(val);
+  }
+  int end = -1;
+  queue.Push(end);
+  consumer.join();
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SpscQueueProducerConsumer)->UseRealTime();
+
+// Like BM_SyncQueueChunks, through an SpscQueue bounded by its length: 64
+// chunks, i.e. as many bytes as the SyncQueue at most. An empty chunk ends
+// the stream.
+void BM_SpscQueueChunks(benchmark::State& state) {
+  const std::string chunk(state.range(0), 'x');
+  SpscQueue<std::string> queue(64);
+  std::thread consumer([&queue] {
+    while (!queue.Pop().empty()) {
+    }
+  });
+  for (auto _ : state) {
+    std::string val = chunk;
+    queue.Push(val);
+  }
+  std::string end;
+  queue.Push(end);
+  consumer.join();
+  state.SetBytesProcessed(state.iterations() * chunk.size());
+}
+BENCHMARK(BM_SpscQueueChunks)->Arg(8 << 10)->Arg(1 << 20)->UseRealTime();
+
+}  // namespace
+}  // namespace video
+}  // namespace api
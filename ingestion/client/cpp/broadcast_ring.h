@@ -0,0 +1,219 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_BROADCAST_RING_H_
+#define API_VIDEO_CLIENT_CPP_BROADCAST_RING_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "client/cpp/queue_stats.h"
+#include "client/cpp/sync_queue.h"
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+// Implements a ring that broadcasts the elements of one producer to several
+// subscribers, each reading at its own pace. Elements are stored once, in
+// a shared sequence of slots, and each subscriber only holds a cursor into
+// it. A subscriber that falls a whole ring behind either blocks the
+// producer (OverflowPolicy::kBlock) or, with kDropOldest, loses the
+// elements overwritten in the meantime, without affecting the others.
+//
+// Elements are copied out to subscribers, so T is typically a shared_ptr.
+// A slot keeps its element until it is overwritten.
+//
+// `Stats` is the statistics policy, see queue_stats.h. The depth is how far
+// the slowest subscriber is behind, and latencies are of all subscribers.
+template <class T, class Stats = NoQueueStats>
+class BroadcastRing {
+ public:
+  // A subscriber's view of the ring. Must be used by one thread.
+  class Subscriber {
+   public:
+    // Gets the next element into `val`, waiting for it. Returns false once
+    // the ring is closed and the subscriber has read everything.
+    bool Next(T* val) { return ring_->Next(this, val); }
+
+    // Gets the number of elements lost by falling behind.
+    size_t Dropped() {
+      std::lock_guard<std::mutex> lock(ring_->m_);
+      return dropped_;
+    }
+
+   private:
+    friend class BroadcastRing;
+
+    Subscriber(BroadcastRing* ring, OverflowPolicy policy, uint64_t cursor)
+        : ring_(ring), policy_(policy), cursor_(cursor) {}
+
+    BroadcastRing* const ring_;
+    const OverflowPolicy policy_;
+    // Sequence number of the next element to read.
+    uint64_t cursor_;
+    size_t dropped_ = 0;
+  };
+
+  // Constructs an empty ring of `capacity` slots.
+  explicit BroadcastRing(size_t capacity)
+      : slots_(capacity), stamps_(capacity) {
+    CHECK_GT(capacity, 0);
+  }
+
+  // Disallows copy and assign.
+  BroadcastRing(const BroadcastRing&) = delete;
+  BroadcastRing& operator=(const BroadcastRing&) = delete;
+
+  // Adds a subscriber that receives the elements published from now on. The
+  // ring owns it. `policy` is kBlock or kDropOldest.
+  Subscriber* Subscribe(OverflowPolicy policy) {
+    CHECK(policy != OverflowPolicy::kDropNewest)
+        << "kDropNewest is not supported by BroadcastRing";
+    std::lock_guard<std::mutex> lock(m_);
+    subscribers_.emplace_back(new Subscriber(this, policy, next_sequence_));
+    return subscribers_.back().get();
+  }
+
+  // Removes a subscriber, e.g. one that stopped reading, so that it no
+  // longer blocks the producer. The subscriber must not be in Next(), and
+  // is deleted.
+  void Unsubscribe(Subscriber* subscriber) {
+    std::lock_guard<std::mutex> lock(m_);
+    for (auto it = subscribers_.begin(); it != subscribers_.end(); ++it) {
+      if (it->get() == subscriber) {
+        subscribers_.erase(it);
+        break;
+      }
+    }
+    cond_var_consumed_.notify_all();
+  }
+
+  // Publishes an element to all subscribers, waiting while a kBlock
+  // subscriber is a whole ring behind. Returns false if the ring is closed.
+  bool Publish(T val) {
+    std::unique_lock<std::mutex> lock(m_);
+    if (!closed_ && Blocked()) {
+      typename Stats::Stamp since = Stats::Now();
+      cond_var_consumed_.wait(lock, [this] { return closed_ || !Blocked(); });
+      stats_.ProducerBlocked(since);
+    }
+    if (closed_) {
+      return false;
+    }
+    slots_[next_sequence_ % slots_.size()] = std::move(val);
+    stamps_[next_sequence_ % slots_.size()] = Stats::Now();
+    ++next_sequence_;
+    stats_.Pushed(Depth());
+    cond_var_published_.notify_all();
+    return true;
+  }
+
+  // Gets the statistics, e.g. to Register() them.
+  Stats* stats() { return &stats_; }
+
+  // Marks the end of the stream and wakes everyone. Subscribers can still
+  // read what they have not read yet.
+  void Close() {
+    std::lock_guard<std::mutex> lock(m_);
+    closed_ = true;
+    cond_var_published_.notify_all();
+    cond_var_consumed_.notify_all();
+  }
+
+ private:
+  // Gets how far the slowest subscriber is behind, within the ring. Must be
+  // called with `m_` held.
+  size_t Depth() const {
+    uint64_t depth = 0;
+    for (const auto& subscriber : subscribers_) {
+      depth = std::max(depth, next_sequence_ - subscriber->cursor_);
+    }
+    return std::min<uint64_t>(depth, slots_.size());
+  }
+
+  // Whether a kBlock subscriber would lose an element if one were published.
+  // Must be called with `m_` held.
+  bool Blocked() const {
+    for (const auto& subscriber : subscribers_) {
+      if (subscriber->policy_ == OverflowPolicy::kBlock &&
+          next_sequence_ - subscriber->cursor_ >= slots_.size()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool Next(Subscriber* subscriber, T* val) {
+    std::unique_lock<std::mutex> lock(m_);
+    if (!closed_ && subscriber->cursor_ == next_sequence_) {
+      typename Stats::Stamp since = Stats::Now();
+      cond_var_published_.wait(lock, [this, subscriber] {
+        return closed_ || subscriber->cursor_ < next_sequence_;
+      });
+      stats_.ConsumerStarved(since);
+    }
+    if (subscriber->cursor_ == next_sequence_) {
+      return false;
+    }
+    // Skips what was overwritten.
+    uint64_t oldest =
+        next_sequence_ - std::min<uint64_t>(next_sequence_, slots_.size());
+    if (subscriber->cursor_ < oldest) {
+      subscriber->dropped_ += oldest - subscriber->cursor_;
+      subscriber->cursor_ = oldest;
+    }
+    *val = slots_[subscriber->cursor_ % slots_.size()];
+    typename Stats::Stamp published =
+        stamps_[subscriber->cursor_ % slots_.size()];
+    ++subscriber->cursor_;
+    stats_.Popped(Depth(), published);
+    if (subscriber->policy_ == OverflowPolicy::kBlock) {
+      cond_var_consumed_.notify_one();
+    }
+    return true;
+  }
+
+  std::vector<T> slots_;
+  // Times the elements were published.
+  std::vector<typename Stats::Stamp> stamps_;
+  // Sequence number of the next element published.
+  uint64_t next_sequence_ = 0;
+  std::vector<std::unique_ptr<Subscriber>> subscribers_;
+  // Whether Close() has been called.
+  bool closed_ = false;
+  // Statistics.
+  Stats stats_;
+  // Mutex.
+  std::mutex m_;
+  // Condition variables.
+  std::condition_variable cond_var_published_;
+  std::condition_variable cond_var_consumed_;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  // API_VIDEO_CLIENT_CPP_BROADCAST_RING_H_
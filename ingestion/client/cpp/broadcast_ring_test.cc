@@ -0,0 +1,109 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/broadcast_ring.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace api {
+namespace video {
+namespace {
+
+// Reads all elements of `subscriber`.
+std::vector<int> ReadAll(BroadcastRing<int>::Subscriber* subscriber) {
+  std::vector<int> vals;
+  int val;
+  while (subscriber->Next(&val)) {
+    vals.push_back(val);
+  }
+  return vals;
+}
+
+// Tests that every subscriber gets every element, with a ring smaller than
+// the stream.
+TEST(BroadcastRingTest, Broadcast) {
+  BroadcastRing<int> ring(4);
+  auto* a = ring.Subscribe(OverflowPolicy::kBlock);
+  auto* b = ring.Subscribe(OverflowPolicy::kBlock);
+  std::vector<int> a_vals;
+  std::vector<int> b_vals;
+  std::thread a_thread([&] { a_vals = ReadAll(a); });
+  std::thread b_thread([&] { b_vals = ReadAll(b); });
+  std::vector<int> expected;
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(ring.Publish(i));
+    expected.push_back(i);
+  }
+  ring.Close();
+  a_thread.join();
+  b_thread.join();
+  EXPECT_EQ(expected, a_vals);
+  EXPECT_EQ(expected, b_vals);
+  EXPECT_FALSE(ring.Publish(1000));
+}
+
+// Tests that a dropping subscriber loses the oldest elements without
+// blocking the producer, while a blocking one gets them all.
+TEST(BroadcastRingTest, DropOldest) {
+  BroadcastRing<int> ring(4);
+  auto* slow = ring.Subscribe(OverflowPolicy::kDropOldest);
+  auto* fast = ring.Subscribe(OverflowPolicy::kBlock);
+  std::vector<int> fast_vals;
+  std::thread fast_thread([&] { fast_vals = ReadAll(fast); });
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(ring.Publish(i));
+  }
+  ring.Close();
+  fast_thread.join();
+  EXPECT_EQ(10, fast_vals.size());
+  EXPECT_EQ(std::vector<int>({6, 7, 8, 9}), ReadAll(slow));
+  EXPECT_EQ(6, slow->Dropped());
+  EXPECT_EQ(0, fast->Dropped());
+}
+
+// Tests that a subscriber only gets elements published after it
+// subscribed, and that unsubscribing unblocks the producer.
+TEST(BroadcastRingTest, Unsubscribe) {
+  BroadcastRing<int> ring(2);
+  EXPECT_TRUE(ring.Publish(0));
+  auto* stuck = ring.Subscribe(OverflowPolicy::kBlock);
+  auto* late = ring.Subscribe(OverflowPolicy::kDropOldest);
+  EXPECT_TRUE(ring.Publish(1));
+  EXPECT_TRUE(ring.Publish(2));
+  std::thread producer([&ring] { EXPECT_TRUE(ring.Publish(3)); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ring.Unsubscribe(stuck);
+  producer.join();
+  ring.Close();
+  EXPECT_EQ(std::vector<int>({2, 3}), ReadAll(late));
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,165 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/compressed_block.h"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+namespace {
+
+using ::google::protobuf::io::ArrayInputStream;
+using ::google::protobuf::io::CodedInputStream;
+using ::google::protobuf::io::CodedOutputStream;
+using ::google::protobuf::io::GzipInputStream;
+using ::google::protobuf::io::GzipOutputStream;
+using ::google::protobuf::io::StringOutputStream;
+
+// Favors speed: object tracking logs compress well at low levels.
+constexpr int kCompressionLevel = 3;
+
+}  // namespace
+
+bool AppendCompressedBlock(const char* data, size_t size, int64_t offset,
+                           std::string* out) {
+  size_t header_offset = out->size();
+  out->resize(header_offset + kCompressedBlockHeaderSize);
+  {
+    StringOutputStream output(out);
+    GzipOutputStream::Options options;
+    options.format = GzipOutputStream::ZLIB;
+    options.compression_level = kCompressionLevel;
+    GzipOutputStream gzip(&output, options);
+    void* buffer;
+    int buffer_size;
+    size_t written = 0;
+    while (written < size) {
+      if (!gzip.Next(&buffer, &buffer_size)) {
+        return false;
+      }
+      size_t n = std::min<size_t>(buffer_size, size - written);
+      memcpy(buffer, data + written, n);
+      written += n;
+      if (n < static_cast<size_t>(buffer_size)) {
+        gzip.BackUp(buffer_size - n);
+      }
+    }
+    if (!gzip.Close()) {
+      return false;
+    }
+  }
+  uint32_t compressed_size =
+      out->size() - header_offset - kCompressedBlockHeaderSize;
+  uint8_t* header = reinterpret_cast<uint8_t*>(&(*out)[header_offset]);
+  header = CodedOutputStream::WriteLittleEndian32ToArray(compressed_size,
+                                                         header);
+  header = CodedOutputStream::WriteLittleEndian32ToArray(size, header);
+  CodedOutputStream::WriteLittleEndian64ToArray(offset, header);
+  return true;
+}
+
+void ParseCompressedBlockHeader(const char* data, CompressedBlock* block) {
+  const uint8_t* header = reinterpret_cast<const uint8_t*>(data);
+  uint64_t offset;
+  header = CodedInputStream::ReadLittleEndian32FromArray(
+      header, &block->compressed_size);
+  header = CodedInputStream::ReadLittleEndian32FromArray(header, &block->size);
+  CodedInputStream::ReadLittleEndian64FromArray(header, &offset);
+  block->offset = static_cast<int64_t>(offset);
+}
+
+bool DecompressBlock(const char* data, const CompressedBlock& block,
+                     char* out) {
+  ArrayInputStream input(data, block.compressed_size);
+  GzipInputStream gzip(&input, GzipInputStream::ZLIB);
+  const void* buffer;
+  int buffer_size;
+  size_t read = 0;
+  while (gzip.Next(&buffer, &buffer_size)) {
+    if (buffer_size > static_cast<int>(block.size - read)) {
+      return false;
+    }
+    memcpy(out + read, buffer, buffer_size);
+    read += buffer_size;
+  }
+  return read == block.size;
+}
+
+bool IsCompressedLog(int fd) {
+  char magic[kCompressedLogMagicSize];
+  return pread(fd, magic, sizeof(magic), 0) ==
+             static_cast<ssize_t>(sizeof(magic)) &&
+         memcmp(magic, kCompressedLogMagic, sizeof(magic)) == 0;
+}
+
+bool ReadCompressedBlocks(int fd, int64_t file_offset,
+                          std::vector<CompressedBlock>* blocks) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return false;
+  }
+  char header[kCompressedBlockHeaderSize];
+  while (file_offset + static_cast<int64_t>(sizeof(header)) <= st.st_size) {
+    if (pread(fd, header, sizeof(header), file_offset) !=
+        static_cast<ssize_t>(sizeof(header))) {
+      return false;
+    }
+    CompressedBlock block;
+    ParseCompressedBlockHeader(header, &block);
+    block.file_offset = file_offset;
+    file_offset += sizeof(header) + block.compressed_size;
+    if (file_offset > st.st_size) {
+      break;
+    }
+    blocks->push_back(block);
+  }
+  return true;
+}
+
+int FindCompressedBlock(const std::vector<CompressedBlock>& blocks,
+                        int64_t offset) {
+  auto it = std::upper_bound(
+      blocks.begin(), blocks.end(), offset,
+      [](int64_t offset, const CompressedBlock& block) {
+        return offset < block.offset;
+      });
+  if (it == blocks.begin()) {
+    return -1;
+  }
+  --it;
+  if (offset >= it->offset + it->size) {
+    return -1;
+  }
+  return it - blocks.begin();
+}
+
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,88 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_COMPRESSED_BLOCK_H_
+#define API_VIDEO_CLIENT_CPP_COMPRESSED_BLOCK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace api {
+namespace video {
+
+// A compressed proto log holds the same length-prefixed records as a raw
+// one, in zlib-compressed blocks. It starts with kCompressedLogMagic,
+// followed by blocks, each with a header:
+//   uint32 compressed_size  Size of the compressed block data that follows.
+//   uint32 size             Size of the block once decompressed.
+//   uint64 offset           Offset of the block in the decompressed log.
+// All little-endian. Offsets in the decompressed log are used throughout,
+// e.g. by time indexes and upload checkpoints, and the block headers are
+// an index to find them.
+
+// Magic at the start of a compressed log.
+constexpr char kCompressedLogMagic[] = "AVZPROT1";
+constexpr size_t kCompressedLogMagicSize = sizeof(kCompressedLogMagic) - 1;
+
+// Size of a block header.
+constexpr size_t kCompressedBlockHeaderSize = 16;
+
+// A block of a compressed log.
+struct CompressedBlock {
+  // Offset of the block header in the file.
+  int64_t file_offset = 0;
+  // Offset of the block in the decompressed log.
+  int64_t offset = 0;
+  uint32_t compressed_size = 0;
+  uint32_t size = 0;
+};
+
+// Compresses `size` bytes at `data`, a block at `offset` in the
+// decompressed log, and appends the block with its header to `out`.
+bool AppendCompressedBlock(const char* data, size_t size, int64_t offset,
+                           std::string* out);
+
+// Parses a block header.
+void ParseCompressedBlockHeader(const char* data, CompressedBlock* block);
+
+// Decompresses the data of `block` into `block.size` bytes at `out`.
+bool DecompressBlock(const char* data, const CompressedBlock& block,
+                     char* out);
+
+// Whether the file open at `fd` is a compressed log.
+bool IsCompressedLog(int fd);
+
+// Reads the headers of the compressed log open at `fd`, from the block at
+// `file_offset` on, and appends the blocks to `blocks`. A truncated last
+// block is ignored.
+bool ReadCompressedBlocks(int fd, int64_t file_offset,
+                          std::vector<CompressedBlock>* blocks);
+
+// Finds the block of `blocks` that contains `offset` in the decompressed
+// log, or returns -1.
+int FindCompressedBlock(const std::vector<CompressedBlock>& blocks,
+                        int64_t offset);
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_COMPRESSED_BLOCK_H_
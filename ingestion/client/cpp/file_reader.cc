@@ -45,6 +45,17 @@ size_t FileReader::ReadBytes(size_t max_bytes_read, char* data) {
   return file_fd_->gcount();
 }
 
+bool FileReader::Seek(int64_t offset) {
+  // Clears the end-of-file state of a previous read.
+  file_fd_->clear();
+  file_fd_->seekg(offset, std::ifstream::beg);
+  if (!file_fd_->good()) {
+    LOG(ERROR) << "Failed to seek to " << offset << " in " << file_name_;
+    return false;
+  }
+  return true;
+}
+
 void FileReader::Close() { file_fd_->close(); }
 
 }  // namespace video
@@ -45,6 +45,9 @@ class FileReader : public IOReader {
   // Reads bytes from file.
   size_t ReadBytes(size_t max_bytes_read, char* data);
 
+  // Moves the read position to `offset` bytes from the start of the file.
+  bool Seek(int64_t offset);
+
   // Closes a file.
   void Close();
 
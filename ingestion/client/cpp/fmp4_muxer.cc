@@ -0,0 +1,105 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/fmp4_muxer.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+#include <libavutil/avutil.h>
+}
+
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+std::string AvError(int error) {
+  char message[AV_ERROR_MAX_STRING_SIZE] = {0};
+  av_strerror(error, message, sizeof(message));
+  return message;
+}
+
+bool OpenFmp4Muxer(const std::string& path, const AVStream* input,
+                   AVIOContext* io, AVFormatContext** output,
+                   AVStream** stream) {
+  *output = nullptr;
+  AVFormatContext* muxer = nullptr;
+  int error = avformat_alloc_output_context2(
+      &muxer, nullptr, "mp4", io == nullptr ? path.c_str() : nullptr);
+  if (error < 0) {
+    LOG(ERROR) << "Failed to create " << path << ": " << AvError(error);
+    return false;
+  }
+  AVStream* video = avformat_new_stream(muxer, nullptr);
+  if (video == nullptr ||
+      avcodec_parameters_copy(video->codecpar, input->codecpar) < 0) {
+    LOG(ERROR) << "Failed to add video stream to " << path;
+    avformat_free_context(muxer);
+    return false;
+  }
+  video->codecpar->codec_tag = 0;
+  video->time_base = input->time_base;
+  if (io != nullptr) {
+    muxer->pb = io;
+    muxer->flags |= AVFMT_FLAG_CUSTOM_IO;
+  } else {
+    error = avio_open(&muxer->pb, path.c_str(), AVIO_FLAG_WRITE);
+    if (error < 0) {
+      LOG(ERROR) << "Failed to open " << path << ": " << AvError(error);
+      avformat_free_context(muxer);
+      return false;
+    }
+  }
+  AVDictionary* options = nullptr;
+  av_dict_set(&options, "movflags", "frag_keyframe+empty_moov", 0);
+  error = avformat_write_header(muxer, &options);
+  av_dict_free(&options);
+  if (error < 0) {
+    LOG(ERROR) << "Failed to write header of " << path << ": "
+               << AvError(error);
+    if (io == nullptr) {
+      avio_closep(&muxer->pb);
+    }
+    avformat_free_context(muxer);
+    return false;
+  }
+  *output = muxer;
+  *stream = video;
+  return true;
+}
+
+bool CloseFmp4Muxer(AVFormatContext** output) {
+  if (*output == nullptr) {
+    return true;
+  }
+  bool status = av_write_trailer(*output) == 0;
+  if ((*output)->flags & AVFMT_FLAG_CUSTOM_IO) {
+    avio_flush((*output)->pb);
+  } else {
+    avio_closep(&(*output)->pb);
+  }
+  avformat_free_context(*output);
+  *output = nullptr;
+  return status;
+}
+
+}  // namespace video
+}  // namespace api
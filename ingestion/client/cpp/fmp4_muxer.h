@@ -0,0 +1,55 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_FMP4_MUXER_H_
+#define API_VIDEO_CLIENT_CPP_FMP4_MUXER_H_
+
+#include <string>
+
+struct AVFormatContext;
+struct AVIOContext;
+struct AVStream;
+
+namespace api {
+namespace video {
+
+// Gets the message of an FFmpeg error code.
+std::string AvError(int error);
+
+// Starts remuxing the video stream `input` into a fragmented MP4: an init
+// section ('moov' without samples), followed by one fragment per keyframe,
+// so that every file or segment can be played on its own. The output goes
+// through `io`, a custom AVIO context the caller keeps owning, or if null to
+// a new file at `path`, which also names the output in errors. On success,
+// `*output` is the muxer, with the init section written, and `*stream` its
+// video stream, in the time base of `input`. On failure, `*output` is null.
+bool OpenFmp4Muxer(const std::string& path, const AVStream* input,
+                   AVIOContext* io, AVFormatContext** output,
+                   AVStream** stream);
+
+// Writes the rest of the output of a muxer started by OpenFmp4Muxer() and
+// frees it, closing its file if it has one. Does nothing if `*output` is
+// null. Returns false if the output failed.
+bool CloseFmp4Muxer(AVFormatContext** output);
+
+}  // namespace video
+}  // namespace api
+
+#endif  // API_VIDEO_CLIENT_CPP_FMP4_MUXER_H_
@@ -0,0 +1,257 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/mapped_proto_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "client/cpp/compressed_block.h"
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+namespace {
+
+using ::google::protobuf::MessageLite;
+using ::google::protobuf::io::CodedInputStream;
+
+// Size of the record length prefix.
+constexpr size_t kLengthSize = 4;
+// Records are handed to parsing threads in chunks of this many.
+constexpr size_t kChunkRecords = 256;
+// In kOrdered order, threads parse up to this many chunks each ahead of the
+// chunk being delivered.
+constexpr size_t kChunksAheadPerThread = 2;
+
+}  // namespace
+
+MappedProtoReader::MappedProtoReader(const std::string& path)
+    : file_name_(path) {}
+
+MappedProtoReader::~MappedProtoReader() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+bool MappedProtoReader::Open() {
+  CHECK(data_ == nullptr) << file_name_ << " is already open";
+  int fd = open(file_name_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(ERROR) << "Failed to open read file " << file_name_ << ": "
+               << strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    LOG(ERROR) << "Failed to stat " << file_name_ << ": " << strerror(errno);
+    close(fd);
+    return false;
+  }
+  size_ = st.st_size;
+  if (size_ == 0) {
+    close(fd);
+    return true;
+  }
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "Failed to map " << file_name_ << ": " << strerror(errno);
+    size_ = 0;
+    return false;
+  }
+  data_ = static_cast<const char*>(data);
+  madvise(data, size_, MADV_WILLNEED);
+  if (size_ >= kCompressedLogMagicSize &&
+      memcmp(data_, kCompressedLogMagic, kCompressedLogMagicSize) == 0) {
+    LOG(ERROR) << file_name_ << " is compressed, use ProtoReader to read it";
+    return false;
+  }
+
+  // Only the length prefixes are read here.
+  size_t offset = 0;
+  while (size_ - offset >= kLengthSize) {
+    uint32_t size;
+    CodedInputStream::ReadLittleEndian32FromArray(
+        reinterpret_cast<const uint8_t*>(data_ + offset), &size);
+    if (size > size_ - offset - kLengthSize) {
+      break;
+    }
+    offsets_.push_back(offset + kLengthSize);
+    sizes_.push_back(size);
+    offset += kLengthSize + size;
+  }
+  if (offset != size_) {
+    LOG(WARNING) << "Truncated record at offset " << offset << " of "
+                 << file_name_;
+  }
+  return true;
+}
+
+const char* MappedProtoReader::record_data(size_t index) const {
+  return data_ + offsets_[index];
+}
+
+size_t MappedProtoReader::record_size(size_t index) const {
+  return sizes_[index];
+}
+
+bool MappedProtoReader::ParseAll(int num_threads, Order order,
+                                 const MessageFactory& message_factory,
+                                 const Callback& callback) {
+  num_threads = std::max(num_threads, 1);
+  if (order == Order::kUnordered) {
+    return ParseUnordered(num_threads, message_factory, callback);
+  }
+
+  // Chunks are parsed into a ring of slots, and delivered in order.
+  struct Slot {
+    std::vector<std::unique_ptr<MessageLite>> messages;
+    // Chunk parsed into the slot, -1 while being parsed.
+    int64_t chunk = -1;
+    // Records parsed, fewer than in the chunk on error.
+    size_t num_parsed = 0;
+  };
+  const size_t num_chunks = (num_records() + kChunkRecords - 1) / kChunkRecords;
+  std::vector<Slot> slots(num_threads * kChunksAheadPerThread);
+  std::mutex mutex;
+  std::condition_variable parsed_cv;
+  std::condition_variable delivered_cv;
+  size_t next_chunk = 0;
+  size_t chunks_delivered = 0;
+  bool stopped = false;
+
+  auto parse = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      delivered_cv.wait(lock, [&] {
+        return stopped || next_chunk >= num_chunks ||
+               next_chunk < chunks_delivered + slots.size();
+      });
+      if (stopped || next_chunk >= num_chunks) {
+        return;
+      }
+      size_t chunk = next_chunk++;
+      Slot& slot = slots[chunk % slots.size()];
+      lock.unlock();
+
+      size_t begin = chunk * kChunkRecords;
+      size_t end = std::min(begin + kChunkRecords, num_records());
+      size_t num_parsed = 0;
+      for (size_t i = begin; i < end; ++i, ++num_parsed) {
+        if (slot.messages.size() <= num_parsed) {
+          slot.messages.push_back(message_factory());
+        }
+        if (!slot.messages[num_parsed]->ParseFromArray(record_data(i),
+                                                       record_size(i))) {
+          break;
+        }
+      }
+
+      lock.lock();
+      slot.chunk = chunk;
+      slot.num_parsed = num_parsed;
+      parsed_cv.notify_all();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back(parse);
+  }
+
+  bool ok = true;
+  for (size_t chunk = 0; chunk < num_chunks && ok; ++chunk) {
+    Slot& slot = slots[chunk % slots.size()];
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      parsed_cv.wait(
+          lock, [&] { return slot.chunk == static_cast<int64_t>(chunk); });
+    }
+    size_t begin = chunk * kChunkRecords;
+    size_t end = std::min(begin + kChunkRecords, num_records());
+    for (size_t i = 0; i < slot.num_parsed; ++i) {
+      callback(begin + i, *slot.messages[i]);
+    }
+    if (begin + slot.num_parsed < end) {
+      LOG(ERROR) << "Failed to parse record " << begin + slot.num_parsed
+                 << " of " << file_name_;
+      ok = false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    slot.chunk = -1;
+    chunks_delivered = chunk + 1;
+    stopped = !ok;
+    delivered_cv.notify_all();
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return ok;
+}
+
+bool MappedProtoReader::ParseUnordered(int num_threads,
+                                       const MessageFactory& message_factory,
+                                       const Callback& callback) {
+  std::atomic<size_t> next_chunk{0};
+  std::atomic<bool> ok{true};
+  auto parse = [&]() {
+    std::unique_ptr<MessageLite> message = message_factory();
+    while (ok) {
+      size_t begin = next_chunk++ * kChunkRecords;
+      if (begin >= num_records()) {
+        return;
+      }
+      size_t end = std::min(begin + kChunkRecords, num_records());
+      for (size_t i = begin; i < end; ++i) {
+        if (!message->ParseFromArray(record_data(i), record_size(i))) {
+          LOG(ERROR) << "Failed to parse record " << i << " of "
+                     << file_name_;
+          ok = false;
+          return;
+        }
+        callback(i, *message);
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back(parse);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return ok;
+}
+
+}  // namespace video
+}  // namespace api
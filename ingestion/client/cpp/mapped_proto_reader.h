@@ -0,0 +1,101 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_MAPPED_PROTO_READER_H_
+#define API_VIDEO_CLIENT_CPP_MAPPED_PROTO_READER_H_
+
+#include <google/protobuf/message_lite.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace api {
+namespace video {
+
+// Reads a whole file of length-prefixed protos written by ProtoWriter, for
+// batch processing. The file is memory-mapped, record boundaries are found
+// by a pass over the length prefixes only, and records are then parsed in
+// parallel straight from the mapped bytes.
+class MappedProtoReader {
+ public:
+  // Order in which ParseAll() delivers messages.
+  enum class Order {
+    // In file order, from the calling thread.
+    kOrdered,
+    // As parsed, concurrently from the parsing threads.
+    kUnordered,
+  };
+
+  // Makes a message to parse records into.
+  using MessageFactory =
+      std::function<std::unique_ptr<google::protobuf::MessageLite>()>;
+  // Receives the message parsed from the record at `index`.
+  using Callback = std::function<void(
+      size_t index, const google::protobuf::MessageLite& message)>;
+
+  explicit MappedProtoReader(const std::string& path);
+  ~MappedProtoReader();
+
+  // Disallows copy and assign.
+  MappedProtoReader(const MappedProtoReader&) = delete;
+  MappedProtoReader& operator=(const MappedProtoReader&) = delete;
+
+  // Maps the file and finds its records. A truncated last record is ignored.
+  // Compressed files are not supported.
+  bool Open();
+
+  // Gets the number of records.
+  size_t num_records() const { return offsets_.size(); }
+
+  // Gets the serialized bytes of the record at `index`.
+  const char* record_data(size_t index) const;
+  size_t record_size(size_t index) const;
+
+  // Parses all records on `num_threads` threads and passes them to
+  // `callback` in `order`. Messages are reused, so `callback` must copy what
+  // it keeps. Returns false if a record fails to parse; messages are
+  // delivered up to it in kOrdered order.
+  bool ParseAll(int num_threads, Order order,
+                const MessageFactory& message_factory,
+                const Callback& callback);
+
+ private:
+  // Parses records in kUnordered order.
+  bool ParseUnordered(int num_threads, const MessageFactory& message_factory,
+                      const Callback& callback);
+
+  // File name.
+  std::string file_name_;
+  // Mapped file, null if not open.
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  // Offsets of the records (after their length prefix) in the file.
+  std::vector<uint64_t> offsets_;
+  // Sizes of the records.
+  std::vector<uint32_t> sizes_;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_MAPPED_PROTO_READER_H_
@@ -0,0 +1,145 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/mapped_proto_reader.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "client/cpp/proto_writer.h"
+#include "gtest/gtest.h"
+#include "proto/video_intelligence_streaming.pb.h"
+
+namespace api {
+namespace video {
+namespace {
+
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingVideoAnnotationResults;
+using ::google::protobuf::MessageLite;
+
+// Writes `num_records` results, the i-th one with i shots, and appends
+// `trailing_bytes` of a truncated record.
+std::string WriteLog(const std::string& name, int num_records,
+                     int trailing_bytes) {
+  const std::string path = std::string(getenv("TEST_TMPDIR")) + "/" + name;
+  ProtoWriter writer(path);
+  EXPECT_TRUE(writer.Open());
+  for (int i = 0; i < num_records; ++i) {
+    StreamingVideoAnnotationResults results;
+    for (int j = 0; j < i % 7; ++j) {
+      results.add_shot_annotations()->mutable_start_time_offset()->set_seconds(
+          i);
+    }
+    EXPECT_TRUE(writer.WriteProto(results));
+  }
+  if (trailing_bytes > 0) {
+    std::vector<char> data(trailing_bytes, 100);
+    EXPECT_TRUE(writer.WriteBytes(data.size(), data.data()));
+  }
+  writer.Close();
+  if (trailing_bytes > 0) {
+    EXPECT_EQ(0, truncate(path.c_str(), writer.Size() - 1));
+  }
+  return path;
+}
+
+MappedProtoReader::MessageFactory ResultsFactory() {
+  return [] {
+    return std::unique_ptr<MessageLite>(new StreamingVideoAnnotationResults());
+  };
+}
+
+int64_t GetRecordIndex(const MessageLite& message) {
+  const auto& results =
+      static_cast<const StreamingVideoAnnotationResults&>(message);
+  return results.shot_annotations_size() == 0
+             ? -1
+             : results.shot_annotations(0).start_time_offset().seconds();
+}
+
+TEST(MappedProtoReaderTest, Ordered) {
+  MappedProtoReader reader(WriteLog("ordered.log", 5000, 10));
+  ASSERT_TRUE(reader.Open());
+  ASSERT_EQ(5000, reader.num_records());
+  size_t next_index = 0;
+  ASSERT_TRUE(reader.ParseAll(
+      4, MappedProtoReader::Order::kOrdered, ResultsFactory(),
+      [&next_index](size_t index, const MessageLite& message) {
+        ASSERT_EQ(next_index, index);
+        int64_t record_index = GetRecordIndex(message);
+        if (record_index >= 0) {
+          ASSERT_EQ(index, record_index);
+        }
+        ++next_index;
+      }));
+  EXPECT_EQ(5000, next_index);
+}
+
+TEST(MappedProtoReaderTest, Unordered) {
+  MappedProtoReader reader(WriteLog("unordered.log", 5000, 0));
+  ASSERT_TRUE(reader.Open());
+  std::mutex mutex;
+  std::vector<int> counts(5000);
+  ASSERT_TRUE(reader.ParseAll(
+      3, MappedProtoReader::Order::kUnordered, ResultsFactory(),
+      [&mutex, &counts](size_t index, const MessageLite& message) {
+        int64_t record_index = GetRecordIndex(message);
+        std::lock_guard<std::mutex> lock(mutex);
+        ++counts[index];
+        if (record_index >= 0) {
+          ASSERT_EQ(index, record_index);
+        }
+      }));
+  EXPECT_EQ(std::vector<int>(5000, 1), counts);
+}
+
+TEST(MappedProtoReaderTest, StopsAtCorruptRecord) {
+  const std::string path = WriteLog("corrupt.log", 1000, 0);
+  MappedProtoReader reader(path);
+  ASSERT_TRUE(reader.Open());
+  // Overwrites a record with an invalid tag.
+  int fd = open(path.c_str(), O_WRONLY);
+  ASSERT_GE(fd, 0);
+  const char invalid_tag = 0;
+  ASSERT_EQ(1, pwrite(fd, &invalid_tag, 1,
+                      reader.record_data(600) - reader.record_data(0) + 4));
+  close(fd);
+  MappedProtoReader corrupt_reader(path);
+  ASSERT_TRUE(corrupt_reader.Open());
+  size_t num_delivered = 0;
+  EXPECT_FALSE(corrupt_reader.ParseAll(
+      4, MappedProtoReader::Order::kOrdered, ResultsFactory(),
+      [&num_delivered](size_t, const MessageLite&) { ++num_delivered; }));
+  EXPECT_EQ(600, num_delivered);
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
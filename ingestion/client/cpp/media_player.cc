@@ -21,7 +21,11 @@
 #include "client/cpp/media_player.h"
 
 #include <algorithm>
-#include <cmath>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
 
 namespace api {
 namespace video {
@@ -32,8 +36,15 @@ constexpr int kInvalidStreamIndex = -1;
 constexpr int kSdlAudioBufferSize = 4096;
 // Max audio buffer size (in bytes).
 constexpr int kMaxAudioBufferSize = 288000;
-// Max encoded stream buffer size (in bytes).
-constexpr int kMaxStreamBufferSize = 8192;
+// A decoded frame more than this many milliseconds late is dropped, if a
+// newer one is ready.
+constexpr int32_t kMaxFrameLateMs = 40;
+// Beyond this lag in milliseconds, non-reference frames are not decoded,
+// until the lag is back within kMaxFrameLateMs.
+constexpr int32_t kSkipNonRefLagMs = 500;
+// Beyond this lag in milliseconds, the video is assumed to have stalled or
+// jumped, and the clock restarts from the current frame.
+constexpr int32_t kNoSyncThresholdMs = 10000;
 // Font size.
 constexpr int kFontSize = 20;
 // Random video path for piped input.
@@ -42,12 +53,6 @@ constexpr char kRandomVideoPath[] = "random";
 constexpr uint32_t kRendereClearThresholdLabel = 1500;
 constexpr uint32_t kRendereClearThresholdTracking = 200;
 
-// The below two global variables are nasty, but have to be there.
-// They will be used in C-style callback.
-
-// Data stream queue.
-SyncQueue<std::string> stream_queue;
-
 namespace {
 
 using ::google::cloud::videointelligence::v1p3beta1::
@@ -57,28 +62,14 @@ void audio_callback(void* userdata, uint8_t* stream, int len) {
   SDL_memset(stream, 0, len);
 }
 
-int stream_callback(void* userdata, uint8_t* stream, int len) {
-  std::string data;
-  if (stream_queue.Size() > 0) {
-    data = stream_queue.Pop();
-  }
-  if (data.size() > kMaxStreamBufferSize) {
-    LOG(FATAL) << "Input data chunk cannot be larger than "
-               << kMaxStreamBufferSize << " bytes!";
-  }
-  if (data.size() > 0) {
-    memcpy(stream, data.c_str(), data.size());
-    return data.size();
-  }
-  return 0;
-}
-
 }  // namespace
 
 MediaPlayer::MediaPlayer(const std::string& font,
                          const std::string& video_path) {
   font_ = font;
   video_path_ = video_path;
+  annotation_response_queue_.stats()->Register("player_annotations");
+  frame_queue_.stats()->Register("player_frames");
   if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER)) {
     LOG(FATAL) << "unable to init SDL!";
   }
@@ -86,9 +77,16 @@ MediaPlayer::MediaPlayer(const std::string& font,
   av_register_all();
 }
 
-MediaPlayer::MediaPlayer(const std::string& font) {
+constexpr size_t MediaPlayer::kDefaultStreamBufferSize;
+
+MediaPlayer::MediaPlayer(const std::string& font, size_t stream_buffer_size,
+                         OverflowPolicy stream_policy)
+    : stream_queue_(kMaxStreamQueueBytes, stream_policy) {
   font_ = font;
   video_path_ = kRandomVideoPath;
+  annotation_response_queue_.stats()->Register("player_annotations");
+  frame_queue_.stats()->Register("player_frames");
+  stream_queue_.stats()->Register("player_stream");
 
   if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER)) {
     LOG(FATAL) << "unable to init SDL!";
@@ -102,13 +100,13 @@ MediaPlayer::MediaPlayer(const std::string& font) {
   }
 
   if ((stream_buffer_ = reinterpret_cast<uint8_t*>(
-           av_malloc(kMaxStreamBufferSize))) == nullptr) {
+           av_malloc(stream_buffer_size))) == nullptr) {
     LOG(FATAL) << "Error av_malloc stream buffer!";
   }
 
-  if ((av_io_ctx_ =
-           avio_alloc_context(stream_buffer_, kMaxStreamBufferSize, 0, nullptr,
-                              stream_callback, nullptr, nullptr)) == nullptr) {
+  if ((av_io_ctx_ = avio_alloc_context(stream_buffer_, stream_buffer_size, 0,
+                                       this, ReadStreamCallback, nullptr,
+                                       nullptr)) == nullptr) {
     LOG(FATAL) << "Error avio_alloc_context!";
   }
 
@@ -117,14 +115,15 @@ MediaPlayer::MediaPlayer(const std::string& font) {
 }
 
 MediaPlayer::~MediaPlayer() {
-  if (av_io_ctx_ != nullptr) {
-    av_free(av_io_ctx_);
-  }
   av_free(video_buffer_);
   av_free(frame_rgb_);
-  av_free(frame_yuv_);
   avcodec_close(video_codec_ctx_);
   avformat_close_input(&av_format_ctx_);
+  // The demuxer may have replaced the buffer, and does not free custom IO.
+  if (av_io_ctx_ != nullptr) {
+    av_freep(&av_io_ctx_->buffer);
+    av_freep(&av_io_ctx_);
+  }
 }
 
 void MediaPlayer::Init() {
@@ -186,6 +185,10 @@ void MediaPlayer::ReadAvCodec() {
     avcodec_free_context(&video_codec_ctx_);
     LOG(FATAL) << "Open bad video codec: avcodec_parameters_to_context!";
   }
+  // Decodes on several threads, on frames or slices as the codec supports,
+  // with as many threads as cores.
+  video_codec_ctx_->thread_count = 0;
+  video_codec_ctx_->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
   if (avcodec_open2(video_codec_ctx_, video_codec_, nullptr) < 0) {
     LOG(FATAL) << "Open bad video codec: avcodec_open2";
   }
@@ -224,9 +227,6 @@ void MediaPlayer::InitAvChannel() {
 }
 
 void MediaPlayer::InitVideoChannel() {
-  if ((frame_yuv_ = av_frame_alloc()) == nullptr) {
-    LOG(FATAL) << "Unable to allocate memory for a YUV frame!";
-  }
   if ((frame_rgb_ = av_frame_alloc()) == nullptr) {
     LOG(FATAL) << "Unable to allocate memory for a RGB frame!";
   }
@@ -265,8 +265,6 @@ void MediaPlayer::InitSdlDisplay() {
 }
 
 void MediaPlayer::PlayMedia() {
-  AVPacket pkt;
-
   sws_ctx_ = sws_getContext(video_codec_ctx_->width, video_codec_ctx_->height,
                             video_codec_ctx_->pix_fmt, video_codec_ctx_->width,
                             video_codec_ctx_->height, AV_PIX_FMT_RGB24,
@@ -279,88 +277,144 @@ void MediaPlayer::PlayMedia() {
     LOG(FATAL) << "Unable to read fonts: " << font_;
   }
 
-  SDL_Event evt;
-  // All timestamps are represented in milliseconds.
-  uint32_t local_start_time, local_current_time;
-  uint32_t video_start_time, video_current_time;
-
-  uint64_t frame_count = 0;
-  bool future_read = true;
+  // Decodes on its own thread, and renders on this one, which owns the SDL
+  // renderer.
+  std::thread decoder([this] { DecodeVideo(); });
+  RenderVideo();
+  decoder.join();
+}
 
-  StreamingAnnotateVideoResponse cur_resp, future_resp;
-  uint32_t last_updated_resp_offset;
-  while (av_read_frame(av_format_ctx_, &pkt) >= 0) {
+void MediaPlayer::DecodeVideo() {
+  AVPacket pkt;
+  bool open = true;
+  while (open && av_read_frame(av_format_ctx_, &pkt) >= 0) {
     if (pkt.stream_index == audio_stream_id_) {
       // Does nothing for now. We are not playing audio.
     }
     if (pkt.stream_index == video_stream_id_) {
+      // Skips non-reference frames, i.e. decodes less, while far behind.
+      int32_t lag_ms = lag_ms_;
+      if (lag_ms > kSkipNonRefLagMs) {
+        video_codec_ctx_->skip_frame = AVDISCARD_NONREF;
+      } else if (lag_ms <= kMaxFrameLateMs) {
+        video_codec_ctx_->skip_frame = AVDISCARD_DEFAULT;
+      }
       if (avcodec_send_packet(video_codec_ctx_, &pkt) < 0) {
         LOG(ERROR) << "Unable to send video packet to decoder!";
-        continue;
-      }
-      if (avcodec_receive_frame(video_codec_ctx_, frame_yuv_) < 0) {
-        LOG(ERROR) << "Unable to receive YUV frame!";
-        continue;
-      }
-      AVRational time_base =
-          av_format_ctx_->streams[video_stream_id_]->time_base;
-      int64_t pts = av_frame_get_best_effort_timestamp(frame_yuv_);
-      video_current_time =
-          static_cast<uint32_t>(pts * av_q2d(time_base) * 1000);
-      if (frame_count == 0) {
-        video_start_time = video_current_time;
-      }
-      uint32_t video_offset = video_current_time - video_start_time;
-
-      // Updates video frames.
-      SDL_UpdateYUVTexture(sdl_texture_, nullptr, frame_yuv_->data[0],
-                           frame_yuv_->linesize[0], frame_yuv_->data[1],
-                           frame_yuv_->linesize[1], frame_yuv_->data[2],
-                           frame_yuv_->linesize[2]);
-      SDL_RenderCopy(sdl_renderer_, sdl_texture_, nullptr, nullptr);
-
-      // Updates future rendering response.
-      if (annotation_response_queue_.Size() > 0) {
-        if (future_read) {
-          future_resp = annotation_response_queue_.Pop();
-          future_read = false;
-        }
-        if (future_resp.has_annotation_results() &&
-            GetAnnotationResponseTimestamp(future_resp) <= video_offset) {
-          cur_resp = future_resp;
-          future_read = true;
-          last_updated_resp_offset = video_offset;
-        }
-      }
-      // If renderer hasn't been updated with new values for too long, clear
-      // renderer.
-      if (cur_resp.has_annotation_results() &&
-          video_offset - last_updated_resp_offset <
-              GetRendererClearThreshold(cur_resp)) {
-        UpdateSDLRendererContent(cur_resp, video_codec_ctx_->width,
-                                 video_codec_ctx_->height, font_ptr_,
-                                 sdl_renderer_);
+      } else {
+        open = ReceiveFrames();
       }
+    }
+    av_packet_unref(&pkt);
+  }
+  // Drains the frames still in the decoder.
+  if (open && avcodec_send_packet(video_codec_ctx_, nullptr) >= 0) {
+    ReceiveFrames();
+  }
+  frame_queue_.Close();
+}
 
-      // Renders video on window.
-      if (frame_count == 0) {
-        local_start_time = SDL_GetTicks();
-      } else {
-        local_current_time = SDL_GetTicks();
-        int32_t wait_time =
-            video_offset - (local_current_time - local_start_time);
-        if (wait_time > 0) {
-          SDL_Delay(wait_time);
-        }
+bool MediaPlayer::ReceiveFrames() {
+  while (true) {
+    FramePtr frame(av_frame_alloc());
+    if (frame == nullptr) {
+      LOG(FATAL) << "Unable to allocate memory for a YUV frame!";
+    }
+    int res = avcodec_receive_frame(video_codec_ctx_, frame.get());
+    if (res == AVERROR(EAGAIN) || res == AVERROR_EOF) {
+      return true;
+    }
+    if (res < 0) {
+      LOG(ERROR) << "Unable to receive YUV frame!";
+      return true;
+    }
+    if (!frame_queue_.Push(frame)) {
+      return false;
+    }
+  }
+}
+
+void MediaPlayer::RenderVideo() {
+  SDL_Event evt;
+  // All timestamps are represented in milliseconds. Frames are presented on
+  // a master clock, the local time, started with the first frame.
+  uint32_t local_start_time;
+  uint32_t video_start_time, video_current_time;
+
+  uint64_t frame_count = 0;
+  bool future_read = true;
+
+  std::shared_ptr<const StreamingAnnotateVideoResponse> cur_resp, future_resp;
+  uint32_t last_updated_resp_offset;
+  const AVRational time_base =
+      av_format_ctx_->streams[video_stream_id_]->time_base;
+  FramePtr frame;
+  while (frame_queue_.Pop(&frame)) {
+    SDL_PollEvent(&evt);
+    int64_t pts = av_frame_get_best_effort_timestamp(frame.get());
+    video_current_time = static_cast<uint32_t>(pts * av_q2d(time_base) * 1000);
+    uint32_t local_current_time = SDL_GetTicks();
+    if (frame_count++ == 0) {
+      video_start_time = video_current_time;
+      local_start_time = local_current_time;
+    }
+    uint32_t video_offset = video_current_time - video_start_time;
+
+    // Updates future rendering response.
+    if (annotation_response_queue_.Size() > 0) {
+      if (future_read) {
+        future_resp = annotation_response_queue_.Pop();
+        future_read = false;
       }
+      if (future_resp->has_annotation_results() &&
+          GetAnnotationResponseTimestamp(*future_resp) <= video_offset) {
+        cur_resp = future_resp;
+        future_read = true;
+        last_updated_resp_offset = video_offset;
+      }
+    }
 
-      SDL_RenderPresent(sdl_renderer_);
-      SDL_UpdateWindowSurface(sdl_window_);
+    // Finds how late the frame is on the clock: waits if early, and drops
+    // it if late and the next one is ready.
+    int32_t lag_ms = static_cast<int32_t>(local_current_time -
+                                          local_start_time - video_offset);
+    if (lag_ms > kNoSyncThresholdMs) {
+      local_start_time = local_current_time - video_offset;
+      lag_ms = 0;
+    }
+    lag_ms_ = std::max(lag_ms, 0);
+    if (lag_ms > kMaxFrameLateMs && frame_queue_.Size() > 0) {
+      ++dropped_frames_;
+      continue;
+    }
+    if (lag_ms < 0) {
+      SDL_Delay(-lag_ms);
+    }
 
-      ++frame_count;
+    // Updates video frames.
+    SDL_UpdateYUVTexture(sdl_texture_, nullptr, frame->data[0],
+                         frame->linesize[0], frame->data[1],
+                         frame->linesize[1], frame->data[2],
+                         frame->linesize[2]);
+    SDL_RenderCopy(sdl_renderer_, sdl_texture_, nullptr, nullptr);
+
+    // If renderer hasn't been updated with new values for too long, clear
+    // renderer.
+    if (cur_resp != nullptr && cur_resp->has_annotation_results() &&
+        video_offset - last_updated_resp_offset <
+            GetRendererClearThreshold(*cur_resp)) {
+      UpdateSDLRendererContent(*cur_resp, frame->width, frame->height,
+                               font_ptr_, sdl_renderer_);
     }
-    SDL_PollEvent(&evt);
+    // Returns the frame's buffers to the decoder.
+    frame.reset();
+
+    // Renders video on window.
+    SDL_RenderPresent(sdl_renderer_);
+    SDL_UpdateWindowSurface(sdl_window_);
   }
+  LOG(INFO) << "Decoded " << frame_count << " video frames, dropped "
+            << dropped_frames_ << " late ones.";
 }
 
 void MediaPlayer::InitAudioChannel() {
@@ -414,22 +468,47 @@ void MediaPlayer::InitAudioQueue(AudioQueue* q) {
   q->cond = SDL_CreateCond();
 }
 
+void MediaPlayer::InsertStreamData(std::shared_ptr<const std::string> data) {
+  if (data != nullptr && !data->empty()) {
+    stream_queue_.Push(std::move(data));
+  }
+}
+
 void MediaPlayer::InsertStreamData(std::string data) {
-  int num_chunks =
-      std::ceil(static_cast<double>(data.size()) / kMaxStreamBufferSize);
-  for (int i = 0; i < num_chunks; ++i) {
-    int start = i * kMaxStreamBufferSize;
-    int rest = data.size() - start;
-    int size = (kMaxStreamBufferSize > rest) ? rest : kMaxStreamBufferSize;
-    if (size > 0) {
-      std::string tmp = data.substr(start, size);
-      stream_queue.Push(tmp);
+  InsertStreamData(std::make_shared<const std::string>(std::move(data)));
+}
+
+void MediaPlayer::EndStreamData() { stream_queue_.Close(); }
+
+int MediaPlayer::ReadStreamData(uint8_t* buf, int size) {
+  int read = 0;
+  while (read < size) {
+    if (stream_chunk_ == nullptr || stream_offset_ == stream_chunk_->size()) {
+      // Only waits for the first bytes, so the demuxer gets what is there.
+      if (read > 0 && stream_queue_.Size() == 0) {
+        break;
+      }
+      stream_chunk_.reset();
+      if (!stream_queue_.Pop(&stream_chunk_)) {
+        break;
+      }
+      stream_offset_ = 0;
     }
+    size_t bytes = std::min<size_t>(size - read,
+                                    stream_chunk_->size() - stream_offset_);
+    memcpy(buf + read, stream_chunk_->data() + stream_offset_, bytes);
+    stream_offset_ += bytes;
+    read += bytes;
   }
+  return read > 0 ? read : AVERROR_EOF;
+}
+
+int MediaPlayer::ReadStreamCallback(void* opaque, uint8_t* buf, int size) {
+  return static_cast<MediaPlayer*>(opaque)->ReadStreamData(buf, size);
 }
 
 void MediaPlayer::InsertAnnotationResponse(
-    StreamingAnnotateVideoResponse annotation_response) {
+    std::shared_ptr<const StreamingAnnotateVideoResponse> annotation_response) {
   annotation_response_queue_.Push(annotation_response);
 }
 
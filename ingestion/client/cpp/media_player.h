@@ -35,6 +35,10 @@ extern "C" {
 #include <libswscale/swscale.h>
 }
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "client/cpp/sync_queue.h"
@@ -64,11 +68,43 @@ typedef struct AudioQueue {
   SDL_cond* cond;
 } AudioQueue;
 
+// Sizes an annotation response queued for the player by its serialized
+// bytes.
+struct ResponseBytes {
+  size_t operator()(
+      const std::shared_ptr<const google::cloud::videointelligence::v1p3beta1::
+                                StreamingAnnotateVideoResponse>& resp) const {
+    return resp->ByteSizeLong();
+  }
+};
+
+// Frees a decoded frame, releasing its buffers.
+struct AVFrameDeleter {
+  void operator()(AVFrame* frame) const { av_frame_free(&frame); }
+};
+using FramePtr = std::unique_ptr<AVFrame, AVFrameDeleter>;
+
+// Sizes a shared chunk of encoded stream data by its bytes.
+struct ChunkBytes {
+  size_t operator()(const std::shared_ptr<const std::string>& chunk) const {
+    return chunk->size();
+  }
+};
+
 class MediaPlayer {
  public:
-  // Constructor and destructor.
+  // Default size of the buffer the demuxer reads piped input into.
+  static constexpr size_t kDefaultStreamBufferSize = 64 << 10;
+
+  // Constructor and destructor. Without a video path, the player reads the
+  // stream data inserted with InsertStreamData(), through a buffer of
+  // `stream_buffer_size` bytes. Once too much stream data is queued,
+  // inserting more waits with OverflowPolicy::kBlock, or drops the oldest
+  // with kDropOldest so that the player never holds up the stream source.
   MediaPlayer(const std::string& font, const std::string& video_path);
-  MediaPlayer(const std::string& font);
+  explicit MediaPlayer(const std::string& font,
+                       size_t stream_buffer_size = kDefaultStreamBufferSize,
+                       OverflowPolicy stream_policy = OverflowPolicy::kBlock);
   ~MediaPlayer();
 
   // Inits all necessary components for media player.
@@ -83,20 +119,40 @@ class MediaPlayer {
   // Inits SDL player.
   void InitSdlDisplay();
 
-  // Starts playing video.
+  // Starts playing video: decodes it on a separate thread, and renders it on
+  // this one. Returns at the end of the video.
   void PlayMedia();
 
-  // Inserts stream, label, object bounding box.
+  // Inserts stream data, following the stream policy while too much is
+  // queued. The chunk is shared, not copied.
+  void InsertStreamData(std::shared_ptr<const std::string> data);
   void InsertStreamData(std::string data);
 
-  // Inserts annotation response to queue.
+  // Marks the end of the stream data: the demuxer reaches the end of the
+  // stream once it has read what is queued.
+  void EndStreamData();
+
+  // Reads up to `size` bytes of stream data into `buf`, waiting for the
+  // first ones. Returns the number of bytes read, or AVERROR_EOF at the end
+  // of the stream.
+  int ReadStreamData(uint8_t* buf, int size);
+
+  // Inserts annotation response to queue. The response is shared, not
+  // copied.
   void InsertAnnotationResponse(
-      google::cloud::videointelligence::v1p3beta1::
-          StreamingAnnotateVideoResponse annotation_response);
+      std::shared_ptr<const google::cloud::videointelligence::v1p3beta1::
+                          StreamingAnnotateVideoResponse>
+          annotation_response);
+
+  // Gets the number of decoded frames dropped because they were late.
+  uint64_t DroppedFrames() const { return dropped_frames_; }
+
+  // Gets how late the latest frame was, in milliseconds.
+  int32_t LagMs() const { return lag_ms_; }
 
  private:
-  // Stream callback function.
-  int StreamCallback(void* userdata, uint8_t* stream, int len);
+  // AVIO callback: reads the stream data of the player `opaque`.
+  static int ReadStreamCallback(void* opaque, uint8_t* buf, int size);
 
   // Inits video and audio channel.
   void InitVideoChannel();
@@ -105,6 +161,19 @@ class MediaPlayer {
   // Inits audio queue and player.
   void InitAudioQueue(AudioQueue* q);
 
+  // Demuxes and decodes the video into `frame_queue_`, and closes it at the
+  // end.
+  void DecodeVideo();
+
+  // Queues all frames the decoder has ready. Returns false if the queue is
+  // closed.
+  bool ReceiveFrames();
+
+  // Renders the frames of `frame_queue_`, with their annotations, at their
+  // pace. Late frames are dropped to catch up, and the decoder skips
+  // non-reference frames while far behind.
+  void RenderVideo();
+
   // Video and audio stream index.
   int video_stream_id_;
   int audio_stream_id_;
@@ -128,7 +197,6 @@ class MediaPlayer {
   AVCodec* audio_codec_ = nullptr;
 
   // Video frame.
-  AVFrame* frame_yuv_ = nullptr;
   AVFrame* frame_rgb_ = nullptr;
 
   // Video and encoded stream buffer.
@@ -157,11 +225,41 @@ class MediaPlayer {
   // Video path.
   std::string video_path_;
 
+  // Max annotation response bytes queued: 16 MBytes. The oldest responses
+  // are dropped beyond it, as they are outdated anyway.
+  static constexpr size_t kMaxAnnotationQueueBytes = 16 << 20;
+
+  // Max encoded stream bytes queued: 64 MBytes. Beyond it, inserting stream
+  // data follows the stream policy.
+  static constexpr size_t kMaxStreamQueueBytes = 64 << 20;
+
+  // Max decoded video frames queued for rendering. Decoding ahead absorbs
+  // variations in decoding time, at the cost of memory: 12 MBytes per 4K
+  // frame.
+  static constexpr size_t kMaxQueuedFrames = 8;
+
+  // Late frames dropped, and the latest frame's lag.
+  std::atomic<uint64_t> dropped_frames_{0};
+  std::atomic<int32_t> lag_ms_{0};
+
+  // Encoded stream chunks, from InsertStreamData() to the demuxer. An empty
+  // queue that is closed ends the stream.
+  SyncQueue<std::shared_ptr<const std::string>, ChunkBytes, QueueStats>
+      stream_queue_{kMaxStreamQueueBytes};
+
+  // Chunk being demuxed, and its bytes demuxed so far.
+  std::shared_ptr<const std::string> stream_chunk_;
+  size_t stream_offset_ = 0;
+
+  // Decoded video frames, from the decoding to the rendering thread.
+  SyncQueue<FramePtr, ElementCount, QueueStats> frame_queue_{kMaxQueuedFrames};
+
   // Synchronous queue.
-  SyncQueue<
-      google::cloud::videointelligence::v1p3beta1::
-      StreamingAnnotateVideoResponse>
-      annotation_response_queue_;
+  SyncQueue<std::shared_ptr<const google::cloud::videointelligence::
+                                v1p3beta1::StreamingAnnotateVideoResponse>,
+            ResponseBytes, QueueStats>
+      annotation_response_queue_{kMaxAnnotationQueueBytes,
+                                 OverflowPolicy::kDropOldest};
 };
 
 }  // namespace video
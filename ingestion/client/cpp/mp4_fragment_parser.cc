@@ -0,0 +1,292 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/mp4_fragment_parser.h"
+
+#include <algorithm>
+
+namespace api {
+namespace video {
+
+namespace {
+
+// Box header sizes (in bytes).
+constexpr size_t kBoxHeaderSize = 8;
+constexpr size_t kLargeBoxHeaderSize = 16;
+// Largest 'ftyp', 'moov' or 'moof' box we keep in memory: 64 MBytes.
+constexpr uint64_t kMaxKeptBoxSize = 64 * 1024 * 1024;
+
+constexpr uint32_t FourCc(const char (&type)[5]) {
+  return (static_cast<uint32_t>(type[0]) << 24) |
+         (static_cast<uint32_t>(type[1]) << 16) |
+         (static_cast<uint32_t>(type[2]) << 8) | static_cast<uint32_t>(type[3]);
+}
+
+constexpr uint32_t kFtyp = FourCc("ftyp");
+constexpr uint32_t kHdlr = FourCc("hdlr");
+constexpr uint32_t kMdat = FourCc("mdat");
+constexpr uint32_t kMdhd = FourCc("mdhd");
+constexpr uint32_t kMdia = FourCc("mdia");
+constexpr uint32_t kMoof = FourCc("moof");
+constexpr uint32_t kMoov = FourCc("moov");
+constexpr uint32_t kTfdt = FourCc("tfdt");
+constexpr uint32_t kTfhd = FourCc("tfhd");
+constexpr uint32_t kTkhd = FourCc("tkhd");
+constexpr uint32_t kTraf = FourCc("traf");
+constexpr uint32_t kTrak = FourCc("trak");
+constexpr uint32_t kVide = FourCc("vide");
+
+// Reads big-endian integers.
+uint32_t ReadU32(const char* data) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  return (static_cast<uint32_t>(p[0]) << 24) |
+         (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+uint64_t ReadU64(const char* data) {
+  return (static_cast<uint64_t>(ReadU32(data)) << 32) | ReadU32(data + 4);
+}
+
+// Finds the child box at `*pos` within [data, data + size) and advances
+// `*pos` past it. Returns false at the end or on a malformed box.
+bool NextChildBox(const char* data, size_t size, size_t* pos, uint32_t* type,
+                  const char** body, size_t* body_size) {
+  if (*pos + kBoxHeaderSize > size) {
+    return false;
+  }
+  uint64_t box_size = ReadU32(data + *pos);
+  *type = ReadU32(data + *pos + 4);
+  size_t header_size = kBoxHeaderSize;
+  if (box_size == 1) {
+    if (*pos + kLargeBoxHeaderSize > size) {
+      return false;
+    }
+    box_size = ReadU64(data + *pos + 8);
+    header_size = kLargeBoxHeaderSize;
+  } else if (box_size == 0) {
+    box_size = size - *pos;
+  }
+  if (box_size < header_size || box_size > size - *pos) {
+    return false;
+  }
+  *body = data + *pos + header_size;
+  *body_size = box_size - header_size;
+  *pos += box_size;
+  return true;
+}
+
+}  // namespace
+
+bool Mp4FragmentParser::Parse(const char* data, size_t size,
+                              std::vector<Mp4Fragment>* fragments) {
+  size_t pos = 0;
+  while (!invalid_ && pos < size) {
+    // Skips media data and boxes we don't need.
+    if (skip_bytes_ > 0) {
+      size_t n = std::min<uint64_t>(skip_bytes_, size - pos);
+      pos += n;
+      skip_bytes_ -= n;
+      bytes_parsed_ += n;
+      continue;
+    }
+
+    // Collects a box we keep.
+    if (box_size_ > 0) {
+      size_t n = std::min<uint64_t>(box_size_ - box_.size(), size - pos);
+      box_.append(data + pos, n);
+      pos += n;
+      bytes_parsed_ += n;
+      if (box_.size() == box_size_) {
+        HandleBox(fragments);
+        box_.clear();
+        box_size_ = 0;
+      }
+      continue;
+    }
+
+    // Reads the next top-level box header.
+    if (header_.empty()) {
+      box_offset_ = bytes_parsed_;
+    }
+    size_t header_size = kBoxHeaderSize;
+    if (header_.size() >= 4 && ReadU32(header_.data()) == 1) {
+      header_size = kLargeBoxHeaderSize;
+    }
+    size_t n = std::min(header_size - header_.size(), size - pos);
+    header_.append(data + pos, n);
+    pos += n;
+    bytes_parsed_ += n;
+    if (header_.size() < header_size ||
+        (header_size == kBoxHeaderSize && ReadU32(header_.data()) == 1)) {
+      continue;
+    }
+
+    uint64_t box_size = ReadU32(header_.data());
+    uint32_t box_type = ReadU32(header_.data() + 4);
+    if (box_size == 1) {
+      box_size = ReadU64(header_.data() + 8);
+    }
+    if (!has_ftyp_ && box_type != kFtyp) {
+      invalid_ = true;
+    } else if (box_size == 0) {
+      // The box extends to the end of the stream.
+      invalid_ = (box_type != kMdat);
+      skip_bytes_ = UINT64_MAX;
+    } else if (box_size < header_.size()) {
+      invalid_ = true;
+    } else if (box_type == kFtyp || box_type == kMoov || box_type == kMoof) {
+      if (box_size > kMaxKeptBoxSize) {
+        invalid_ = true;
+      } else {
+        box_type_ = box_type;
+        box_size_ = box_size;
+        box_ = header_;
+        if (box_.size() == box_size_) {
+          HandleBox(fragments);
+          box_.clear();
+          box_size_ = 0;
+        }
+      }
+    } else {
+      skip_bytes_ = box_size - header_.size();
+    }
+    header_.clear();
+  }
+  return !invalid_;
+}
+
+void Mp4FragmentParser::Skip(uint64_t size) {
+  size = std::min(size, skip_bytes_);
+  skip_bytes_ -= size;
+  bytes_parsed_ += size;
+}
+
+void Mp4FragmentParser::HandleBox(std::vector<Mp4Fragment>* fragments) {
+  size_t header_size =
+      (ReadU32(box_.data()) == 1) ? kLargeBoxHeaderSize : kBoxHeaderSize;
+  const char* body = box_.data() + header_size;
+  size_t body_size = box_.size() - header_size;
+  if (box_type_ == kFtyp) {
+    init_segment_ = box_;
+    has_ftyp_ = true;
+  } else if (box_type_ == kMoov) {
+    init_segment_.append(box_);
+    ParseMoov(body, body_size);
+    has_moov_ = true;
+  } else if (box_type_ == kMoof && has_moov_) {
+    Mp4Fragment fragment;
+    fragment.offset = box_offset_;
+    if (ParseMoof(body, body_size, &fragment.decode_time_us)) {
+      fragments->push_back(fragment);
+    }
+  }
+}
+
+void Mp4FragmentParser::ParseMoov(const char* data, size_t size) {
+  size_t pos = 0;
+  uint32_t type;
+  const char* body;
+  size_t body_size;
+  while (NextChildBox(data, size, &pos, &type, &body, &body_size)) {
+    if (type != kTrak) {
+      continue;
+    }
+    uint32_t track_id = 0;
+    uint32_t timescale = 0;
+    uint32_t handler = 0;
+    size_t trak_pos = 0;
+    const char* trak_data = body;
+    size_t trak_size = body_size;
+    while (NextChildBox(trak_data, trak_size, &trak_pos, &type, &body,
+                        &body_size)) {
+      if (type == kTkhd && body_size >= 24) {
+        // Version 1 has 64-bit creation and modification times.
+        track_id = ReadU32(body + (body[0] == 1 ? 20 : 12));
+      } else if (type == kMdia) {
+        size_t mdia_pos = 0;
+        const char* mdia_data = body;
+        size_t mdia_size = body_size;
+        while (NextChildBox(mdia_data, mdia_size, &mdia_pos, &type, &body,
+                            &body_size)) {
+          if (type == kMdhd && body_size >= 24) {
+            timescale = ReadU32(body + (body[0] == 1 ? 20 : 12));
+          } else if (type == kHdlr && body_size >= 12) {
+            handler = ReadU32(body + 8);
+          }
+        }
+      }
+    }
+    if (track_id != 0 && timescale != 0) {
+      timescales_[track_id] = timescale;
+      if (handler == kVide && video_track_id_ == 0) {
+        video_track_id_ = track_id;
+      }
+    }
+  }
+}
+
+bool Mp4FragmentParser::ParseMoof(const char* data, size_t size,
+                                  int64_t* decode_time_us) {
+  size_t pos = 0;
+  uint32_t type;
+  const char* body;
+  size_t body_size;
+  while (NextChildBox(data, size, &pos, &type, &body, &body_size)) {
+    if (type != kTraf) {
+      continue;
+    }
+    uint32_t track_id = 0;
+    bool has_decode_time = false;
+    uint64_t decode_time = 0;
+    size_t traf_pos = 0;
+    const char* traf_data = body;
+    size_t traf_size = body_size;
+    while (NextChildBox(traf_data, traf_size, &traf_pos, &type, &body,
+                        &body_size)) {
+      if (type == kTfhd && body_size >= 8) {
+        track_id = ReadU32(body + 4);
+      } else if (type == kTfdt && body_size >= 8) {
+        if (body[0] == 1 && body_size >= 12) {
+          decode_time = ReadU64(body + 4);
+        } else {
+          decode_time = ReadU32(body + 4);
+        }
+        has_decode_time = true;
+      }
+    }
+    if (!has_decode_time ||
+        (video_track_id_ != 0 && track_id != video_track_id_)) {
+      continue;
+    }
+    auto it = timescales_.find(track_id);
+    if (it == timescales_.end()) {
+      return false;
+    }
+    uint64_t timescale = it->second;
+    *decode_time_us = (decode_time / timescale) * 1000000 +
+                      (decode_time % timescale) * 1000000 / timescale;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace video
+}  // namespace api
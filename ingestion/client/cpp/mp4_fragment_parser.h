@@ -0,0 +1,116 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_MP4_FRAGMENT_PARSER_H_
+#define API_VIDEO_CLIENT_CPP_MP4_FRAGMENT_PARSER_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace api {
+namespace video {
+
+// A movie fragment ('moof' box) in a fragmented MP4 byte stream.
+struct Mp4Fragment {
+  // Byte offset of the 'moof' box from the start of the stream.
+  int64_t offset;
+  // Decode time of the first video sample in the fragment (microseconds).
+  int64_t decode_time_us;
+};
+
+// Incrementally scans the top-level boxes of a fragmented MP4 (ISO BMFF)
+// byte stream. It keeps the init segment ('ftyp' and 'moov' boxes), which a
+// decoder needs before any fragment, and reports fragment boundaries where
+// the stream can be cut and resumed. Media data is skipped, never copied.
+class Mp4FragmentParser {
+ public:
+  Mp4FragmentParser() = default;
+  ~Mp4FragmentParser() = default;
+
+  // Disallows copy and assign.
+  Mp4FragmentParser(const Mp4FragmentParser&) = delete;
+  Mp4FragmentParser& operator=(const Mp4FragmentParser&) = delete;
+
+  // Parses the next `size` bytes of the stream. Fragments whose 'moof' box
+  // completes within these bytes are appended to `fragments`.
+  // Returns false if the stream is not a fragmented MP4.
+  bool Parse(const char* data, size_t size,
+             std::vector<Mp4Fragment>* fragments);
+
+  // Whether the whole init segment has been received.
+  bool has_init_segment() const { return has_moov_; }
+
+  // Gets the init segment ('ftyp' and 'moov' boxes).
+  const std::string& init_segment() const { return init_segment_; }
+
+  // Gets the number of stream bytes parsed so far.
+  int64_t bytes_parsed() const { return bytes_parsed_; }
+
+  // Gets the number of upcoming stream bytes that the parser ignores (media
+  // data). A caller reading from a file can seek over them and call Skip().
+  uint64_t skippable_bytes() const { return skip_bytes_; }
+
+  // Skips `size` bytes, at most skippable_bytes().
+  void Skip(uint64_t size);
+
+  // Whether the stream has been rejected as not a fragmented MP4.
+  bool is_invalid() const { return invalid_; }
+
+ private:
+  // Handles a complete top-level box kept in `box_`.
+  void HandleBox(std::vector<Mp4Fragment>* fragments);
+
+  // Reads track ids, timescales and the video track from a 'moov' box body.
+  void ParseMoov(const char* data, size_t size);
+
+  // Reads the video decode time from a 'moof' box body.
+  bool ParseMoof(const char* data, size_t size, int64_t* decode_time_us);
+
+  // Stream bytes parsed so far.
+  int64_t bytes_parsed_ = 0;
+  // Stream offset of the box being parsed.
+  int64_t box_offset_ = 0;
+  // Header bytes of the box being parsed.
+  std::string header_;
+  // Full bytes of the box being parsed, if it's a box we keep.
+  std::string box_;
+  // Size of the box being kept.
+  uint64_t box_size_ = 0;
+  // Bytes left to skip in a box we don't keep.
+  uint64_t skip_bytes_ = 0;
+  // Type of the box being kept.
+  uint32_t box_type_ = 0;
+  // Init segment.
+  std::string init_segment_;
+  bool has_ftyp_ = false;
+  bool has_moov_ = false;
+  bool invalid_ = false;
+  // Timescale per track id.
+  std::map<uint32_t, uint32_t> timescales_;
+  // Video track id, 0 if unknown.
+  uint32_t video_track_id_ = 0;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  // API_VIDEO_CLIENT_CPP_MP4_FRAGMENT_PARSER_H_
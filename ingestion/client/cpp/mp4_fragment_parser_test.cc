@@ -0,0 +1,101 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/mp4_fragment_parser.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace api {
+namespace video {
+namespace {
+
+std::string U32(uint32_t v) {
+  std::string s(4, 0);
+  for (int i = 0; i < 4; ++i) {
+    s[i] = static_cast<char>((v >> (24 - 8 * i)) & 255);
+  }
+  return s;
+}
+
+std::string Box(const std::string& type, const std::string& body) {
+  return U32(8 + body.size()) + type + body;
+}
+
+// Builds a 'moof' box of video track 1 with a version 1 'tfdt'.
+std::string Moof(uint64_t decode_time) {
+  std::string tfdt = U32(0x01000000) + U32(decode_time >> 32) +
+                     U32(decode_time & 0xffffffff);
+  return Box("moof", Box("traf", Box("tfhd", U32(0) + U32(1)) +
+                                     Box("tfdt", tfdt)));
+}
+
+TEST(Mp4FragmentParserTest, FindsInitSegmentAndFragments) {
+  // 'tkhd' and 'mdhd' version 0: track id / timescale at byte 12.
+  std::string tkhd = U32(0) + U32(0) + U32(0) + U32(1) + std::string(8, 0);
+  std::string mdhd = U32(0) + U32(0) + U32(0) + U32(90000) + std::string(8, 0);
+  std::string hdlr = U32(0) + U32(0) + "vide" + std::string(12, 0);
+  std::string init =
+      Box("ftyp", "isom" + U32(0)) +
+      Box("moov", Box("trak", Box("tkhd", tkhd) +
+                                  Box("mdia", Box("mdhd", mdhd) +
+                                                  Box("hdlr", hdlr))));
+  std::string mdat = Box("mdat", std::string(1000, 'x'));
+  std::string stream = init + Moof(90000) + mdat + Moof(270000) + mdat;
+
+  // Feeds the stream in small pieces to exercise partial boxes.
+  Mp4FragmentParser parser;
+  std::vector<Mp4Fragment> fragments;
+  for (size_t pos = 0; pos < stream.size(); pos += 7) {
+    ASSERT_TRUE(parser.Parse(stream.data() + pos,
+                             std::min<size_t>(7, stream.size() - pos),
+                             &fragments));
+  }
+  EXPECT_EQ(stream.size(), parser.bytes_parsed());
+  ASSERT_TRUE(parser.has_init_segment());
+  EXPECT_EQ(init, parser.init_segment());
+  ASSERT_EQ(2, fragments.size());
+  EXPECT_EQ(init.size(), fragments[0].offset);
+  EXPECT_EQ(1000000, fragments[0].decode_time_us);
+  EXPECT_EQ(init.size() + Moof(0).size() + mdat.size(), fragments[1].offset);
+  EXPECT_EQ(3000000, fragments[1].decode_time_us);
+}
+
+TEST(Mp4FragmentParserTest, RejectsOtherContainers) {
+  // An MPEG-TS packet.
+  std::string stream(188, 0);
+  stream[0] = 0x47;
+  Mp4FragmentParser parser;
+  std::vector<Mp4Fragment> fragments;
+  EXPECT_FALSE(parser.Parse(stream.data(), stream.size(), &fragments));
+  EXPECT_TRUE(parser.is_invalid());
+  EXPECT_TRUE(fragments.empty());
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
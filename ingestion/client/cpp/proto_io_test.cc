@@ -18,7 +18,9 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "client/cpp/proto_reader.h"
 #include "client/cpp/proto_writer.h"
@@ -89,6 +91,209 @@ TEST(ProtoIo, ProtoReaderWriterTest) {
   reader.Close();
 }
 
+TEST(ProtoIo, BufferedWriterTest) {
+  const std::string filename =
+      std::string(getenv("TEST_TMPDIR")) + "/buffered_proto.io";
+
+  // Small blocks, so that records span many blocks and some are larger
+  // than a block.
+  ProtoWriter::Options options;
+  options.block_size = 64;
+  options.sync_records = 7;
+  options.sync_interval_ms = 5;
+  ProtoWriter writer(filename, options);
+  ASSERT_TRUE(writer.Open());
+  std::vector<StreamingVideoAnnotationResults> results(100);
+  int64_t size = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    for (size_t j = 0; j <= i % 5; ++j) {
+      results[i].add_shot_annotations()->mutable_start_time_offset()
+          ->set_seconds(i * 10 + j);
+    }
+    ASSERT_TRUE(writer.WriteProto(results[i]));
+    size += 4 + results[i].ByteSizeLong();
+    if (i == 49) {
+      ASSERT_TRUE(writer.Flush());
+      ASSERT_EQ(size, writer.Size());
+    }
+  }
+  writer.Close();
+
+  // Continues the file after the first half.
+  int64_t half_size = 0;
+  for (size_t i = 0; i < 50; ++i) {
+    half_size += 4 + results[i].ByteSizeLong();
+  }
+  ProtoWriter appender(filename, options);
+  ASSERT_TRUE(appender.OpenAt(half_size));
+  ASSERT_EQ(half_size, appender.Size());
+  for (size_t i = 50; i < results.size(); ++i) {
+    ASSERT_TRUE(appender.WriteProto(results[i]));
+  }
+  ASSERT_TRUE(appender.Flush());
+  ASSERT_EQ(size, appender.Size());
+  appender.Close();
+
+  ProtoReader reader(filename);
+  ASSERT_TRUE(reader.Open());
+  for (size_t i = 0; i < results.size(); ++i) {
+    StreamingVideoAnnotationResults res;
+    ASSERT_TRUE(reader.ReadProto(&res));
+    ASSERT_EQ(results[i].ShortDebugString(), res.ShortDebugString());
+  }
+  StreamingVideoAnnotationResults res;
+  ASSERT_FALSE(reader.ReadProto(&res));
+  reader.Close();
+}
+
+TEST(ProtoIo, LargeRecordsTest) {
+  const std::string filename =
+      std::string(getenv("TEST_TMPDIR")) + "/large_proto.io";
+
+  // Records from a few bytes to several MBytes, larger than the read buffer.
+  std::vector<StreamingVideoAnnotationResults> results(6);
+  ProtoWriter writer(filename);
+  ASSERT_TRUE(writer.Open());
+  for (size_t i = 0; i < results.size(); ++i) {
+    int num_frames = (i % 2 == 0) ? 1 : 200000 * i;
+    auto* object = results[i].add_object_annotations();
+    object->set_track_id(i);
+    for (int j = 0; j < num_frames; ++j) {
+      object->add_frames()->mutable_normalized_bounding_box()->set_left(0.5);
+    }
+    ASSERT_TRUE(writer.WriteProto(results[i]));
+  }
+  writer.Close();
+
+  ProtoReader reader(filename);
+  ASSERT_TRUE(reader.Open());
+  StreamingVideoAnnotationResults res1, res2, res3;
+  ASSERT_EQ(2, reader.ReadProtos({&res1, &res2}));
+  ASSERT_EQ(results[0].SerializeAsString(), res1.SerializeAsString());
+  ASSERT_EQ(results[1].SerializeAsString(), res2.SerializeAsString());
+  ASSERT_EQ(3, reader.ReadProtos({&res1, &res2, &res3}));
+  ASSERT_EQ(results[2].SerializeAsString(), res1.SerializeAsString());
+  ASSERT_EQ(results[3].SerializeAsString(), res2.SerializeAsString());
+  ASSERT_EQ(results[4].SerializeAsString(), res3.SerializeAsString());
+  // A record larger than the caller's buffer is not read.
+  char data[16];
+  ASSERT_EQ(0, reader.ReadBytes(sizeof(data), data));
+  ASSERT_FALSE(reader.ReadProto(&res1));
+  reader.Close();
+}
+
+TEST(ProtoIo, TimeIndexTest) {
+  const std::string filename =
+      std::string(getenv("TEST_TMPDIR")) + "/indexed_proto.io";
+
+  // Writes results at 1 ms intervals, with an index entry every 16.
+  ProtoWriter::Options options;
+  options.block_size = 1024;
+  options.index_interval = 16;
+  std::vector<int64_t> offsets;
+  ProtoWriter writer(filename, options);
+  ASSERT_TRUE(writer.Open());
+  for (int i = 0; i < 500; ++i) {
+    StreamingVideoAnnotationResults res;
+    res.add_shot_annotations()->mutable_end_time_offset()->set_nanos(i);
+    offsets.push_back(writer.Size());
+    ASSERT_TRUE(writer.WriteProto(res, i * 1000));
+  }
+  writer.Close();
+
+  // Continues the file after 300 results.
+  ProtoWriter appender(filename, options);
+  ASSERT_TRUE(appender.OpenAt(offsets[300], 299 * 1000));
+  for (int i = 300; i < 1000; ++i) {
+    StreamingVideoAnnotationResults res;
+    res.add_shot_annotations()->mutable_end_time_offset()->set_nanos(i);
+    ASSERT_TRUE(appender.WriteProto(res, i * 1000));
+  }
+  appender.Close();
+
+  ProtoReader reader(filename);
+  ASSERT_TRUE(reader.Open());
+  for (int i : {0, 1, 15, 16, 17, 299, 300, 301, 500, 999, 2000}) {
+    ASSERT_TRUE(reader.SeekToTime(i * 1000));
+    StreamingVideoAnnotationResults res;
+    ASSERT_TRUE(reader.ReadProto(&res));
+    int first = res.shot_annotations(0).end_time_offset().nanos();
+    EXPECT_LE(first, i);
+    EXPECT_GT(first + 16, std::min(i, 999));
+    // Results follow in order.
+    while (first < std::min(i, 999)) {
+      ASSERT_TRUE(reader.ReadProto(&res));
+      ASSERT_EQ(++first, res.shot_annotations(0).end_time_offset().nanos());
+    }
+  }
+  reader.Close();
+}
+
+TEST(ProtoIo, CompressedTest) {
+  const std::string filename =
+      std::string(getenv("TEST_TMPDIR")) + "/compressed_proto.io";
+
+  ProtoWriter::Options options;
+  options.block_size = 1024;
+  options.index_interval = 16;
+  options.compress = true;
+  std::vector<StreamingVideoAnnotationResults> results(1000);
+  std::vector<int64_t> offsets;
+  ProtoWriter writer(filename, options);
+  ASSERT_TRUE(writer.Open());
+  for (int i = 0; i < 500; ++i) {
+    results[i].add_shot_annotations()->mutable_end_time_offset()->set_nanos(i);
+    offsets.push_back(writer.Size());
+    ASSERT_TRUE(writer.WriteProto(results[i], i * 1000));
+  }
+  writer.Close();
+
+  // Continues the file after 300 results, in the middle of a block.
+  ProtoWriter appender(filename, options);
+  ASSERT_TRUE(appender.OpenAt(offsets[300], 299 * 1000));
+  ASSERT_EQ(offsets[300], appender.Size());
+  offsets.resize(300);
+  for (int i = 300; i < 1000; ++i) {
+    results[i].add_shot_annotations()->mutable_end_time_offset()->set_nanos(i);
+    offsets.push_back(appender.Size());
+    ASSERT_TRUE(appender.WriteProto(results[i], i * 1000));
+  }
+  int64_t size = appender.Size();
+  appender.Close();
+
+  FILE* file = fopen(filename.c_str(), "r");
+  ASSERT_NE(nullptr, file);
+  fseek(file, 0, SEEK_END);
+  EXPECT_LT(ftell(file), size);
+  fclose(file);
+
+  ProtoReader reader(filename);
+  ASSERT_TRUE(reader.Open());
+  for (size_t i = 0; i < results.size(); ++i) {
+    StreamingVideoAnnotationResults res;
+    ASSERT_TRUE(reader.ReadProto(&res));
+    ASSERT_EQ(results[i].ShortDebugString(), res.ShortDebugString());
+  }
+  StreamingVideoAnnotationResults res;
+  ASSERT_FALSE(reader.ReadProto(&res));
+
+  // Seeks to record offsets and media times in decompressed records.
+  for (int i : {0, 1, 299, 300, 999}) {
+    ASSERT_TRUE(reader.Seek(offsets[i]));
+    ASSERT_TRUE(reader.ReadProto(&res));
+    ASSERT_EQ(i, res.shot_annotations(0).end_time_offset().nanos());
+    ASSERT_TRUE(reader.SeekToTime(i * 1000));
+    ASSERT_TRUE(reader.ReadProto(&res));
+    int first = res.shot_annotations(0).end_time_offset().nanos();
+    EXPECT_LE(first, i);
+    EXPECT_GT(first + 16, i);
+  }
+  ASSERT_TRUE(reader.Seek(size));
+  ASSERT_FALSE(reader.ReadProto(&res));
+  ASSERT_FALSE(reader.Seek(size + 1));
+  reader.Close();
+}
+
 }  // namespace
 }  // namespace video
 }  // namespace api
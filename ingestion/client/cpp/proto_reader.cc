@@ -20,62 +20,308 @@
 
 #include "client/cpp/proto_reader.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "client/cpp/compressed_block.h"
+#include "client/cpp/time_index.h"
 #include "glog/logging.h"
 
 namespace api {
 namespace video {
 
-// Maximum data read: 10 KBytes.
-constexpr int kMaxDataRead = 10 * 1024;
+namespace {
+
+using ::google::protobuf::io::CodedInputStream;
+
+// Size of the record length prefix.
+constexpr size_t kLengthSize = 4;
+// Initial read buffer size, and minimum size of a file read: 1 MByte.
+constexpr size_t kReadSize = 1024 * 1024;
+// Larger records are treated as corrupt: 256 MBytes.
+constexpr size_t kMaxRecordSize = 256 * 1024 * 1024;
+
+// Reads up to `size` bytes, fewer only at the end of the file. Returns the
+// number of bytes read, or -1 on error.
+ssize_t ReadFully(int fd, char* data, size_t size) {
+  size_t total = 0;
+  while (total < size) {
+    ssize_t bytes_read = read(fd, data + total, size - total);
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read < 0) {
+      return -1;
+    }
+    if (bytes_read == 0) {
+      break;
+    }
+    total += bytes_read;
+  }
+  return total;
+}
+
+}  // namespace
 
 ProtoReader::ProtoReader(const std::string& path)
     : IOReader(path), file_name_(path) {}
 
+ProtoReader::~ProtoReader() { Close(); }
+
 bool ProtoReader::Open() {
-  file_fd_.reset(new std::ifstream(file_name_, std::ifstream::binary));
-  if (!file_fd_->is_open()) {
-    LOG(ERROR) << "Failed to open read file " << file_name_;
+  fd_ = open(file_name_.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    LOG(ERROR) << "Failed to open read file " << file_name_ << ": "
+               << strerror(errno);
     return false;
   }
+  posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+  compressed_ = IsCompressedLog(fd_);
+  blocks_.clear();
+  if (compressed_ && lseek(fd_, kCompressedLogMagicSize, SEEK_SET) < 0) {
+    LOG(ERROR) << "Failed to seek " << file_name_ << ": " << strerror(errno);
+    Close();
+    return false;
+  }
+  if (buffer_ == nullptr) {
+    buffer_.reset(new char[kReadSize]);
+    buffer_size_ = kReadSize;
+  }
+  begin_ = 0;
+  end_ = 0;
   return true;
 }
 
 size_t ProtoReader::ReadBytes(size_t max_bytes_read, char* data) {
   CHECK(data != nullptr);
-  memset(data, 0, max_bytes_read);
-
-  size_t bytes_read;
-  char bytes_size[4];  // size of uint32_t
-  file_fd_->read(bytes_size, 4);
-  if (file_fd_->gcount() == 4) {
-    bytes_read = static_cast<int>(bytes_size[0]) +
-                 (static_cast<int>(bytes_size[1]) << 8) +
-                 (static_cast<int>(bytes_size[2]) << 16) +
-                 (static_cast<int>(bytes_size[3]) << 24);
-    // Confirms that max allowable data is larger than bytes_read.
-    // If not, exits the process.
-    CHECK(bytes_read < max_bytes_read);
-    // Reads bytes of exact bytes_read size.
-    file_fd_->read(data, bytes_read);
-    // Confirms that read bytes is of the size bytes_read.
-    // If not, exits the process.
-    CHECK(bytes_read == static_cast<size_t>(file_fd_->gcount()));
-    return bytes_read;
-  }
-  return 0;
+
+  const char* record;
+  size_t size;
+  if (!NextRecord(&record, &size)) {
+    return 0;
+  }
+  if (size > max_bytes_read) {
+    LOG(ERROR) << "Record of " << size << " bytes in " << file_name_
+               << " is larger than " << max_bytes_read << " bytes";
+    return 0;
+  }
+  memcpy(data, record, size);
+  return size;
 }
 
 bool ProtoReader::ReadProto(google::protobuf::MessageLite* message) {
   CHECK(message != nullptr);
-  char data[kMaxDataRead];
-  size_t bytes_read = ReadBytes(kMaxDataRead, data);
-  if (bytes_read > 0) {
-    return message->ParseFromArray(data, bytes_read);
+  const char* record;
+  size_t size;
+  if (!NextRecord(&record, &size)) {
+    return false;
+  }
+  return message->ParseFromArray(record, size);
+}
+
+size_t ProtoReader::ReadProtos(
+    const std::vector<google::protobuf::MessageLite*>& messages) {
+  size_t count = 0;
+  while (count < messages.size() && ReadProto(messages[count])) {
+    ++count;
+  }
+  return count;
+}
+
+bool ProtoReader::Seek(int64_t offset) {
+  int64_t file_offset = offset;
+  size_t skip = 0;
+  if (fd_ >= 0 && compressed_ && !FindBlock(offset, &file_offset, &skip)) {
+    file_offset = -1;
+  }
+  if (fd_ < 0 || file_offset < 0 || lseek(fd_, file_offset, SEEK_SET) < 0) {
+    LOG(ERROR) << "Failed to seek " << file_name_ << " to " << offset;
+    return false;
+  }
+  begin_ = 0;
+  end_ = 0;
+  // Decompresses the block and skips to the record.
+  if (skip > 0) {
+    if (!Fill(skip)) {
+      LOG(ERROR) << "Failed to seek " << file_name_ << " to " << offset;
+      return false;
+    }
+    begin_ += skip;
+  }
+  return true;
+}
+
+bool ProtoReader::SeekToTime(int64_t time_us) {
+  if (time_index_ == nullptr) {
+    std::unique_ptr<TimeIndex> time_index(new TimeIndex());
+    if (!time_index->Open(TimeIndexPath(file_name_))) {
+      return false;
+    }
+    time_index_ = std::move(time_index);
+  }
+  return Seek(time_index_->FindOffset(time_us));
+}
+
+void ProtoReader::Close() {
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+bool ProtoReader::NextRecord(const char** data, size_t* size) {
+  if (!Fill(kLengthSize)) {
+    return false;
+  }
+  uint32_t record_size;
+  CodedInputStream::ReadLittleEndian32FromArray(
+      reinterpret_cast<const uint8_t*>(buffer_.get() + begin_),
+      &record_size);
+  if (record_size > kMaxRecordSize) {
+    LOG(ERROR) << "Corrupt record of " << record_size << " bytes in "
+               << file_name_;
+    return false;
+  }
+  if (!Fill(kLengthSize + record_size)) {
+    return false;
+  }
+  *data = buffer_.get() + begin_ + kLengthSize;
+  *size = record_size;
+  begin_ += kLengthSize + record_size;
+  return true;
+}
+
+bool ProtoReader::Fill(size_t size) {
+  if (end_ - begin_ >= size) {
+    return true;
+  }
+  if (fd_ < 0) {
+    return false;
+  }
+  if (compressed_) {
+    while (end_ - begin_ < size) {
+      if (!ReadBlock()) {
+        return false;
+      }
+    }
+    return true;
+  }
+  Reserve(size + kReadSize);
+  while (end_ - begin_ < size) {
+    ssize_t bytes_read = read(fd_, buffer_.get() + end_, buffer_size_ - end_);
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read < 0) {
+      LOG(ERROR) << "Failed to read " << file_name_ << ": " << strerror(errno);
+      return false;
+    }
+    if (bytes_read == 0) {
+      if (end_ > begin_) {
+        LOG(WARNING) << "Truncated record at the end of " << file_name_;
+      }
+      return false;
+    }
+    end_ += bytes_read;
+  }
+  return true;
+}
+
+bool ProtoReader::ReadBlock() {
+  char header[kCompressedBlockHeaderSize];
+  ssize_t bytes_read = ReadFully(fd_, header, sizeof(header));
+  if (bytes_read == 0) {
+    if (end_ > begin_) {
+      LOG(WARNING) << "Truncated record at the end of " << file_name_;
+    }
+    return false;
+  }
+  CompressedBlock block;
+  if (bytes_read == static_cast<ssize_t>(sizeof(header))) {
+    ParseCompressedBlockHeader(header, &block);
+    compressed_buffer_.resize(block.compressed_size);
+    ssize_t data_read =
+        ReadFully(fd_, &compressed_buffer_[0], block.compressed_size);
+    bytes_read = data_read < 0 ? -1 : bytes_read + data_read;
+  }
+  if (bytes_read < 0) {
+    LOG(ERROR) << "Failed to read " << file_name_ << ": " << strerror(errno);
+    return false;
+  }
+  if (bytes_read <
+      static_cast<ssize_t>(sizeof(header) + block.compressed_size)) {
+    // The block may still be being written: reads it again next time.
+    LOG(WARNING) << "Truncated block at the end of " << file_name_;
+    lseek(fd_, -bytes_read, SEEK_CUR);
+    return false;
+  }
+  Reserve(end_ - begin_ + block.size);
+  if (!DecompressBlock(compressed_buffer_.data(), block,
+                       buffer_.get() + end_)) {
+    LOG(ERROR) << "Corrupt block at offset " << block.offset << " of "
+               << file_name_;
+    return false;
   }
-  return false;
+  end_ += block.size;
+  return true;
+}
+
+bool ProtoReader::FindBlock(int64_t offset, int64_t* file_offset,
+                            size_t* skip) {
+  int index = FindCompressedBlock(blocks_, offset);
+  if (index < 0) {
+    // Reads the headers of blocks written since last time.
+    int64_t next_block = kCompressedLogMagicSize;
+    if (!blocks_.empty()) {
+      next_block = blocks_.back().file_offset + kCompressedBlockHeaderSize +
+                   blocks_.back().compressed_size;
+    }
+    if (!ReadCompressedBlocks(fd_, next_block, &blocks_)) {
+      return false;
+    }
+    index = FindCompressedBlock(blocks_, offset);
+  }
+  if (index >= 0) {
+    *file_offset = blocks_[index].file_offset;
+    *skip = offset - blocks_[index].offset;
+    return true;
+  }
+  // The end of the log.
+  if (blocks_.empty()) {
+    *file_offset = kCompressedLogMagicSize;
+    *skip = 0;
+    return offset == 0;
+  }
+  const CompressedBlock& last = blocks_.back();
+  *file_offset =
+      last.file_offset + kCompressedBlockHeaderSize + last.compressed_size;
+  *skip = 0;
+  return offset == last.offset + last.size;
 }
 
-void ProtoReader::Close() { file_fd_->close(); }
+void ProtoReader::Reserve(size_t size) {
+  // Moves the unread bytes to the front, or to a larger buffer.
+  if (buffer_size_ - begin_ < size) {
+    size_t unread = end_ - begin_;
+    if (buffer_size_ < size) {
+      size_t new_size = std::max(size, 2 * buffer_size_);
+      std::unique_ptr<char[]> buffer(new char[new_size]);
+      memcpy(buffer.get(), buffer_.get() + begin_, unread);
+      buffer_ = std::move(buffer);
+      buffer_size_ = new_size;
+    } else {
+      memmove(buffer_.get(), buffer_.get() + begin_, unread);
+    }
+    begin_ = 0;
+    end_ = unread;
+  }
+}
 
 }  // namespace video
 }  // namespace api
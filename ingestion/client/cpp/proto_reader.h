@@ -23,19 +23,30 @@
 
 #include <google/protobuf/message_lite.h>
 
-#include <fstream>
 #include <memory>
+#include <string>
+#include <vector>
 
+#include "client/cpp/compressed_block.h"
 #include "client/cpp/io_reader.h"
 #include "glog/logging.h"
 
 namespace api {
 namespace video {
 
+class TimeIndex;
+
+// Reads length-prefixed protos written by ProtoWriter. The file is read in
+// large chunks into a reused buffer that grows to the largest record, and
+// messages are parsed in place, so records of any size are read without
+// per-record copies or allocations. With a time index (see time_index.h),
+// it can seek to a media time in O(log n). Compressed files (see
+// compressed_block.h) are decompressed a block at a time, and offsets are
+// those of the decompressed records.
 class ProtoReader : public IOReader {
  public:
   explicit ProtoReader(const std::string& path);
-  virtual ~ProtoReader() = default;
+  virtual ~ProtoReader();
 
   // Disallows copy and assign.
   ProtoReader(const ProtoReader&) = delete;
@@ -44,20 +55,68 @@ class ProtoReader : public IOReader {
   // Opens a file.
   bool Open();
 
-  // Reads serialized proto bytes of next proto message from file.
+  // Reads serialized proto bytes of next proto message from file. Returns 0
+  // at the end of the file. A record larger than `max_bytes_read` is skipped
+  // and 0 returned.
   size_t ReadBytes(size_t max_bytes_read, char* data);
 
   // Reads next proto message from file.
   bool ReadProto(google::protobuf::MessageLite* message);
 
+  // Reads the next records into `messages`, in order. Returns the number of
+  // messages read, fewer than requested at the end of the file or on error.
+  size_t ReadProtos(
+      const std::vector<google::protobuf::MessageLite*>& messages);
+
+  // Seeks to the record at byte offset `offset`.
+  bool Seek(int64_t offset);
+
+  // Seeks to a record such that all records with media times from `time_us`
+  // are at or after it, using the time index of the file. Records before
+  // `time_us` may follow, up to the index interval. Returns false if there
+  // is no index.
+  bool SeekToTime(int64_t time_us);
+
   // Closes a file.
   void Close();
 
  private:
+  // Gets the next record. `data` is valid until the next read. Returns false
+  // at the end of the file or on a truncated or corrupt record.
+  bool NextRecord(const char** data, size_t* size);
+
+  // Reads the file until `size` unread bytes are buffered. Returns false if
+  // the file ends first.
+  bool Fill(size_t size);
+
+  // Reads and decompresses the next block of a compressed file into the
+  // buffer. Returns false at the end of the file or on error.
+  bool ReadBlock();
+
+  // Finds where to seek to in a compressed file for the record at `offset`:
+  // the block at `file_offset`, `skip` bytes into it.
+  bool FindBlock(int64_t offset, int64_t* file_offset, size_t* skip);
+
+  // Makes room for `size` bytes from begin_.
+  void Reserve(size_t size);
+
   // File name.
   std::string file_name_;
-  // File stream.
-  std::unique_ptr<std::ifstream> file_fd_;
+  // File descriptor, -1 if closed.
+  int fd_ = -1;
+  // Read buffer. Bytes in [begin_, end_) are read but not consumed.
+  std::unique_ptr<char[]> buffer_;
+  size_t buffer_size_ = 0;
+  size_t begin_ = 0;
+  size_t end_ = 0;
+  // Whether the file is compressed.
+  bool compressed_ = false;
+  // Compressed block being read.
+  std::string compressed_buffer_;
+  // Blocks of a compressed file, read on first seek.
+  std::vector<CompressedBlock> blocks_;
+  // Time index, loaded on first use.
+  std::unique_ptr<TimeIndex> time_index_;
 };
 
 }  // namespace video
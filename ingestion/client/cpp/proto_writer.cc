@@ -20,46 +20,408 @@
 
 #include "client/cpp/proto_writer.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#include "client/cpp/compressed_block.h"
+#include "client/cpp/time_index.h"
 #include "glog/logging.h"
 
 namespace api {
 namespace video {
 
+namespace {
+
+using ::google::protobuf::io::CodedOutputStream;
+
+// Size of the record length prefix.
+constexpr size_t kLengthSize = 4;
+// Writers wait when this many blocks are waiting to be written.
+constexpr size_t kMaxPendingBlocks = 4;
+
+}  // namespace
+
 ProtoWriter::ProtoWriter(const std::string& path)
-    : IOWriter(path), file_name_(path) {}
+    : ProtoWriter(path, Options()) {}
+
+ProtoWriter::ProtoWriter(const std::string& path, const Options& options)
+    : IOWriter(path), file_name_(path), options_(options) {}
+
+ProtoWriter::~ProtoWriter() { Close(); }
 
 bool ProtoWriter::Open() {
-  file_fd_.reset(new std::ofstream(file_name_, std::ofstream::binary));
+  return OpenFile(O_WRONLY | O_CREAT | O_TRUNC, 0, -1);
+}
 
-  if (!file_fd_->is_open()) {
-    LOG(ERROR) << "Failed to open write file " << file_name_;
+bool ProtoWriter::OpenAt(int64_t size, int64_t latest_time_us) {
+  if (options_.compress) {
+    if (!TruncateCompressed(size)) {
+      return false;
+    }
+  } else if (truncate(file_name_.c_str(), size) != 0) {
+    LOG(ERROR) << "Failed to truncate " << file_name_ << ": "
+               << strerror(errno);
     return false;
   }
+  return OpenFile(O_WRONLY, size, latest_time_us);
+}
+
+bool ProtoWriter::OpenFile(int flags, int64_t size, int64_t latest_time_us) {
+  CHECK(writer_thread_ == nullptr) << file_name_ << " is already open";
+  fd_ = open(file_name_.c_str(), flags, 0644);
+  if (fd_ < 0) {
+    LOG(ERROR) << "Failed to open write file " << file_name_ << ": "
+               << strerror(errno);
+    return false;
+  }
+  off_t file_size = lseek(fd_, 0, SEEK_END);
+  std::vector<std::string> magic(1, kCompressedLogMagic);
+  if (file_size < 0 ||
+      (options_.compress && file_size == 0 && !WriteBlocks(fd_, magic))) {
+    LOG(ERROR) << "Failed to write " << file_name_ << ": " << strerror(errno);
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  if (options_.index_interval > 0 && !OpenIndex(size)) {
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  records_since_index_entry_ = 0;
+  index_time_us_ = latest_time_us;
+  size_ = size;
+  block_offset_ = size - block_.size();
+  closing_ = false;
+  failed_ = false;
+  block_.reserve(options_.block_size);
+  writer_thread_.reset(new std::thread(&ProtoWriter::WriteLoop, this));
   return true;
 }
 
+bool ProtoWriter::TruncateCompressed(int64_t size) {
+  int fd = open(file_name_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(ERROR) << "Failed to open read file " << file_name_ << ": "
+               << strerror(errno);
+    return false;
+  }
+  // Truncates the file before the block containing `size`, and keeps the
+  // beginning of that block to write again.
+  std::vector<CompressedBlock> blocks;
+  bool ok = IsCompressedLog(fd) &&
+            ReadCompressedBlocks(fd, kCompressedLogMagicSize, &blocks);
+  int64_t file_size = kCompressedLogMagicSize;
+  block_.clear();
+  int index = FindCompressedBlock(blocks, size);
+  if (ok && index >= 0) {
+    const CompressedBlock& block = blocks[index];
+    std::string data(block.compressed_size, 0);
+    block_.resize(block.size);
+    ok = pread(fd, &data[0], data.size(),
+               block.file_offset + kCompressedBlockHeaderSize) ==
+             static_cast<ssize_t>(data.size()) &&
+         DecompressBlock(data.data(), block, &block_[0]);
+    block_.resize(size - block.offset);
+    file_size = block.file_offset;
+  } else if (ok && !blocks.empty()) {
+    const CompressedBlock& block = blocks.back();
+    ok = (size == block.offset + block.size);
+    file_size = block.file_offset + kCompressedBlockHeaderSize +
+                block.compressed_size;
+  } else {
+    ok = ok && size == 0;
+  }
+  close(fd);
+  if (!ok || truncate(file_name_.c_str(), file_size) != 0) {
+    LOG(ERROR) << "Failed to truncate " << file_name_ << " to " << size
+               << " bytes";
+    block_.clear();
+    return false;
+  }
+  return true;
+}
+
+bool ProtoWriter::OpenIndex(int64_t size) {
+  // Continues the index of a continued file if there is one. Otherwise a new
+  // index only has entries from `size` on, which is still correct: earlier
+  // times are found from the start of the file.
+  const std::string path = TimeIndexPath(file_name_);
+  bool append = size > 0 && access(path.c_str(), F_OK) == 0 &&
+                TruncateTimeIndex(path, size);
+  index_fd_ = open(path.c_str(), O_WRONLY | O_CREAT | (append ? 0 : O_TRUNC),
+                   0644);
+  if (index_fd_ < 0) {
+    LOG(ERROR) << "Failed to open write file " << path << ": "
+               << strerror(errno);
+    return false;
+  }
+  std::vector<std::string> header(1);
+  if (append) {
+    if (lseek(index_fd_, 0, SEEK_END) >= 0) {
+      return true;
+    }
+  } else {
+    AppendTimeIndexHeader(&header[0]);
+    if (WriteBlocks(index_fd_, header)) {
+      return true;
+    }
+  }
+  LOG(ERROR) << "Failed to write " << path << ": " << strerror(errno);
+  close(index_fd_);
+  index_fd_ = -1;
+  return false;
+}
+
 bool ProtoWriter::WriteBytes(size_t bytes_written, char* data) {
   CHECK(data != nullptr);
 
-  char bytes_size[4];  // size of uint32_t
-  bytes_size[0] = bytes_written & 255;
-  bytes_size[1] = (bytes_written >> 8) & 255;
-  bytes_size[2] = (bytes_written >> 16) & 255;
-  bytes_size[3] = (bytes_written >> 24) & 255;
-  file_fd_->write(bytes_size, 4);
-  file_fd_->write(data, bytes_written);
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (fd_ < 0 || failed_) {
+    return false;
+  }
+  uint8_t* target = Reserve(kLengthSize + bytes_written, &lock);
+  target = CodedOutputStream::WriteLittleEndian32ToArray(
+      static_cast<uint32_t>(bytes_written), target);
+  memcpy(target, data, bytes_written);
+  EndRecord(kLengthSize + bytes_written, -1);
   return true;
 }
 
 bool ProtoWriter::WriteProto(const google::protobuf::MessageLite& message) {
-  std::string data;
-  if (message.SerializeToString(&data)) {
-    return WriteBytes(data.size(), const_cast<char*>(data.c_str()));
+  return WriteProto(message, -1);
+}
+
+bool ProtoWriter::WriteProto(const google::protobuf::MessageLite& message,
+                             int64_t time_us) {
+  size_t size = message.ByteSizeLong();
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (fd_ < 0 || failed_) {
+    return false;
   }
-  return false;
+  // Serializes in place, after the size computed above.
+  uint8_t* target = Reserve(kLengthSize + size, &lock);
+  target = CodedOutputStream::WriteLittleEndian32ToArray(
+      static_cast<uint32_t>(size), target);
+  message.SerializeWithCachedSizesToArray(target);
+  EndRecord(kLengthSize + size, time_us);
+  return true;
+}
+
+bool ProtoWriter::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (fd_ < 0) {
+    return false;
+  }
+  SealBlock();
+  int64_t blocks_sealed = blocks_sealed_;
+  written_cv_.wait(lock, [this, blocks_sealed] {
+    return blocks_written_ >= blocks_sealed || failed_;
+  });
+  return !failed_;
+}
+
+int64_t ProtoWriter::Size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_;
 }
 
-void ProtoWriter::Close() { file_fd_->close(); }
+void ProtoWriter::Close() {
+  if (writer_thread_ == nullptr) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    SealBlock();
+    sync_requested_ = options_.sync_interval_ms > 0 ||
+                      options_.sync_records > 0;
+    closing_ = true;
+    write_cv_.notify_one();
+  }
+  writer_thread_->join();
+  writer_thread_.reset();
+  std::lock_guard<std::mutex> lock(mutex_);
+  close(fd_);
+  fd_ = -1;
+  if (index_fd_ >= 0) {
+    close(index_fd_);
+    index_fd_ = -1;
+  }
+}
+
+uint8_t* ProtoWriter::Reserve(size_t size,
+                              std::unique_lock<std::mutex>* lock) {
+  if (!block_.empty() && block_.size() + size > options_.block_size) {
+    written_cv_.wait(*lock, [this] {
+      return sealed_blocks_.size() < kMaxPendingBlocks || failed_;
+    });
+    SealBlock();
+  }
+  // A record larger than a block gets a block of its own.
+  size_t offset = block_.size();
+  block_.resize(offset + size);
+  size_ += size;
+  return reinterpret_cast<uint8_t*>(&block_[offset]);
+}
+
+void ProtoWriter::EndRecord(size_t size, int64_t time_us) {
+  if (index_fd_ >= 0) {
+    if (records_since_index_entry_ == 0) {
+      AppendTimeIndexEntry(index_time_us_, size_ - size, &index_entries_);
+    }
+    records_since_index_entry_ =
+        (records_since_index_entry_ + 1) % options_.index_interval;
+    index_time_us_ = std::max(index_time_us_, time_us);
+  }
+  if (options_.sync_records > 0 &&
+      ++unsynced_records_ >= options_.sync_records) {
+    unsynced_records_ = 0;
+    sync_requested_ = true;
+    SealBlock();
+  }
+}
+
+void ProtoWriter::SealBlock() {
+  if (block_.empty()) {
+    return;
+  }
+  sealed_blocks_.push_back(std::move(block_));
+  ++blocks_sealed_;
+  if (!index_entries_.empty()) {
+    sealed_index_entries_.push_back(std::move(index_entries_));
+    index_entries_.clear();
+  }
+  if (!free_blocks_.empty()) {
+    block_ = std::move(free_blocks_.back());
+    free_blocks_.pop_back();
+  } else {
+    block_ = std::string();
+    block_.reserve(options_.block_size);
+  }
+  write_cv_.notify_one();
+}
+
+void ProtoWriter::WriteLoop() {
+  const std::chrono::milliseconds sync_interval(options_.sync_interval_ms);
+  std::chrono::steady_clock::time_point next_sync_time =
+      std::chrono::steady_clock::now() + sync_interval;
+  // Whether blocks have been written since the last fsync.
+  bool unsynced = false;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    if (sealed_blocks_.empty() && !closing_) {
+      if (options_.sync_interval_ms > 0) {
+        write_cv_.wait_until(lock, next_sync_time);
+      } else {
+        write_cv_.wait(lock);
+      }
+    }
+    bool sync = sync_requested_;
+    if (options_.sync_interval_ms > 0 &&
+        std::chrono::steady_clock::now() >= next_sync_time) {
+      // Writes the partial block too, bounding how long records stay in
+      // memory.
+      SealBlock();
+      sync = true;
+      next_sync_time = std::chrono::steady_clock::now() + sync_interval;
+    }
+    if (sealed_blocks_.empty() && !(sync && unsynced)) {
+      if (closing_) {
+        break;
+      }
+      continue;
+    }
+
+    // Writes all pending blocks at once, without holding the lock.
+    // Index entries are written after the records they point to.
+    std::vector<std::string> blocks;
+    blocks.swap(sealed_blocks_);
+    std::vector<std::string> index_entries;
+    index_entries.swap(sealed_index_entries_);
+    sync_requested_ = false;
+    lock.unlock();
+    bool ok = true;
+    if (options_.compress) {
+      compressed_blocks_.resize(1);
+      compressed_blocks_[0].clear();
+      for (const std::string& block : blocks) {
+        ok = ok && AppendCompressedBlock(block.data(), block.size(),
+                                         block_offset_, &compressed_blocks_[0]);
+        block_offset_ += block.size();
+      }
+    }
+    ok = ok &&
+         WriteBlocks(fd_, options_.compress ? compressed_blocks_ : blocks) &&
+         (index_entries.empty() || WriteBlocks(index_fd_, index_entries));
+    if (!ok) {
+      LOG(ERROR) << "Failed to write " << file_name_ << ": "
+                 << strerror(errno);
+    }
+    unsynced = unsynced || !blocks.empty();
+    if (ok && sync && unsynced) {
+      if (fsync(fd_) != 0 || (index_fd_ >= 0 && fsync(index_fd_) != 0)) {
+        LOG(ERROR) << "Failed to sync " << file_name_ << ": "
+                   << strerror(errno);
+        ok = false;
+      }
+      unsynced = false;
+    }
+    lock.lock();
+
+    if (!ok) {
+      failed_ = true;
+    }
+    blocks_written_ += blocks.size();
+    for (std::string& block : blocks) {
+      if (free_blocks_.size() >= kMaxPendingBlocks) {
+        break;
+      }
+      block.clear();
+      free_blocks_.push_back(std::move(block));
+    }
+    written_cv_.notify_all();
+  }
+}
+
+bool ProtoWriter::WriteBlocks(int fd,
+                              const std::vector<std::string>& blocks) {
+  std::vector<struct iovec> iov(blocks.size());
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    iov[i].iov_base = const_cast<char*>(blocks[i].data());
+    iov[i].iov_len = blocks[i].size();
+  }
+  size_t index = 0;
+  while (index < iov.size()) {
+    ssize_t written =
+        writev(fd, &iov[index], std::min<size_t>(iov.size() - index, IOV_MAX));
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    // Skips what has been written, which may end within a block.
+    size_t remaining = written;
+    while (index < iov.size() && remaining >= iov[index].iov_len) {
+      remaining -= iov[index].iov_len;
+      ++index;
+    }
+    if (remaining > 0) {
+      iov[index].iov_base = static_cast<char*>(iov[index].iov_base) + remaining;
+      iov[index].iov_len -= remaining;
+    }
+  }
+  return true;
+}
 
 }  // namespace video
 }  // namespace api
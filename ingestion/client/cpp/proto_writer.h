@@ -23,8 +23,13 @@
 
 #include <google/protobuf/message_lite.h>
 
-#include <fstream>
+#include <condition_variable>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "client/cpp/io_writer.h"
 #include "glog/logging.h"
@@ -32,10 +37,34 @@
 namespace api {
 namespace video {
 
+// Writes length-prefixed protos (a 4-byte little-endian size followed by the
+// serialized message), as read by ProtoReader.
+//
+// Records are serialized straight into a reused block buffer. Full blocks are
+// written by a background thread, which writes all the blocks pending at
+// once (group commit) so that a record costs no system call. The file can
+// also be fsync()ed periodically, trading throughput for durability, have a
+// time index (see time_index.h), and be compressed.
 class ProtoWriter : public IOWriter {
  public:
+  struct Options {
+    // Size of the blocks records are buffered in.
+    size_t block_size = 256 * 1024;
+    // If positive, buffered records are written and the file is fsync()ed
+    // at least this often (in milliseconds).
+    int64_t sync_interval_ms = 0;
+    // If positive, the file is fsync()ed every this many records.
+    int64_t sync_records = 0;
+    // If positive, a time index is written next to the file, with an entry
+    // every this many records.
+    int64_t index_interval = 0;
+    // If set, blocks are zlib-compressed (see compressed_block.h).
+    bool compress = false;
+  };
+
   explicit ProtoWriter(const std::string& path);
-  virtual ~ProtoWriter() = default;
+  ProtoWriter(const std::string& path, const Options& options);
+  virtual ~ProtoWriter();
 
   // Disallows copy and assign.
   ProtoWriter(const ProtoWriter&) = delete;
@@ -44,20 +73,101 @@ class ProtoWriter : public IOWriter {
   // Opens a proto file.
   bool Open();
 
+  // Opens an existing proto file for appending, after truncating it to
+  // `size` bytes. Used to continue a log from a known good point, whose
+  // latest media time is `latest_time_us`.
+  bool OpenAt(int64_t size, int64_t latest_time_us = -1);
+
   // Writes serialized proto bytes to the proto file.
   bool WriteBytes(size_t bytes_written, char* data);
 
   // Writes proto message to the proto file.
   bool WriteProto(const google::protobuf::MessageLite& message);
 
-  // Closes a file.
+  // Writes proto message with the latest media time it refers to, for the
+  // time index.
+  bool WriteProto(const google::protobuf::MessageLite& message,
+                  int64_t time_us);
+
+  // Writes all buffered records to the file, and waits until they are
+  // written. Returns false if a write failed.
+  bool Flush();
+
+  // Gets the size of the file, including buffered writes.
+  int64_t Size();
+
+  // Writes buffered records and closes the file.
   void Close();
 
  private:
+  // Opens the file and its index with `flags`, and starts the background
+  // writer.
+  bool OpenFile(int flags, int64_t size, int64_t latest_time_us);
+
+  // Truncates a compressed file to `size` bytes of records. The file is cut
+  // at a block boundary and the rest is kept in `block_`.
+  bool TruncateCompressed(int64_t size);
+
+  // Opens the time index of a file opened at `size` bytes.
+  bool OpenIndex(int64_t size);
+
+  // Reserves `size` bytes for a record at the end of the current block, and
+  // returns where to write them. Requires `mutex_`.
+  uint8_t* Reserve(size_t size, std::unique_lock<std::mutex>* lock);
+
+  // Ends a record of `size` bytes written to the current block: adds an
+  // index entry and requests an fsync if due. Requires `mutex_`.
+  void EndRecord(size_t size, int64_t time_us);
+
+  // Hands the current block to the background writer. Requires `mutex_`.
+  void SealBlock();
+
+  // Background writer loop.
+  void WriteLoop();
+
+  // Writes blocks to a file. Returns false on error.
+  bool WriteBlocks(int fd, const std::vector<std::string>& blocks);
+
   // File name.
   std::string file_name_;
-  // File stream.
-  std::unique_ptr<std::ofstream> file_fd_;
+  Options options_;
+  // File descriptors of the file and its time index, -1 if closed.
+  int fd_ = -1;
+  int index_fd_ = -1;
+
+  std::mutex mutex_;
+  // Signals the background writer that blocks are sealed or it must stop.
+  std::condition_variable write_cv_;
+  // Signals that sealed blocks have been written.
+  std::condition_variable written_cv_;
+  // Block records are appended to.
+  std::string block_;
+  // Blocks waiting to be written, and written blocks kept for reuse.
+  std::vector<std::string> sealed_blocks_;
+  std::vector<std::string> free_blocks_;
+  // Index entries of records in the current block, and of sealed blocks.
+  std::string index_entries_;
+  std::vector<std::string> sealed_index_entries_;
+  // Records since the last index entry, and latest media time written.
+  int64_t records_since_index_entry_ = 0;
+  int64_t index_time_us_ = -1;
+  // Number of blocks sealed and written so far.
+  int64_t blocks_sealed_ = 0;
+  int64_t blocks_written_ = 0;
+  // Records appended since the last fsync was requested.
+  int64_t unsynced_records_ = 0;
+  // Whether the background writer must fsync after its next write.
+  bool sync_requested_ = false;
+  // File size, including buffered records. With compression, sizes and
+  // offsets are those of the decompressed records.
+  int64_t size_ = 0;
+  // Offset of the next block to write. Used by the background writer.
+  int64_t block_offset_ = 0;
+  // Compressed blocks being written. Used by the background writer.
+  std::vector<std::string> compressed_blocks_;
+  bool closing_ = false;
+  bool failed_ = false;
+  std::unique_ptr<std::thread> writer_thread_;
 };
 
 }  // namespace video
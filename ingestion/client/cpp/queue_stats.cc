@@ -0,0 +1,206 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/queue_stats.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+namespace {
+
+int64_t MicrosSince(QueueStats::Stamp since) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             QueueStats::Now() - since)
+      .count();
+}
+
+// Raises `value` to at least `candidate`.
+template <class T>
+void UpdateMax(std::atomic<T>* value, T candidate) {
+  T current = value->load(std::memory_order_relaxed);
+  while (candidate > current &&
+         !value->compare_exchange_weak(current, candidate,
+                                       std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace
+
+constexpr int LatencyHistogram::kNumBuckets;
+
+LatencyHistogram::LatencyHistogram() {
+  for (auto& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+void LatencyHistogram::Record(int64_t duration_us) {
+  duration_us = std::max<int64_t>(duration_us, 0);
+  int bucket = 0;
+  while (bucket < kNumBuckets - 1 && (int64_t{1} << bucket) <= duration_us) {
+    ++bucket;
+  }
+  buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  total_us_.fetch_add(duration_us, std::memory_order_relaxed);
+  UpdateMax(&max_us_, duration_us);
+}
+
+int64_t LatencyHistogram::Percentile(double percentile) const {
+  uint64_t total = count();
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = static_cast<uint64_t>(percentile / 100 * total);
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumBuckets - 1; ++i) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen > rank) {
+      return std::min(int64_t{1} << i, max_us());
+    }
+  }
+  return max_us();
+}
+
+QueueStats::~QueueStats() {
+  if (registered_) {
+    QueueStatsRegistry::Get()->Remove(this);
+  }
+}
+
+void QueueStats::Register(const std::string& name) {
+  CHECK(!registered_) << name_ << " is already registered";
+  name_ = name;
+  registered_ = true;
+  QueueStatsRegistry::Get()->Add(this);
+}
+
+void QueueStats::Pushed(size_t depth) {
+  pushes_.fetch_add(1, std::memory_order_relaxed);
+  depth_.store(depth, std::memory_order_relaxed);
+  UpdateMax(&high_water_, depth);
+}
+
+void QueueStats::Popped(size_t depth, Stamp enqueued) {
+  depth_.store(depth, std::memory_order_relaxed);
+  latency_.Record(MicrosSince(enqueued));
+}
+
+void QueueStats::ProducerBlocked(Stamp since) {
+  producer_blocked_.Record(MicrosSince(since));
+}
+
+void QueueStats::ConsumerStarved(Stamp since) {
+  consumer_starved_.Record(MicrosSince(since));
+}
+
+std::string QueueStats::Report() const {
+  char line[512];
+  snprintf(line, sizeof(line),
+           "%s: depth %zu (max %zu), %llu pushed, latency p50 %lld us p99 "
+           "%lld us max %lld us, producer blocked %llu times %.3f s, "
+           "consumer starved %llu times %.3f s",
+           name_.c_str(), depth(), high_water(),
+           static_cast<unsigned long long>(pushes()),
+           static_cast<long long>(latency_.Percentile(50)),
+           static_cast<long long>(latency_.Percentile(99)),
+           static_cast<long long>(latency_.max_us()),
+           static_cast<unsigned long long>(producer_blocked_.count()),
+           producer_blocked_.total_us() / 1e6,
+           static_cast<unsigned long long>(consumer_starved_.count()),
+           consumer_starved_.total_us() / 1e6);
+  return line;
+}
+
+QueueStatsRegistry* QueueStatsRegistry::Get() {
+  static QueueStatsRegistry* registry = new QueueStatsRegistry();
+  return registry;
+}
+
+void QueueStatsRegistry::Add(QueueStats* stats) {
+  std::lock_guard<std::mutex> lock(m_);
+  queues_.push_back(stats);
+}
+
+void QueueStatsRegistry::Remove(QueueStats* stats) {
+  std::lock_guard<std::mutex> lock(m_);
+  queues_.erase(std::remove(queues_.begin(), queues_.end(), stats),
+                queues_.end());
+}
+
+std::string QueueStatsRegistry::Report() {
+  std::lock_guard<std::mutex> lock(m_);
+  std::string report;
+  for (const QueueStats* stats : queues_) {
+    report += stats->Report();
+    report += "\n";
+  }
+  return report;
+}
+
+void QueueStatsRegistry::StartLogging(std::chrono::milliseconds interval) {
+  std::lock_guard<std::mutex> lock(m_);
+  if (logging_users_++ > 0) {
+    return;
+  }
+  const uint64_t generation = logging_generation_;
+  logging_thread_.reset(new std::thread([this, interval, generation] {
+    std::unique_lock<std::mutex> lock(m_);
+    while (!cond_var_stop_.wait_for(lock, interval, [this, generation] {
+      return logging_generation_ != generation;
+    })) {
+      lock.unlock();
+      std::string report = Report();
+      if (!report.empty()) {
+        LOG(INFO) << "Queue stats:\n" << report;
+      }
+      lock.lock();
+    }
+  }));
+}
+
+void QueueStatsRegistry::StopLogging() {
+  std::unique_ptr<std::thread> thread;
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    if (logging_users_ == 0 || --logging_users_ > 0) {
+      return;
+    }
+    ++logging_generation_;
+    cond_var_stop_.notify_all();
+    thread = std::move(logging_thread_);
+  }
+  if (thread != nullptr) {
+    thread->join();
+  }
+}
+
+bool QueueStatsRegistry::IsLogging() {
+  std::lock_guard<std::mutex> lock(m_);
+  return logging_users_ > 0;
+}
+
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,189 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_QUEUE_STATS_H_
+#define API_VIDEO_CLIENT_CPP_QUEUE_STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace api {
+namespace video {
+
+// Queues take a statistics policy as a template parameter: NoQueueStats,
+// the default, compiles to nothing, and QueueStats records depth and
+// timings, and reports them through the QueueStatsRegistry once the queue
+// is given a name with Register(). Queues call the policy as follows:
+//   Stamp Now()                     Gets a timestamp.
+//   Pushed(depth)                   After a push, with the new depth.
+//   Popped(depth, enqueued)         After a pop, with the new depth and the
+//                                   time the element was pushed.
+//   ProducerBlocked(since)          After a push waited for room.
+//   ConsumerStarved(since)          After a pop waited for an element.
+
+// Statistics policy that records nothing.
+struct NoQueueStats {
+  struct Stamp {};
+
+  static Stamp Now() { return Stamp(); }
+  void Register(const std::string&) {}
+  void Pushed(size_t) {}
+  void Popped(size_t, Stamp) {}
+  void ProducerBlocked(Stamp) {}
+  void ConsumerStarved(Stamp) {}
+};
+
+// Histogram of durations, in power-of-two microsecond buckets. Safe to
+// record into from several threads.
+class LatencyHistogram {
+ public:
+  // Bucket i counts durations in [2^(i-1), 2^i) microseconds, bucket 0
+  // those under 1 microsecond, and the last bucket everything longer.
+  static constexpr int kNumBuckets = 32;
+
+  LatencyHistogram();
+
+  // Records a duration.
+  void Record(int64_t duration_us);
+
+  // Gets the number and total of recorded durations.
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t total_us() const {
+    return total_us_.load(std::memory_order_relaxed);
+  }
+
+  // Gets an upper bound of the `percentile` (0-100) of recorded durations,
+  // i.e. the upper end of its bucket, or 0 if there are none.
+  int64_t Percentile(double percentile) const;
+
+  // Gets the longest recorded duration.
+  int64_t max_us() const { return max_us_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> buckets_[kNumBuckets];
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> total_us_{0};
+  std::atomic<int64_t> max_us_{0};
+};
+
+// Statistics policy that records:
+//  - the current and the high-water depth,
+//  - the time producers spent blocked on a full queue,
+//  - the time consumers spent starved on an empty queue,
+//  - the latency from push to pop.
+// Safe to use from several threads.
+class QueueStats {
+ public:
+  using Stamp = std::chrono::steady_clock::time_point;
+
+  QueueStats() = default;
+  ~QueueStats();
+
+  // Disallows copy and assign.
+  QueueStats(const QueueStats&) = delete;
+  QueueStats& operator=(const QueueStats&) = delete;
+
+  static Stamp Now() { return std::chrono::steady_clock::now(); }
+
+  // Names the queue and adds it to the registry, until destroyed.
+  void Register(const std::string& name);
+
+  void Pushed(size_t depth);
+  void Popped(size_t depth, Stamp enqueued);
+  void ProducerBlocked(Stamp since);
+  void ConsumerStarved(Stamp since);
+
+  const std::string& name() const { return name_; }
+  size_t depth() const { return depth_.load(std::memory_order_relaxed); }
+  size_t high_water() const {
+    return high_water_.load(std::memory_order_relaxed);
+  }
+  uint64_t pushes() const { return pushes_.load(std::memory_order_relaxed); }
+  const LatencyHistogram& producer_blocked() const {
+    return producer_blocked_;
+  }
+  const LatencyHistogram& consumer_starved() const {
+    return consumer_starved_;
+  }
+  const LatencyHistogram& latency() const { return latency_; }
+
+  // Formats the statistics on one line.
+  std::string Report() const;
+
+ private:
+  std::string name_;
+  bool registered_ = false;
+  std::atomic<size_t> depth_{0};
+  std::atomic<size_t> high_water_{0};
+  std::atomic<uint64_t> pushes_{0};
+  LatencyHistogram producer_blocked_;
+  LatencyHistogram consumer_starved_;
+  LatencyHistogram latency_;
+};
+
+// Registry of the named queues of the process.
+class QueueStatsRegistry {
+ public:
+  // Gets the registry.
+  static QueueStatsRegistry* Get();
+
+  void Add(QueueStats* stats);
+  void Remove(QueueStats* stats);
+
+  // Formats the statistics of all queues, one per line.
+  std::string Report();
+
+  // Logs the report every `interval` on a background thread, until
+  // StopLogging(). Calls nest, so that several clients in a process can
+  // each log: logging runs from the first StartLogging() until as many
+  // StopLogging() calls, at the interval of the first one. Extra
+  // StopLogging() calls are ignored.
+  void StartLogging(std::chrono::milliseconds interval);
+  void StopLogging();
+
+  // Whether the report is being logged.
+  bool IsLogging();
+
+ private:
+  QueueStatsRegistry() = default;
+
+  std::mutex m_;
+  std::vector<QueueStats*> queues_;
+  std::unique_ptr<std::thread> logging_thread_;
+  // StartLogging() calls not yet matched by StopLogging().
+  int logging_users_ = 0;
+  // Bumped whenever logging stops, so that a stopping thread exits even if
+  // logging restarts before it wakes up.
+  uint64_t logging_generation_ = 0;
+  std::condition_variable cond_var_stop_;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  // API_VIDEO_CLIENT_CPP_QUEUE_STATS_H_
@@ -0,0 +1,115 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/queue_stats.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "client/cpp/sync_queue.h"
+#include "gtest/gtest.h"
+
+namespace api {
+namespace video {
+namespace {
+
+TEST(LatencyHistogramTest, Percentiles) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0, histogram.Percentile(50));
+  for (int i = 0; i < 90; ++i) {
+    histogram.Record(3);
+  }
+  for (int i = 0; i < 10; ++i) {
+    histogram.Record(1000);
+  }
+  EXPECT_EQ(100, histogram.count());
+  EXPECT_EQ(90 * 3 + 10 * 1000, histogram.total_us());
+  // 3 falls in [2, 4), and 1000 in [512, 1024).
+  EXPECT_EQ(4, histogram.Percentile(50));
+  EXPECT_EQ(1000, histogram.Percentile(99));
+  EXPECT_EQ(1000, histogram.max_us());
+}
+
+TEST(QueueStatsTest, RecordsSyncQueue) {
+  SyncQueue<int, ElementCount, QueueStats> queue(2);
+  queue.stats()->Register("test_queue");
+  for (int i = 0; i < 2; ++i) {
+    queue.Push(i);
+  }
+  std::thread consumer([&queue] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    int val;
+    for (int i = 0; i < 3; ++i) {
+      queue.Pop(&val);
+    }
+  });
+  // Blocks until the consumer makes room.
+  queue.Push(2);
+  consumer.join();
+
+  const QueueStats& stats = *queue.stats();
+  EXPECT_EQ(3, stats.pushes());
+  EXPECT_EQ(0, stats.depth());
+  EXPECT_EQ(2, stats.high_water());
+  EXPECT_EQ(1, stats.producer_blocked().count());
+  EXPECT_GE(stats.producer_blocked().max_us(), 10000);
+  EXPECT_EQ(3, stats.latency().count());
+  EXPECT_NE(std::string::npos,
+            QueueStatsRegistry::Get()->Report().find("test_queue: depth 0"));
+}
+
+TEST(QueueStatsTest, UnregistersOnDestruction) {
+  {
+    SyncQueue<int, ElementCount, QueueStats> queue;
+    queue.stats()->Register("short_lived");
+    EXPECT_NE(std::string::npos,
+              QueueStatsRegistry::Get()->Report().find("short_lived"));
+  }
+  EXPECT_EQ(std::string::npos,
+            QueueStatsRegistry::Get()->Report().find("short_lived"));
+}
+
+TEST(QueueStatsRegistryTest, NestsLogging) {
+  QueueStatsRegistry* registry = QueueStatsRegistry::Get();
+  // Unmatched stops are ignored.
+  registry->StopLogging();
+  EXPECT_FALSE(registry->IsLogging());
+  registry->StartLogging(std::chrono::milliseconds(1));
+  registry->StartLogging(std::chrono::milliseconds(1));
+  registry->StopLogging();
+  EXPECT_TRUE(registry->IsLogging());
+  registry->StopLogging();
+  EXPECT_FALSE(registry->IsLogging());
+  // Logging restarts after it stopped.
+  registry->StartLogging(std::chrono::milliseconds(1));
+  EXPECT_TRUE(registry->IsLogging());
+  registry->StopLogging();
+  EXPECT_FALSE(registry->IsLogging());
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
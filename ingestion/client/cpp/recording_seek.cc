@@ -0,0 +1,59 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/recording_seek.h"
+
+#include <algorithm>
+
+#include "client/cpp/segmented_writer.h"
+#include "client/cpp/time_index.h"
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+bool FindRecordingSeekPoint(const std::string& path, int64_t time_us,
+                            RecordingSeekPoint* point) {
+  CHECK(point != nullptr);
+  SegmentManifest manifest;
+  if (!manifest.Load(SegmentManifestPath(path))) {
+    return false;
+  }
+  const SegmentInfo* segment = nullptr;
+  for (const SegmentInfo& info : manifest.segments()) {
+    if (info.start_time_us >= 0 && info.start_time_us <= time_us) {
+      segment = &info;
+    }
+  }
+  if (segment == nullptr) {
+    return false;
+  }
+  TimeIndex index;
+  if (!index.Open(TimeIndexPath(segment->path)) || index.size() == 0) {
+    return false;
+  }
+  point->path = segment->path;
+  point->init_size = index.entry_offset(0);
+  point->offset = std::max(index.FindOffset(time_us), point->init_size);
+  return true;
+}
+
+}  // namespace video
+}  // namespace api
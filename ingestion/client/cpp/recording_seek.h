@@ -0,0 +1,51 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_RECORDING_SEEK_H_
+#define API_VIDEO_CLIENT_CPP_RECORDING_SEEK_H_
+
+#include <cstdint>
+#include <string>
+
+namespace api {
+namespace video {
+
+// Where to start playing a recording to show a media time.
+struct RecordingSeekPoint {
+  // Segment file.
+  std::string path;
+  // Size of the init segment at the start of the file.
+  int64_t init_size = 0;
+  // Offset of the fragment starting with the keyframe to decode from.
+  int64_t offset = 0;
+};
+
+// Finds where to start playing the recording at `path`, as written by
+// VideoRecorder, to show media time `time_us`: the last keyframe at or
+// before it, in the last segment that starts at or before it. Uses the
+// segment manifest and the time indexes of the segments only. Returns false
+// if there is none.
+bool FindRecordingSeekPoint(const std::string& path, int64_t time_us,
+                            RecordingSeekPoint* point);
+
+}  // namespace video
+}  // namespace api
+
+#endif  // API_VIDEO_CLIENT_CPP_RECORDING_SEEK_H_
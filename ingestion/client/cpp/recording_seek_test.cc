@@ -0,0 +1,128 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/recording_seek.h"
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "client/cpp/segmented_writer.h"
+#include "client/cpp/time_index.h"
+#include "gtest/gtest.h"
+
+namespace api {
+namespace video {
+namespace {
+
+// Size of the init segment of the segments.
+constexpr int64_t kInitSize = 500;
+// Size of a fragment, one per second.
+constexpr int64_t kFragmentSize = 1000;
+
+void WriteFile(const std::string& path, const std::string& data) {
+  std::ofstream output(path, std::ofstream::binary);
+  output.write(data.data(), data.size());
+}
+
+// Lists segments starting every 2 s in a manifest, as VideoRecorder does,
+// each with a time index of its two fragments. Segment 0 has no known start
+// time, as if it had no frames.
+std::string MakeRecording(const std::string& name) {
+  const std::string path = std::string(getenv("TEST_TMPDIR")) + "/" + name;
+  SegmentManifest manifest;
+  for (int i = 0; i < 4; ++i) {
+    SegmentInfo segment;
+    segment.index = i;
+    segment.path = SegmentPath(path, i);
+    segment.size = kInitSize + 2 * kFragmentSize;
+    if (i > 0) {
+      segment.start_time_us = (i - 1) * 2000000;
+      segment.end_time_us = segment.start_time_us + 1000000;
+      std::string index;
+      AppendTimeIndexHeader(&index);
+      for (int j = 0; j < 2; ++j) {
+        AppendTimeIndexEntry(segment.start_time_us + j * 1000000 - 1,
+                             kInitSize + j * kFragmentSize, &index);
+      }
+      WriteFile(TimeIndexPath(segment.path), index);
+    }
+    WriteFile(segment.path, std::string(segment.size, 'x'));
+    manifest.segments().push_back(segment);
+  }
+  EXPECT_TRUE(manifest.Save(SegmentManifestPath(path)));
+  return path;
+}
+
+// Tests finding the segment and the keyframe to play a media time from.
+TEST(RecordingSeekTest, FindsKeyframe) {
+  const std::string path = MakeRecording("seek.mp4");
+  RecordingSeekPoint point;
+  ASSERT_TRUE(FindRecordingSeekPoint(path, 0, &point));
+  EXPECT_EQ(SegmentPath(path, 1), point.path);
+  EXPECT_EQ(kInitSize, point.init_size);
+  EXPECT_EQ(kInitSize, point.offset);
+
+  ASSERT_TRUE(FindRecordingSeekPoint(path, 999999, &point));
+  EXPECT_EQ(SegmentPath(path, 1), point.path);
+  EXPECT_EQ(kInitSize, point.offset);
+
+  ASSERT_TRUE(FindRecordingSeekPoint(path, 1000000, &point));
+  EXPECT_EQ(SegmentPath(path, 1), point.path);
+  EXPECT_EQ(kInitSize + kFragmentSize, point.offset);
+
+  // Past the last fragment of a segment, but before the next segment.
+  ASSERT_TRUE(FindRecordingSeekPoint(path, 1999999, &point));
+  EXPECT_EQ(SegmentPath(path, 1), point.path);
+  EXPECT_EQ(kInitSize + kFragmentSize, point.offset);
+
+  ASSERT_TRUE(FindRecordingSeekPoint(path, 2500000, &point));
+  EXPECT_EQ(SegmentPath(path, 2), point.path);
+  EXPECT_EQ(kInitSize, point.offset);
+
+  // Past the end of the recording.
+  ASSERT_TRUE(FindRecordingSeekPoint(path, 60000000, &point));
+  EXPECT_EQ(SegmentPath(path, 3), point.path);
+  EXPECT_EQ(kInitSize + kFragmentSize, point.offset);
+}
+
+// Tests media times and recordings with nothing to play from.
+TEST(RecordingSeekTest, NotFound) {
+  const std::string path = MakeRecording("seek_missing.mp4");
+  RecordingSeekPoint point;
+  EXPECT_FALSE(FindRecordingSeekPoint(path, -1, &point));
+  EXPECT_FALSE(FindRecordingSeekPoint(
+      std::string(getenv("TEST_TMPDIR")) + "/missing.mp4", 0, &point));
+
+  // A segment whose time index is missing.
+  unlink(TimeIndexPath(SegmentPath(path, 2)).c_str());
+  EXPECT_FALSE(FindRecordingSeekPoint(path, 2500000, &point));
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,119 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/result_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+namespace {
+// FNV-1a 64-bit prime.
+constexpr uint64_t kFnvPrime = 1099511628211ULL;
+}  // namespace
+
+void ContentHasher::Update(const char* data, size_t size) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  uint64_t hash = hash_;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ p[i]) * kFnvPrime;
+  }
+  hash_ = hash;
+  size_ += size;
+}
+
+std::string ContentHasher::Digest() const {
+  char digest[40];
+  snprintf(digest, sizeof(digest), "%016llx-%llx",
+           static_cast<unsigned long long>(hash_),
+           static_cast<unsigned long long>(size_));
+  return digest;
+}
+
+ResultCache::ResultCache(const std::string& cache_dir)
+    : cache_dir_(cache_dir) {}
+
+bool ResultCache::Open() {
+  if (mkdir(cache_dir_.c_str(), 0755) != 0 && errno != EEXIST) {
+    LOG(ERROR) << "Failed to create cache directory " << cache_dir_ << ": "
+               << strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+std::string ResultCache::Key(
+    const google::cloud::videointelligence::v1p3beta1::
+        StreamingAnnotateVideoRequest& config,
+    const std::string& content_digest) {
+  std::string config_bytes;
+  config.SerializeToString(&config_bytes);
+  ContentHasher config_hasher;
+  config_hasher.Update(config_bytes.data(), config_bytes.size());
+  return config_hasher.Digest() + "-" + content_digest;
+}
+
+bool ResultCache::Lookup(const std::string& key, CachedResult* result) {
+  CHECK(result != nullptr);
+  std::ifstream input(EntryPath(key), std::ifstream::binary);
+  if (!input.is_open()) {
+    return false;
+  }
+  if (!result->ParseFromIstream(&input)) {
+    LOG(WARNING) << "Ignoring corrupted cache entry " << EntryPath(key);
+    return false;
+  }
+  return true;
+}
+
+bool ResultCache::Store(const std::string& key, const CachedResult& result) {
+  // Writes a temporary file and renames it, so that concurrent runs never
+  // see a partial entry.
+  const std::string path = EntryPath(key);
+  const std::string tmp_path = path + "." + std::to_string(getpid()) + ".tmp";
+  {
+    std::ofstream output(tmp_path, std::ofstream::binary);
+    if (!output.is_open() || !result.SerializeToOstream(&output)) {
+      LOG(ERROR) << "Failed to write cache entry " << tmp_path;
+      return false;
+    }
+  }
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG(ERROR) << "Failed to rename cache entry " << tmp_path << " to " << path;
+    return false;
+  }
+  return true;
+}
+
+std::string ResultCache::EntryPath(const std::string& key) const {
+  return cache_dir_ + "/" + key + ".cache";
+}
+
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,89 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_RESULT_CACHE_H_
+#define API_VIDEO_CLIENT_CPP_RESULT_CACHE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "proto/result_cache.pb.h"
+#include "proto/video_intelligence_streaming.pb.h"
+
+namespace api {
+namespace video {
+
+// Incrementally hashes a byte stream with 64-bit FNV-1a. The digest also
+// includes the stream length. It is not a cryptographic hash: the cache is
+// meant for trusted local inputs such as regression clips.
+class ContentHasher {
+ public:
+  ContentHasher() = default;
+  ~ContentHasher() = default;
+
+  // Hashes the next `size` bytes of the stream.
+  void Update(const char* data, size_t size);
+
+  // Gets the digest of the bytes hashed so far, as a hex string.
+  std::string Digest() const;
+
+ private:
+  // FNV-1a offset basis.
+  uint64_t hash_ = 14695981039346656037ULL;
+  uint64_t size_ = 0;
+};
+
+// On-disk cache of the responses received for a video, keyed by the config
+// request and the content digest of the video bytes sent.
+class ResultCache {
+ public:
+  explicit ResultCache(const std::string& cache_dir);
+  ~ResultCache() = default;
+
+  // Disallows copy and assign.
+  ResultCache(const ResultCache&) = delete;
+  ResultCache& operator=(const ResultCache&) = delete;
+
+  // Creates the cache directory if needed.
+  bool Open();
+
+  // Gets the cache key of a config request and content digest.
+  static std::string Key(const google::cloud::videointelligence::v1p3beta1::
+                             StreamingAnnotateVideoRequest& config,
+                         const std::string& content_digest);
+
+  // Looks up cached responses. Returns false on a miss.
+  bool Lookup(const std::string& key, CachedResult* result);
+
+  // Stores responses, replacing any existing entry.
+  bool Store(const std::string& key, const CachedResult& result);
+
+ private:
+  // Gets the file of a cache entry.
+  std::string EntryPath(const std::string& key) const;
+
+  // Cache directory.
+  std::string cache_dir_;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_RESULT_CACHE_H_
@@ -0,0 +1,84 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/result_cache.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace api {
+namespace video {
+namespace {
+
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingAnnotateVideoRequest;
+
+TEST(ResultCacheTest, DigestIsIncremental) {
+  const std::string content = "0123456789abcdefghij";
+  ContentHasher whole;
+  whole.Update(content.data(), content.size());
+  ContentHasher pieces;
+  pieces.Update(content.data(), 7);
+  pieces.Update(content.data() + 7, content.size() - 7);
+  EXPECT_EQ(whole.Digest(), pieces.Digest());
+
+  ContentHasher other;
+  other.Update(content.data(), content.size() - 1);
+  EXPECT_NE(whole.Digest(), other.Digest());
+}
+
+TEST(ResultCacheTest, StoreAndLookup) {
+  ResultCache cache(std::string(getenv("TEST_TMPDIR")) + "/result_cache");
+  ASSERT_TRUE(cache.Open());
+
+  StreamingAnnotateVideoRequest config;
+  config.mutable_video_config()->set_feature(
+      google::cloud::videointelligence::v1p3beta1::STREAMING_LABEL_DETECTION);
+  const std::string key = ResultCache::Key(config, "digest");
+  CachedResult result;
+  EXPECT_FALSE(cache.Lookup(key, &result));
+
+  CachedResponse* response = result.add_responses();
+  response->set_elapsed_ms(1500);
+  response->mutable_response()->set_annotation_results_uri("uri");
+  ASSERT_TRUE(cache.Store(key, result));
+
+  CachedResult cached;
+  ASSERT_TRUE(cache.Lookup(key, &cached));
+  ASSERT_EQ(1, cached.responses_size());
+  EXPECT_EQ(1500, cached.responses(0).elapsed_ms());
+  EXPECT_EQ("uri", cached.responses(0).response().annotation_results_uri());
+
+  // A different config is a different entry.
+  config.mutable_video_config()->set_feature(
+      google::cloud::videointelligence::v1p3beta1::
+          STREAMING_SHOT_CHANGE_DETECTION);
+  EXPECT_FALSE(cache.Lookup(ResultCache::Key(config, "digest"), &cached));
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,325 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/result_encoder.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+namespace api {
+namespace video {
+
+namespace {
+
+using ::google::cloud::videointelligence::v1p3beta1::Entity;
+using ::google::cloud::videointelligence::v1p3beta1::NormalizedBoundingBox;
+using ::google::cloud::videointelligence::v1p3beta1::ObjectTrackingAnnotation;
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingVideoAnnotationResults;
+using ::google::protobuf::Duration;
+
+// Likelihood names, indexed by value.
+const char* const kLikelihoodNames[] = {
+    "LIKELIHOOD_UNSPECIFIED", "VERY_UNLIKELY", "UNLIKELY",
+    "POSSIBLE",               "LIKELY",        "VERY_LIKELY",
+};
+constexpr int kNumLikelihoods =
+    sizeof(kLikelihoodNames) / sizeof(kLikelihoodNames[0]);
+
+// Numbers are printed with this many decimals at most.
+constexpr int kDecimals = 6;
+constexpr int64_t kDecimalScale = 1000000;
+// Larger magnitudes don't fit the fixed-point formatting below.
+constexpr double kMaxFixedValue = 1e12;
+
+// One flattened annotation. Optional fields are unset when negative or null.
+struct Record {
+  const char* type = nullptr;
+  int64_t time_us = 0;
+  int64_t end_time_us = -1;
+  const Entity* entity = nullptr;
+  bool has_confidence = false;
+  float confidence = 0;
+  bool has_track_id = false;
+  int64_t track_id = 0;
+  int likelihood = -1;
+  const NormalizedBoundingBox* box = nullptr;
+};
+
+int64_t DurationToMicros(const Duration& duration) {
+  return duration.seconds() * 1000000 + duration.nanos() / 1000;
+}
+
+void AppendInt(int64_t value, std::string* out) {
+  char buffer[24];
+  char* end = buffer + sizeof(buffer);
+  char* p = end;
+  uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value)
+                                 : static_cast<uint64_t>(value);
+  do {
+    *--p = static_cast<char>('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0) {
+    *--p = '-';
+  }
+  out->append(p, end - p);
+}
+
+// Appends a finite number with at most kDecimals decimals and no trailing
+// zeros, e.g. 0.5, 12 or -0.000125.
+void AppendDouble(double value, std::string* out) {
+  if (std::fabs(value) >= kMaxFixedValue) {
+    char buffer[32];
+    int size = snprintf(buffer, sizeof(buffer), "%.*g", kDecimals, value);
+    out->append(buffer, size);
+    return;
+  }
+  int64_t scaled = std::llround(value * kDecimalScale);
+  if (scaled < 0) {
+    out->push_back('-');
+    scaled = -scaled;
+  }
+  AppendInt(scaled / kDecimalScale, out);
+  int64_t fraction = scaled % kDecimalScale;
+  if (fraction == 0) {
+    return;
+  }
+  char digits[kDecimals];
+  int size = kDecimals;
+  for (int i = kDecimals - 1; i >= 0; --i) {
+    digits[i] = static_cast<char>('0' + fraction % 10);
+    fraction /= 10;
+  }
+  while (digits[size - 1] == '0') {
+    --size;
+  }
+  out->push_back('.');
+  out->append(digits, size);
+}
+
+void AppendJsonString(const std::string& value, std::string* out) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  out->push_back('"');
+  for (char c : value) {
+    switch (c) {
+      case '"':
+        out->append("\\\"", 2);
+        break;
+      case '\\':
+        out->append("\\\\", 2);
+        break;
+      case '\n':
+        out->append("\\n", 2);
+        break;
+      case '\r':
+        out->append("\\r", 2);
+        break;
+      case '\t':
+        out->append("\\t", 2);
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          out->append("\\u00", 4);
+          out->push_back(kHexDigits[c >> 4]);
+          out->push_back(kHexDigits[c & 0xf]);
+        } else {
+          out->push_back(c);
+        }
+        break;
+    }
+  }
+  out->push_back('"');
+}
+
+// Quotes a CSV field only when it contains a separator, quote or line break.
+void AppendCsvString(const std::string& value, std::string* out) {
+  if (value.find_first_of(",\"\r\n") == std::string::npos) {
+    out->append(value);
+    return;
+  }
+  out->push_back('"');
+  for (char c : value) {
+    if (c == '"') {
+      out->push_back('"');
+    }
+    out->push_back(c);
+  }
+  out->push_back('"');
+}
+
+void AppendJsonRecord(const Record& record, std::string* out) {
+  out->append("{\"type\":\"");
+  out->append(record.type);
+  out->append("\",\"time_us\":");
+  AppendInt(record.time_us, out);
+  if (record.end_time_us >= 0) {
+    out->append(",\"end_time_us\":");
+    AppendInt(record.end_time_us, out);
+  }
+  if (record.entity != nullptr) {
+    out->append(",\"entity_id\":");
+    AppendJsonString(record.entity->entity_id(), out);
+    out->append(",\"description\":");
+    AppendJsonString(record.entity->description(), out);
+  }
+  if (record.has_confidence && std::isfinite(record.confidence)) {
+    out->append(",\"confidence\":");
+    AppendDouble(record.confidence, out);
+  }
+  if (record.has_track_id) {
+    out->append(",\"track_id\":");
+    AppendInt(record.track_id, out);
+  }
+  if (record.likelihood >= 0) {
+    out->append(",\"likelihood\":\"");
+    out->append(kLikelihoodNames[record.likelihood]);
+    out->push_back('"');
+  }
+  if (record.box != nullptr) {
+    const float coordinates[] = {record.box->left(), record.box->top(),
+                                 record.box->right(), record.box->bottom()};
+    out->append(",\"box\":[");
+    for (int i = 0; i < 4; ++i) {
+      if (i > 0) {
+        out->push_back(',');
+      }
+      if (std::isfinite(coordinates[i])) {
+        AppendDouble(coordinates[i], out);
+      } else {
+        out->append("null");
+      }
+    }
+    out->push_back(']');
+  }
+  out->append("}\n");
+}
+
+void AppendCsvRecord(const Record& record, std::string* out) {
+  out->append(record.type);
+  out->push_back(',');
+  AppendInt(record.time_us, out);
+  out->push_back(',');
+  if (record.end_time_us >= 0) {
+    AppendInt(record.end_time_us, out);
+  }
+  out->push_back(',');
+  if (record.entity != nullptr) {
+    AppendCsvString(record.entity->entity_id(), out);
+    out->push_back(',');
+    AppendCsvString(record.entity->description(), out);
+  } else {
+    out->push_back(',');
+  }
+  out->push_back(',');
+  if (record.has_confidence && std::isfinite(record.confidence)) {
+    AppendDouble(record.confidence, out);
+  }
+  out->push_back(',');
+  if (record.has_track_id) {
+    AppendInt(record.track_id, out);
+  }
+  out->push_back(',');
+  if (record.likelihood >= 0) {
+    out->append(kLikelihoodNames[record.likelihood]);
+  }
+  const float coordinates[] = {
+      record.box != nullptr ? record.box->left() : NAN,
+      record.box != nullptr ? record.box->top() : NAN,
+      record.box != nullptr ? record.box->right() : NAN,
+      record.box != nullptr ? record.box->bottom() : NAN};
+  for (float coordinate : coordinates) {
+    out->push_back(',');
+    if (std::isfinite(coordinate)) {
+      AppendDouble(coordinate, out);
+    }
+  }
+  out->push_back('\n');
+}
+
+}  // namespace
+
+const char ResultEncoder::kCsvHeader[] =
+    "type,time_us,end_time_us,entity_id,description,confidence,track_id,"
+    "likelihood,left,top,right,bottom";
+
+void ResultEncoder::AppendHeader(std::string* out) const {
+  if (format_ == Format::kCsv) {
+    out->append(kCsvHeader);
+    out->push_back('\n');
+  }
+}
+
+void ResultEncoder::Append(const StreamingVideoAnnotationResults& results,
+                           std::string* out) const {
+  void (*append_record)(const Record&, std::string*) =
+      format_ == Format::kCsv ? AppendCsvRecord : AppendJsonRecord;
+
+  for (const auto& shot : results.shot_annotations()) {
+    Record record;
+    record.type = "shot";
+    record.time_us = DurationToMicros(shot.start_time_offset());
+    record.end_time_us = DurationToMicros(shot.end_time_offset());
+    append_record(record, out);
+  }
+
+  for (const auto& annotation : results.label_annotations()) {
+    for (const auto& frame : annotation.frames()) {
+      Record record;
+      record.type = "label";
+      record.time_us = DurationToMicros(frame.time_offset());
+      record.entity = &annotation.entity();
+      record.has_confidence = true;
+      record.confidence = frame.confidence();
+      append_record(record, out);
+    }
+  }
+
+  for (const auto& frame : results.explicit_annotation().frames()) {
+    Record record;
+    record.type = "explicit";
+    record.time_us = DurationToMicros(frame.time_offset());
+    int likelihood = frame.pornography_likelihood();
+    record.likelihood =
+        (likelihood >= 0 && likelihood < kNumLikelihoods) ? likelihood : 0;
+    append_record(record, out);
+  }
+
+  for (const auto& annotation : results.object_annotations()) {
+    for (const auto& frame : annotation.frames()) {
+      Record record;
+      record.type = "object";
+      record.time_us = DurationToMicros(frame.time_offset());
+      record.entity = &annotation.entity();
+      record.has_confidence = true;
+      record.confidence = annotation.confidence();
+      record.has_track_id =
+          annotation.track_info_case() == ObjectTrackingAnnotation::kTrackId;
+      record.track_id = annotation.track_id();
+      record.box = &frame.normalized_bounding_box();
+      append_record(record, out);
+    }
+  }
+}
+
+}  // namespace video
+}  // namespace api
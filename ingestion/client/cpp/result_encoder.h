@@ -0,0 +1,66 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_RESULT_ENCODER_H_
+#define API_VIDEO_CLIENT_CPP_RESULT_ENCODER_H_
+
+#include <string>
+
+#include "proto/video_intelligence_streaming.pb.h"
+
+namespace api {
+namespace video {
+
+// Encodes annotation results as flat, machine-readable records: one line per
+// shot, label frame, explicit content frame and object box. Records are
+// written by hand into the caller's buffer, without protobuf reflection, so
+// encoding takes no allocation once the buffer has grown.
+//
+// CSV records have the columns of kCsvHeader, empty when not applicable.
+// JSON Lines records only have the applicable fields, e.g.
+//   {"type":"object","time_us":1500000,"entity_id":"/m/0k4j",
+//    "description":"car","confidence":0.87,"track_id":3,
+//    "box":[0.1,0.25,0.5,0.75]}
+// Times are in microseconds, numbers have at most 6 decimals.
+class ResultEncoder {
+ public:
+  enum class Format { kJsonl, kCsv };
+
+  // CSV header line, without the line break.
+  static const char kCsvHeader[];
+
+  explicit ResultEncoder(Format format) : format_(format) {}
+
+  // Appends the header line to `out`, if the format has one.
+  void AppendHeader(std::string* out) const;
+
+  // Appends the records of `results` to `out`.
+  void Append(const google::cloud::videointelligence::v1p3beta1::
+                  StreamingVideoAnnotationResults& results,
+              std::string* out) const;
+
+ private:
+  Format format_;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_RESULT_ENCODER_H_
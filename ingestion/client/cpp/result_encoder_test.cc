@@ -0,0 +1,120 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/result_encoder.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace api {
+namespace video {
+namespace {
+
+using ::google::cloud::videointelligence::v1p3beta1::POSSIBLE;
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingVideoAnnotationResults;
+
+StreamingVideoAnnotationResults MakeResults() {
+  StreamingVideoAnnotationResults results;
+  auto* shot = results.add_shot_annotations();
+  shot->mutable_start_time_offset()->set_seconds(1);
+  shot->mutable_end_time_offset()->set_seconds(2);
+  shot->mutable_end_time_offset()->set_nanos(500000000);
+
+  auto* label = results.add_label_annotations();
+  label->mutable_entity()->set_entity_id("/m/01");
+  label->mutable_entity()->set_description("say \"hi\", \\o/");
+  auto* label_frame = label->add_frames();
+  label_frame->mutable_time_offset()->set_nanos(250000);
+  label_frame->set_confidence(0.5f);
+
+  auto* explicit_frame = results.mutable_explicit_annotation()->add_frames();
+  explicit_frame->mutable_time_offset()->set_seconds(3);
+  explicit_frame->set_pornography_likelihood(POSSIBLE);
+
+  auto* object = results.add_object_annotations();
+  object->mutable_entity()->set_entity_id("/m/02");
+  object->mutable_entity()->set_description("car");
+  object->set_confidence(0.875f);
+  object->set_track_id(7);
+  auto* object_frame = object->add_frames();
+  object_frame->mutable_time_offset()->set_seconds(4);
+  auto* box = object_frame->mutable_normalized_bounding_box();
+  box->set_left(0.125f);
+  box->set_top(0);
+  box->set_right(1);
+  box->set_bottom(0.1f);
+  return results;
+}
+
+TEST(ResultEncoderTest, Jsonl) {
+  ResultEncoder encoder(ResultEncoder::Format::kJsonl);
+  std::string out;
+  encoder.AppendHeader(&out);
+  EXPECT_EQ("", out);
+  encoder.Append(MakeResults(), &out);
+  EXPECT_EQ(
+      "{\"type\":\"shot\",\"time_us\":1000000,\"end_time_us\":2500000}\n"
+      "{\"type\":\"label\",\"time_us\":250,\"entity_id\":\"/m/01\","
+      "\"description\":\"say \\\"hi\\\", \\\\o/\",\"confidence\":0.5}\n"
+      "{\"type\":\"explicit\",\"time_us\":3000000,"
+      "\"likelihood\":\"POSSIBLE\"}\n"
+      "{\"type\":\"object\",\"time_us\":4000000,\"entity_id\":\"/m/02\","
+      "\"description\":\"car\",\"confidence\":0.875,\"track_id\":7,"
+      "\"box\":[0.125,0,1,0.1]}\n",
+      out);
+}
+
+TEST(ResultEncoderTest, Csv) {
+  ResultEncoder encoder(ResultEncoder::Format::kCsv);
+  std::string out;
+  encoder.AppendHeader(&out);
+  encoder.Append(MakeResults(), &out);
+  EXPECT_EQ(std::string(ResultEncoder::kCsvHeader) +
+                "\n"
+                "shot,1000000,2500000,,,,,,,,,\n"
+                "label,250,,/m/01,\"say \"\"hi\"\", \\o/\",0.5,,,,,,\n"
+                "explicit,3000000,,,,,,POSSIBLE,,,,\n"
+                "object,4000000,,/m/02,car,0.875,7,,0.125,0,1,0.1\n",
+            out);
+}
+
+TEST(ResultEncoderTest, ReusesBuffer) {
+  ResultEncoder encoder(ResultEncoder::Format::kJsonl);
+  StreamingVideoAnnotationResults results = MakeResults();
+  std::string out;
+  encoder.Append(results, &out);
+  std::string first = out;
+  const char* data = out.data();
+  out.clear();
+  encoder.Append(results, &out);
+  EXPECT_EQ(first, out);
+  EXPECT_EQ(data, out.data());
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
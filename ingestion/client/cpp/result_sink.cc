@@ -0,0 +1,78 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/result_sink.h"
+
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+ResultDispatcher::~ResultDispatcher() { Close(); }
+
+void ResultDispatcher::AddSink(const std::string& name,
+                               std::unique_ptr<ResultSink> sink,
+                               size_t max_queue_size, size_t max_batch_size,
+                               OverflowPolicy policy) {
+  CHECK(sink != nullptr);
+  CHECK_GT(max_queue_size, 0);
+  CHECK_GT(max_batch_size, 0);
+  std::unique_ptr<Worker> worker(new Worker(max_queue_size, policy));
+  worker->name = name;
+  worker->sink = std::move(sink);
+  worker->max_batch_size = max_batch_size;
+  worker->queue.stats()->Register("result_sink_" + name);
+  Worker* w = worker.get();
+  worker->thread = std::thread([w] { Run(w); });
+  workers_.push_back(std::move(worker));
+}
+
+void ResultDispatcher::Publish(const SharedResponse& resp) {
+  for (auto& worker : workers_) {
+    // Fails if the response is dropped, which Close() reports.
+    worker->queue.Emplace(resp);
+  }
+}
+
+void ResultDispatcher::Close() {
+  for (auto& worker : workers_) {
+    worker->queue.Close();
+    worker->thread.join();
+    size_t dropped = worker->queue.Dropped();
+    if (dropped > 0) {
+      LOG(WARNING) << "Result sink " << worker->name << " fell behind and "
+                   << "dropped " << dropped << " responses.";
+    }
+  }
+  workers_.clear();
+}
+
+void ResultDispatcher::Run(Worker* worker) {
+  std::vector<SharedResponse> batch;
+  // The sink runs outside the queue's lock, so publishing is never blocked
+  // by it unless the queue is full.
+  while (worker->queue.PopBatch(&batch, worker->max_batch_size) > 0) {
+    worker->sink->Consume(batch);
+  }
+  worker->sink->Flush();
+}
+
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,106 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_RESULT_SINK_H_
+#define API_VIDEO_CLIENT_CPP_RESULT_SINK_H_
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "client/cpp/sync_queue.h"
+#include "proto/video_intelligence_streaming.pb.h"
+
+namespace api {
+namespace video {
+
+// Shared read-only annotation response.
+using SharedResponse = std::shared_ptr<
+    const google::cloud::videointelligence::v1p3beta1::
+        StreamingAnnotateVideoResponse>;
+
+// Consumer of annotation responses, e.g. a log or a result file. A sink is
+// driven by a single worker thread, so it need not be thread-safe.
+class ResultSink {
+ public:
+  ResultSink() = default;
+  virtual ~ResultSink() = default;
+
+  // Disallows copy and assign.
+  ResultSink(const ResultSink&) = delete;
+  ResultSink& operator=(const ResultSink&) = delete;
+
+  // Consumes a batch of responses, in arrival order.
+  virtual void Consume(const std::vector<SharedResponse>& batch) = 0;
+
+  // Called after the last batch.
+  virtual void Flush() {}
+};
+
+// Fans responses out to sinks. Each sink runs on its own worker thread
+// behind a bounded queue with its own OverflowPolicy, so publishing only
+// enqueues and a slow sink never delays reading the gRPC stream, unless its
+// policy is kBlock.
+class ResultDispatcher {
+ public:
+  ResultDispatcher() = default;
+  ~ResultDispatcher();
+
+  // Disallows copy and assign.
+  ResultDispatcher(const ResultDispatcher&) = delete;
+  ResultDispatcher& operator=(const ResultDispatcher&) = delete;
+
+  // Adds a sink and starts its worker. The worker hands the sink up to
+  // `max_batch_size` queued responses at a time.
+  void AddSink(const std::string& name, std::unique_ptr<ResultSink> sink,
+               size_t max_queue_size, size_t max_batch_size,
+               OverflowPolicy policy);
+
+  // Publishes a response to all sinks.
+  void Publish(const SharedResponse& resp);
+
+  // Delivers all queued responses, flushes the sinks and stops the workers.
+  // Nothing can be published afterwards.
+  void Close();
+
+ private:
+  // A sink with its queue and worker.
+  struct Worker {
+    Worker(size_t max_queue_size, OverflowPolicy policy)
+        : queue(max_queue_size, policy) {}
+
+    std::string name;
+    std::unique_ptr<ResultSink> sink;
+    size_t max_batch_size;
+    SyncQueue<SharedResponse, ElementCount, QueueStats> queue;
+    std::thread thread;
+  };
+
+  // Runs a sink until its queue is closed and drained.
+  static void Run(Worker* worker);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_RESULT_SINK_H_
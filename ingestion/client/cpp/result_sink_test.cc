@@ -0,0 +1,134 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/result_sink.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace api {
+namespace video {
+namespace {
+
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingAnnotateVideoResponse;
+
+SharedResponse MakeResponse(int i) {
+  std::shared_ptr<StreamingAnnotateVideoResponse> resp(
+      new StreamingAnnotateVideoResponse());
+  resp->set_annotation_results_uri(std::to_string(i));
+  return resp;
+}
+
+// Records responses, blocking while `blocked` is set.
+class RecordingSink : public ResultSink {
+ public:
+  RecordingSink(std::vector<int>* received, std::vector<size_t>* batch_sizes,
+                std::atomic<bool>* blocked, std::atomic<int>* consuming)
+      : received_(received),
+        batch_sizes_(batch_sizes),
+        blocked_(blocked),
+        consuming_(consuming) {}
+
+  void Consume(const std::vector<SharedResponse>& batch) override {
+    ++*consuming_;
+    while (*blocked_) {
+      std::this_thread::yield();
+    }
+    batch_sizes_->push_back(batch.size());
+    for (const SharedResponse& resp : batch) {
+      received_->push_back(std::stoi(resp->annotation_results_uri()));
+    }
+  }
+
+ private:
+  std::vector<int>* received_;
+  std::vector<size_t>* batch_sizes_;
+  std::atomic<bool>* blocked_;
+  std::atomic<int>* consuming_;
+};
+
+TEST(ResultDispatcherTest, BlockDeliversAllInOrder) {
+  std::vector<int> received;
+  std::vector<size_t> batch_sizes;
+  std::atomic<bool> blocked{false};
+  std::atomic<int> consuming{0};
+  ResultDispatcher dispatcher;
+  dispatcher.AddSink("sink",
+                     std::unique_ptr<ResultSink>(new RecordingSink(
+                         &received, &batch_sizes, &blocked, &consuming)),
+                     4, 3, OverflowPolicy::kBlock);
+  for (int i = 0; i < 100; ++i) {
+    dispatcher.Publish(MakeResponse(i));
+  }
+  dispatcher.Close();
+  ASSERT_EQ(100, received.size());
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(i, received[i]);
+  }
+  for (size_t batch_size : batch_sizes) {
+    EXPECT_LE(batch_size, 3);
+  }
+}
+
+TEST(ResultDispatcherTest, DropPolicies) {
+  std::vector<int> newest_received, oldest_received;
+  std::vector<size_t> newest_batch_sizes, oldest_batch_sizes;
+  std::atomic<bool> blocked{true};
+  std::atomic<int> consuming{0};
+  ResultDispatcher dispatcher;
+  // A batch of one is taken by each worker before it blocks; the queues
+  // then hold 2 responses.
+  dispatcher.AddSink(
+      "newest",
+      std::unique_ptr<ResultSink>(new RecordingSink(
+          &newest_received, &newest_batch_sizes, &blocked, &consuming)),
+      2, 1, OverflowPolicy::kDropNewest);
+  dispatcher.AddSink(
+      "oldest",
+      std::unique_ptr<ResultSink>(new RecordingSink(
+          &oldest_received, &oldest_batch_sizes, &blocked, &consuming)),
+      2, 1, OverflowPolicy::kDropOldest);
+  dispatcher.Publish(MakeResponse(0));
+  // Waits for both workers to take the first response.
+  while (consuming < 2) {
+    std::this_thread::yield();
+  }
+  for (int i = 1; i < 10; ++i) {
+    dispatcher.Publish(MakeResponse(i));
+  }
+  blocked = false;
+  dispatcher.Close();
+  EXPECT_EQ(std::vector<int>({0, 1, 2}), newest_received);
+  EXPECT_EQ(std::vector<int>({0, 8, 9}), oldest_received);
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
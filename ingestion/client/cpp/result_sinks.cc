@@ -0,0 +1,156 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/result_sinks.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "client/cpp/annotation_util.h"
+#include "client/cpp/proto_processor.h"
+#include "client/cpp/proto_writer.h"
+#include "client/cpp/segmented_writer.h"
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+using ::google::cloud::videointelligence::v1p3beta1::StreamingFeature;
+
+LogSink::LogSink(StreamingFeature feature) : feature_(feature) {}
+
+void LogSink::Consume(const std::vector<SharedResponse>& batch) {
+  for (const SharedResponse& resp : batch) {
+    ProtoProcessor::Process(feature_, resp->annotation_results());
+  }
+}
+
+ProtoFileSink::ProtoFileSink(ProtoWriter* writer,
+                             WrittenCallback written_callback,
+                             DueCallback due_callback)
+    : writer_(writer),
+      written_callback_(std::move(written_callback)),
+      due_callback_(std::move(due_callback)) {
+  CHECK(writer_ != nullptr);
+}
+
+void ProtoFileSink::Consume(const std::vector<SharedResponse>& batch) {
+  for (const SharedResponse& resp : batch) {
+    if (resp->has_error()) {
+      continue;
+    }
+    int64_t time_us = GetLatestTimeOffsetUs(resp->annotation_results());
+    writer_->WriteProto(resp->annotation_results(), time_us);
+    latest_time_us_ = std::max(latest_time_us_, time_us);
+  }
+  // Results are flushed before they are reported as written.
+  if (written_callback_ != nullptr &&
+      (due_callback_ == nullptr || due_callback_()) && writer_->Flush()) {
+    written_callback_(latest_time_us_, writer_->Size());
+  }
+}
+
+void ProtoFileSink::Flush() { writer_->Flush(); }
+
+SegmentedProtoFileSink::SegmentedProtoFileSink(
+    SegmentedWriter* segments, WrittenCallback written_callback,
+    DueCallback due_callback)
+    : segments_(segments),
+      written_callback_(std::move(written_callback)),
+      due_callback_(std::move(due_callback)) {
+  CHECK(segments_ != nullptr);
+}
+
+void SegmentedProtoFileSink::Consume(const std::vector<SharedResponse>& batch) {
+  bool flushed = true;
+  for (const SharedResponse& resp : batch) {
+    if (resp->has_error()) {
+      continue;
+    }
+    int64_t time_us = GetLatestTimeOffsetUs(resp->annotation_results());
+    if (segments_->ShouldRotate(time_us)) {
+      // The segment is closed in the background, so results reported as
+      // written must be flushed first.
+      if (written_callback_ != nullptr) {
+        flushed = static_cast<ProtoWriter*>(segments_->writer())->Flush() &&
+                  flushed;
+      }
+      segments_->Rotate();
+    }
+    ProtoWriter* writer = static_cast<ProtoWriter*>(segments_->writer());
+    int64_t size = writer->Size();
+    writer->WriteProto(resp->annotation_results(), time_us);
+    segments_->Written(writer->Size() - size, time_us);
+    latest_time_us_ = std::max(latest_time_us_, time_us);
+  }
+  // Results are flushed before they are reported as written.
+  if (written_callback_ != nullptr &&
+      (due_callback_ == nullptr || due_callback_())) {
+    ProtoWriter* writer = static_cast<ProtoWriter*>(segments_->writer());
+    if (writer->Flush() && flushed) {
+      written_callback_(latest_time_us_, segments_->segment_index(),
+                        writer->Size());
+    }
+  }
+}
+
+void SegmentedProtoFileSink::Flush() {
+  static_cast<ProtoWriter*>(segments_->writer())->Flush();
+}
+
+EncodedFileSink::EncodedFileSink(const std::string& path,
+                                 ResultEncoder::Format format)
+    : path_(path), encoder_(format) {}
+
+bool EncodedFileSink::Open() {
+  output_.open(path_, std::ofstream::binary);
+  if (!output_.is_open()) {
+    LOG(ERROR) << "Failed to open write file " << path_;
+    return false;
+  }
+  buffer_.clear();
+  encoder_.AppendHeader(&buffer_);
+  output_.write(buffer_.data(), buffer_.size());
+  return true;
+}
+
+void EncodedFileSink::Consume(const std::vector<SharedResponse>& batch) {
+  buffer_.clear();
+  for (const SharedResponse& resp : batch) {
+    if (!resp->has_error()) {
+      encoder_.Append(resp->annotation_results(), &buffer_);
+    }
+  }
+  output_.write(buffer_.data(), buffer_.size());
+}
+
+void EncodedFileSink::Flush() { output_.flush(); }
+
+CallbackSink::CallbackSink(Callback callback)
+    : callback_(std::move(callback)) {}
+
+void CallbackSink::Consume(const std::vector<SharedResponse>& batch) {
+  for (const SharedResponse& resp : batch) {
+    callback_(resp);
+  }
+}
+
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,146 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_RESULT_SINKS_H_
+#define API_VIDEO_CLIENT_CPP_RESULT_SINKS_H_
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "client/cpp/result_encoder.h"
+#include "client/cpp/result_sink.h"
+#include "proto/video_intelligence_streaming.pb.h"
+
+namespace api {
+namespace video {
+
+class ProtoWriter;
+class SegmentedWriter;
+
+// Logs annotation results with ProtoProcessor.
+class LogSink : public ResultSink {
+ public:
+  explicit LogSink(
+      google::cloud::videointelligence::v1p3beta1::StreamingFeature feature);
+
+  void Consume(const std::vector<SharedResponse>& batch) override;
+
+ private:
+  google::cloud::videointelligence::v1p3beta1::StreamingFeature feature_;
+};
+
+// Appends annotation results to a proto file. Error responses are skipped.
+class ProtoFileSink : public ResultSink {
+ public:
+  // Called after a batch is written and flushed, with the latest time offset
+  // (in microseconds) written so far and the file size.
+  using WrittenCallback =
+      std::function<void(int64_t latest_time_us, int64_t file_size)>;
+
+  // Whether written results are due to be reported. A flush is a
+  // synchronous write, so batches are only flushed to be reported.
+  using DueCallback = std::function<bool()>;
+
+  // `writer` must be open and outlive the sink. `written_callback` may be
+  // null. If `due_callback` is null, every batch is reported.
+  ProtoFileSink(ProtoWriter* writer, WrittenCallback written_callback,
+                DueCallback due_callback = nullptr);
+
+  void Consume(const std::vector<SharedResponse>& batch) override;
+  void Flush() override;
+
+ private:
+  ProtoWriter* writer_;
+  WrittenCallback written_callback_;
+  DueCallback due_callback_;
+  int64_t latest_time_us_ = -1;
+};
+
+// Appends annotation results to proto file segments, rotated by size or
+// media time. Error responses are skipped.
+class SegmentedProtoFileSink : public ResultSink {
+ public:
+  // Called after a batch is written and flushed, with the latest time offset
+  // (in microseconds) written so far, and the index and size of the current
+  // segment.
+  using WrittenCallback = std::function<void(
+      int64_t latest_time_us, int64_t segment_index, int64_t segment_size)>;
+
+  // Whether written results are due to be reported, see ProtoFileSink.
+  using DueCallback = ProtoFileSink::DueCallback;
+
+  // `segments` must be open, write segments with ProtoWriters, and outlive
+  // the sink. `written_callback` may be null. If `due_callback` is null,
+  // every batch is reported.
+  SegmentedProtoFileSink(SegmentedWriter* segments,
+                         WrittenCallback written_callback,
+                         DueCallback due_callback = nullptr);
+
+  void Consume(const std::vector<SharedResponse>& batch) override;
+  void Flush() override;
+
+ private:
+  SegmentedWriter* segments_;
+  WrittenCallback written_callback_;
+  DueCallback due_callback_;
+  int64_t latest_time_us_ = -1;
+};
+
+// Writes annotation results as JSON Lines or CSV records, with one file
+// write per batch.
+class EncodedFileSink : public ResultSink {
+ public:
+  EncodedFileSink(const std::string& path, ResultEncoder::Format format);
+
+  // Opens the output file and writes the header, if any.
+  bool Open();
+
+  void Consume(const std::vector<SharedResponse>& batch) override;
+  void Flush() override;
+
+ private:
+  std::string path_;
+  ResultEncoder encoder_;
+  std::ofstream output_;
+  // Encoded batch, reused across batches.
+  std::string buffer_;
+};
+
+// Passes responses to a function.
+class CallbackSink : public ResultSink {
+ public:
+  using Callback = std::function<void(const SharedResponse& resp)>;
+
+  explicit CallbackSink(Callback callback);
+
+  void Consume(const std::vector<SharedResponse>& batch) override;
+
+ private:
+  Callback callback_;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_RESULT_SINKS_H_
@@ -0,0 +1,247 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/result_sinks.h"
+
+#include <sys/stat.h>
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "client/cpp/proto_reader.h"
+#include "client/cpp/proto_writer.h"
+#include "client/cpp/segmented_writer.h"
+#include "gtest/gtest.h"
+
+namespace api {
+namespace video {
+namespace {
+
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingAnnotateVideoResponse;
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingVideoAnnotationResults;
+
+// Makes a response with a shot ending at `i` * 100 ms.
+SharedResponse MakeResponse(int i) {
+  std::shared_ptr<StreamingAnnotateVideoResponse> resp(
+      new StreamingAnnotateVideoResponse());
+  auto* end = resp->mutable_annotation_results()
+                  ->add_shot_annotations()
+                  ->mutable_end_time_offset();
+  end->set_seconds(i / 10);
+  end->set_nanos((i % 10) * 100000000);
+  return resp;
+}
+
+int64_t FileSize(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+std::unique_ptr<SegmentedWriter> MakeSegments(const std::string& path) {
+  SegmentedWriter::Options options;
+  options.max_segment_duration_us = 1000000;
+  return std::unique_ptr<SegmentedWriter>(
+      new SegmentedWriter(path, options, [](const std::string& segment_path) {
+        return std::unique_ptr<IOWriter>(new ProtoWriter(segment_path));
+      }));
+}
+
+struct Checkpoint {
+  int64_t latest_time_us = -1;
+  int64_t segment_index = -1;
+  int64_t segment_size = -1;
+};
+
+// Writes responses [begin, end) in batches of 4.
+void WriteResponses(SegmentedProtoFileSink* sink, int begin, int end) {
+  for (int i = begin; i < end; i += 4) {
+    std::vector<SharedResponse> batch;
+    for (int j = i; j < std::min(i + 4, end); ++j) {
+      batch.push_back(MakeResponse(j));
+    }
+    sink->Consume(batch);
+  }
+}
+
+// Tests that written results are only reported when they are due.
+TEST(ProtoFileSinkTest, ReportsOnlyWhenDue) {
+  const std::string path =
+      std::string(getenv("TEST_TMPDIR")) + "/due_results.log";
+  ProtoWriter writer(path);
+  ASSERT_TRUE(writer.Open());
+  std::vector<int64_t> reported_sizes;
+  bool due = false;
+  ProtoFileSink sink(
+      &writer,
+      [&reported_sizes](int64_t, int64_t file_size) {
+        reported_sizes.push_back(file_size);
+      },
+      [&due] { return due; });
+  sink.Consume({MakeResponse(0)});
+  EXPECT_TRUE(reported_sizes.empty());
+  due = true;
+  sink.Consume({MakeResponse(1)});
+  ASSERT_EQ(1, reported_sizes.size());
+  // Reported results are flushed.
+  EXPECT_EQ(reported_sizes[0], FileSize(path));
+  writer.Close();
+}
+
+// Rolls the segments at `path` back to `checkpoint`. Returns null on
+// failure.
+std::unique_ptr<SegmentedWriter> RollBack(const std::string& path,
+                                          const Checkpoint& checkpoint) {
+  std::unique_ptr<SegmentedWriter> segments = MakeSegments(path);
+  bool rolled_back = segments->RollBack(
+      checkpoint.segment_index, checkpoint.segment_size,
+      [&checkpoint](const std::string& segment_path, int64_t size) {
+        ProtoWriter writer(segment_path);
+        if (!writer.OpenAt(size, checkpoint.latest_time_us)) {
+          return false;
+        }
+        writer.Close();
+        return true;
+      });
+  if (!rolled_back) {
+    return nullptr;
+  }
+  return segments;
+}
+
+// Checks that the segments listed at `path` hold the results of responses
+// [0, num_responses) once each, and are all of their listed size.
+void ExpectResults(const std::string& path, int num_responses) {
+  SegmentManifest manifest;
+  ASSERT_TRUE(manifest.Load(SegmentManifestPath(path)));
+  std::vector<int64_t> times;
+  for (const SegmentInfo& segment : manifest.segments()) {
+    EXPECT_EQ(segment.size, FileSize(segment.path));
+    ProtoReader reader(segment.path);
+    ASSERT_TRUE(reader.Open());
+    StreamingVideoAnnotationResults results;
+    while (reader.ReadProto(&results)) {
+      times.push_back(
+          results.shot_annotations(0).end_time_offset().seconds() * 1000000 +
+          results.shot_annotations(0).end_time_offset().nanos() / 1000);
+    }
+    reader.Close();
+  }
+  ASSERT_EQ(num_responses, times.size());
+  for (int i = 0; i < num_responses; ++i) {
+    EXPECT_EQ(i * 100000, times[i]);
+  }
+}
+
+// Writes responses [0, 30) to segments at `path`, and gets the checkpoint
+// the sink reported after results 0-15: in the middle of segment 1, while
+// the run went on to segment 2.
+void WriteFirstRun(const std::string& path, Checkpoint* checkpoint) {
+  std::vector<Checkpoint> checkpoints;
+  auto record = [&checkpoints](int64_t latest_time_us, int64_t segment_index,
+                               int64_t segment_size) {
+    Checkpoint checkpoint;
+    checkpoint.latest_time_us = latest_time_us;
+    checkpoint.segment_index = segment_index;
+    checkpoint.segment_size = segment_size;
+    checkpoints.push_back(checkpoint);
+  };
+  std::unique_ptr<SegmentedWriter> segments = MakeSegments(path);
+  ASSERT_TRUE(segments->Open());
+  {
+    SegmentedProtoFileSink sink(segments.get(), record);
+    WriteResponses(&sink, 0, 30);
+  }
+  segments->Close();
+  ASSERT_EQ(8, checkpoints.size());
+  *checkpoint = checkpoints[3];
+  EXPECT_EQ(1500000, checkpoint->latest_time_us);
+  EXPECT_EQ(1, checkpoint->segment_index);
+  EXPECT_LT(checkpoint->segment_size, FileSize(SegmentPath(path, 1)));
+  EXPECT_GT(FileSize(SegmentPath(path, 2)), 0);
+}
+
+// Tests that a run resumed from a checkpoint reported by the sink neither
+// loses nor duplicates results, although results past the checkpoint were
+// written before the first run stopped.
+TEST(SegmentedProtoFileSinkTest, ResumesFromCheckpoint) {
+  const std::string path =
+      std::string(getenv("TEST_TMPDIR")) + "/segmented_results.log";
+  Checkpoint checkpoint;
+  WriteFirstRun(path, &checkpoint);
+
+  std::unique_ptr<SegmentedWriter> segments = RollBack(path, checkpoint);
+  ASSERT_TRUE(segments != nullptr);
+  EXPECT_EQ(checkpoint.segment_size, FileSize(SegmentPath(path, 1)));
+  EXPECT_EQ(-1, FileSize(SegmentPath(path, 2)));
+  ASSERT_TRUE(segments->Open());
+  EXPECT_EQ(2, segments->segment_index());
+  {
+    // Results after the checkpoint are received again.
+    SegmentedProtoFileSink sink(segments.get(), nullptr);
+    WriteResponses(&sink, 16, 40);
+  }
+  segments->Close();
+  ExpectResults(path, 40);
+}
+
+// Tests resuming after a crash, from a checkpoint in the segment that the
+// first run was writing and had not listed.
+TEST(SegmentedProtoFileSinkTest, ResumesAfterCrash) {
+  const std::string path =
+      std::string(getenv("TEST_TMPDIR")) + "/crashed_results.log";
+  Checkpoint checkpoint;
+  WriteFirstRun(path, &checkpoint);
+  // The run stopped while writing segment 1.
+  SegmentManifest manifest;
+  ASSERT_TRUE(manifest.Load(SegmentManifestPath(path)));
+  while (manifest.segments().back().index > 0) {
+    manifest.segments().pop_back();
+  }
+  ASSERT_TRUE(manifest.Save(SegmentManifestPath(path)));
+
+  std::unique_ptr<SegmentedWriter> segments = RollBack(path, checkpoint);
+  ASSERT_TRUE(segments != nullptr);
+  EXPECT_EQ(checkpoint.segment_size, FileSize(SegmentPath(path, 1)));
+  EXPECT_EQ(-1, FileSize(SegmentPath(path, 2)));
+  ASSERT_TRUE(segments->Open());
+  EXPECT_EQ(2, segments->segment_index());
+  {
+    SegmentedProtoFileSink sink(segments.get(), nullptr);
+    WriteResponses(&sink, 16, 40);
+  }
+  segments->Close();
+  ASSERT_TRUE(manifest.Load(SegmentManifestPath(path)));
+  ASSERT_LE(3, manifest.segments().size());
+  EXPECT_EQ(1, manifest.segments()[1].index);
+  ExpectResults(path, 40);
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
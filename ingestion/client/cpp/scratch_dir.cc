@@ -0,0 +1,80 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/scratch_dir.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+ScratchDir::~ScratchDir() { Remove(); }
+
+bool ScratchDir::Create(const std::string& parent, const std::string& prefix) {
+  CHECK(path_.empty()) << path_ << " is already created";
+  std::string pattern = parent + "/" + prefix + "XXXXXX";
+  std::vector<char> path(pattern.begin(), pattern.end());
+  path.push_back('\0');
+  if (mkdtemp(path.data()) == nullptr) {
+    LOG(ERROR) << "Failed to create a directory in " << parent << ": "
+               << strerror(errno);
+    return false;
+  }
+  path_ = path.data();
+  return true;
+}
+
+bool ScratchDir::Remove() {
+  if (path_.empty()) {
+    return true;
+  }
+  bool status = true;
+  DIR* dir = opendir(path_.c_str());
+  if (dir != nullptr) {
+    while (struct dirent* entry = readdir(dir)) {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+        continue;
+      }
+      std::string file = path_ + "/" + entry->d_name;
+      if (unlink(file.c_str()) != 0 && errno != ENOENT) {
+        LOG(ERROR) << "Failed to remove " << file << ": " << strerror(errno);
+        status = false;
+      }
+    }
+    closedir(dir);
+  }
+  if (rmdir(path_.c_str()) != 0 && errno != ENOENT) {
+    LOG(ERROR) << "Failed to remove " << path_ << ": " << strerror(errno);
+    return false;
+  }
+  path_.clear();
+  return status;
+}
+
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,59 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_SCRATCH_DIR_H_
+#define API_VIDEO_CLIENT_CPP_SCRATCH_DIR_H_
+
+#include <string>
+
+namespace api {
+namespace video {
+
+// A uniquely named directory for the temporary files of one run, so that
+// concurrent runs sharing a parent directory do not overwrite each other's
+// files. It is removed with the files in it when destroyed.
+class ScratchDir {
+ public:
+  ScratchDir() = default;
+  ~ScratchDir();
+
+  // Disallows copy and assign.
+  ScratchDir(const ScratchDir&) = delete;
+  ScratchDir& operator=(const ScratchDir&) = delete;
+
+  // Creates a new directory in `parent`, named `prefix` followed by a unique
+  // suffix.
+  bool Create(const std::string& parent, const std::string& prefix);
+
+  // Removes the files in the directory, then the directory. Subdirectories
+  // are not supported.
+  bool Remove();
+
+  // Gets the path of the directory, empty if not created.
+  const std::string& path() const { return path_; }
+
+ private:
+  std::string path_;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  // API_VIDEO_CLIENT_CPP_SCRATCH_DIR_H_
@@ -0,0 +1,74 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/scratch_dir.h"
+
+#include <sys/stat.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace api {
+namespace video {
+namespace {
+
+bool Exists(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+// Tests that every run gets its own directory, removed with its files.
+TEST(ScratchDirTest, UniqueAndRemoved) {
+  const std::string parent = getenv("TEST_TMPDIR");
+  std::string first_path, file_path;
+  {
+    ScratchDir first;
+    ScratchDir second;
+    ASSERT_TRUE(first.Create(parent, "shards-"));
+    ASSERT_TRUE(second.Create(parent, "shards-"));
+    EXPECT_NE(first.path(), second.path());
+    EXPECT_EQ(0, first.path().find(parent + "/shards-"));
+    first_path = first.path();
+    file_path = first_path + "/shard-000.mp4";
+    std::ofstream(file_path) << "data";
+    ASSERT_TRUE(Exists(file_path));
+
+    EXPECT_TRUE(second.Remove());
+    EXPECT_TRUE(second.path().empty());
+    EXPECT_TRUE(second.Remove());
+  }
+  EXPECT_FALSE(Exists(file_path));
+  EXPECT_FALSE(Exists(first_path));
+}
+
+// Tests that creating a directory in a missing parent fails.
+TEST(ScratchDirTest, MissingParent) {
+  ScratchDir dir;
+  EXPECT_FALSE(
+      dir.Create(std::string(getenv("TEST_TMPDIR")) + "/missing", "shards-"));
+  EXPECT_TRUE(dir.path().empty());
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,99 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/segmented_file_writer.h"
+
+#include <memory>
+#include <vector>
+
+#include "client/cpp/file_writer.h"
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+SegmentedFileWriter::SegmentedFileWriter(
+    const std::string& path, const SegmentedWriter::Options& options)
+    : IOWriter(path),
+      segments_(path, options, [](const std::string& segment_path) {
+        return std::unique_ptr<IOWriter>(new FileWriter(segment_path));
+      }) {}
+
+bool SegmentedFileWriter::Open() { return segments_.Open(); }
+
+bool SegmentedFileWriter::WriteBytes(size_t bytes_written, char* data) {
+  CHECK(data != nullptr);
+
+  int64_t chunk_offset = parser_.bytes_parsed();
+  std::vector<Mp4Fragment> fragments;
+  if (!parser_.is_invalid() &&
+      !parser_.Parse(data, bytes_written, &fragments)) {
+    LOG(WARNING) << "Video segments are cut by size only: input is not a "
+                 << "fragmented MP4 stream.";
+  }
+  if (parser_.is_invalid()) {
+    if (segments_.ShouldRotate(-1)) {
+      segments_.Rotate();
+    }
+    return Write(data, bytes_written);
+  }
+
+  size_t written = 0;
+  for (const Mp4Fragment& fragment : fragments) {
+    if (first_fragment_time_us_ < 0) {
+      first_fragment_time_us_ = fragment.decode_time_us;
+    }
+    int64_t time_us = fragment.decode_time_us - first_fragment_time_us_;
+    // A segment can start at a fragment that starts within this chunk, as
+    // none of it has been written yet.
+    if (fragment.offset >= chunk_offset) {
+      size_t split = fragment.offset - chunk_offset;
+      if (!Write(data + written, split - written)) {
+        return false;
+      }
+      written = split;
+      if (segments_.ShouldRotate(time_us) && segments_.Rotate()) {
+        time_us_ = time_us;
+        const std::string& init_segment = parser_.init_segment();
+        if (!Write(init_segment.data(), init_segment.size())) {
+          return false;
+        }
+      }
+    }
+    time_us_ = time_us;
+  }
+  return Write(data + written, bytes_written - written);
+}
+
+void SegmentedFileWriter::Close() { segments_.Close(); }
+
+bool SegmentedFileWriter::Write(const char* data, size_t size) {
+  if (size == 0) {
+    return true;
+  }
+  if (!segments_.writer()->WriteBytes(size, const_cast<char*>(data))) {
+    return false;
+  }
+  segments_.Written(size, time_us_);
+  return true;
+}
+
+}  // namespace video
+}  // namespace api
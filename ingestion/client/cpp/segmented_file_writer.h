@@ -0,0 +1,73 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_SEGMENTED_FILE_WRITER_H_
+#define API_VIDEO_CLIENT_CPP_SEGMENTED_FILE_WRITER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "client/cpp/io_writer.h"
+#include "client/cpp/mp4_fragment_parser.h"
+#include "client/cpp/segmented_writer.h"
+
+namespace api {
+namespace video {
+
+// Records a video stream as segments (see SegmentedWriter). A fragmented MP4
+// stream is cut where a fragment starts, and each segment starts with the
+// init segment, so that it plays on its own; segment times are media times
+// from the first fragment, as annotation times are. Other streams are cut
+// between writes, by size only.
+class SegmentedFileWriter : public IOWriter {
+ public:
+  SegmentedFileWriter(const std::string& path,
+                      const SegmentedWriter::Options& options);
+  virtual ~SegmentedFileWriter() = default;
+
+  // Disallows copy and assign.
+  SegmentedFileWriter(const SegmentedFileWriter&) = delete;
+  SegmentedFileWriter& operator=(const SegmentedFileWriter&) = delete;
+
+  // Opens the first segment.
+  bool Open();
+
+  // Writes bytes to the current segment, rotating first if due.
+  bool WriteBytes(size_t bytes_written, char* data);
+
+  // Closes the last segment.
+  void Close();
+
+ private:
+  // Writes bytes to the current segment.
+  bool Write(const char* data, size_t size);
+
+  SegmentedWriter segments_;
+  Mp4FragmentParser parser_;
+  // Decode time of the first fragment, and media time of the latest one
+  // (microseconds), -1 if none.
+  int64_t first_fragment_time_us_ = -1;
+  int64_t time_us_ = -1;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_SEGMENTED_FILE_WRITER_H_
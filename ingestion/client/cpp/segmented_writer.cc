@@ -0,0 +1,365 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/segmented_writer.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "client/cpp/time_index.h"
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+namespace {
+
+// Gets the directory of `path`, with a trailing slash, or "".
+std::string Dirname(const std::string& path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+}
+
+// Deletes a segment and its time index, if any.
+void RemoveSegment(const std::string& path) {
+  unlink(path.c_str());
+  unlink(TimeIndexPath(path).c_str());
+}
+
+// Lists the segments of `path` after the last one `manifest` lists, up to
+// `last_index`, that a previous run did not close: it was stopped before
+// listing them. Their media times are unknown. Returns whether any was
+// listed.
+bool ListUnclosedSegments(const std::string& path, int64_t last_index,
+                          SegmentManifest* manifest) {
+  int64_t index = 0;
+  if (!manifest->segments().empty()) {
+    index = manifest->segments().back().index + 1;
+  }
+  bool listed = false;
+  // Segments are numbered without gaps.
+  struct stat st;
+  for (; index <= last_index &&
+         stat(SegmentPath(path, index).c_str(), &st) == 0;
+       ++index) {
+    SegmentInfo segment;
+    segment.index = index;
+    segment.path = SegmentPath(path, index);
+    segment.size = st.st_size;
+    manifest->segments().push_back(segment);
+    listed = true;
+  }
+  return listed;
+}
+
+}  // namespace
+
+std::string SegmentPath(const std::string& path, int64_t index) {
+  size_t dot = path.rfind('.');
+  size_t slash = path.rfind('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    dot = path.size();
+  }
+  char number[32];
+  snprintf(number, sizeof(number), "-%06lld", static_cast<long long>(index));
+  return path.substr(0, dot) + number + path.substr(dot);
+}
+
+std::string SegmentManifestPath(const std::string& path) {
+  return path + ".manifest";
+}
+
+bool SegmentManifest::Load(const std::string& path) {
+  segments_.clear();
+  std::ifstream input(path);
+  if (!input.is_open()) {
+    return true;
+  }
+  const std::string dir = Dirname(path);
+  std::string line;
+  while (std::getline(input, line)) {
+    std::istringstream fields(line);
+    SegmentInfo segment;
+    std::string file_name;
+    fields >> segment.index >> segment.start_time_us >> segment.end_time_us >>
+        segment.size;
+    fields.ignore(1);
+    if (!fields || !std::getline(fields, file_name) || file_name.empty()) {
+      LOG(ERROR) << "Invalid segment manifest " << path << ": " << line;
+      return false;
+    }
+    segment.path = dir + file_name;
+    segments_.push_back(segment);
+  }
+  return true;
+}
+
+bool SegmentManifest::Save(const std::string& path) const {
+  // Writes a temporary file and renames it, so that readers never see a
+  // partially written manifest.
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream output(tmp_path);
+    for (const SegmentInfo& segment : segments_) {
+      size_t slash = segment.path.rfind('/');
+      output << segment.index << ' ' << segment.start_time_us << ' '
+             << segment.end_time_us << ' ' << segment.size << ' '
+             << segment.path.substr(slash == std::string::npos ? 0
+                                                              : slash + 1)
+             << '\n';
+    }
+    if (!output.good()) {
+      LOG(ERROR) << "Failed to write segment manifest " << tmp_path;
+      return false;
+    }
+  }
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG(ERROR) << "Failed to rename segment manifest " << tmp_path << " to "
+               << path;
+    return false;
+  }
+  return true;
+}
+
+std::vector<SegmentInfo> SegmentManifest::FindSegments(
+    int64_t start_time_us, int64_t end_time_us) const {
+  std::vector<SegmentInfo> segments;
+  for (const SegmentInfo& segment : segments_) {
+    if (segment.start_time_us < 0 || segment.end_time_us < 0 ||
+        (segment.end_time_us >= start_time_us &&
+         segment.start_time_us <= end_time_us)) {
+      segments.push_back(segment);
+    }
+  }
+  return segments;
+}
+
+SegmentedWriter::SegmentedWriter(const std::string& path,
+                                 const Options& options,
+                                 WriterFactory writer_factory)
+    : path_(path),
+      manifest_path_(SegmentManifestPath(path)),
+      options_(options),
+      writer_factory_(std::move(writer_factory)) {}
+
+SegmentedWriter::~SegmentedWriter() { Close(); }
+
+bool SegmentedWriter::Open() {
+  CHECK(thread_ == nullptr) << path_ << " is already open";
+  if (!manifest_.Load(manifest_path_)) {
+    return false;
+  }
+  // Keeps the segments that a previous run did not close, listed so that
+  // retention deletes them in turn.
+  if (ListUnclosedSegments(path_, std::numeric_limits<int64_t>::max(),
+                           &manifest_) &&
+      !manifest_.Save(manifest_path_)) {
+    return false;
+  }
+  int64_t index = 0;
+  if (!manifest_.segments().empty()) {
+    index = manifest_.segments().back().index + 1;
+  }
+  current_ = OpenSegment(index);
+  if (current_ == nullptr) {
+    return false;
+  }
+  current_info_ = SegmentInfo();
+  current_info_.index = index;
+  current_info_.path = SegmentPath(path_, index);
+  next_index_ = index + 1;
+  next_failed_ = false;
+  closing_ = false;
+  thread_.reset(new std::thread(&SegmentedWriter::BackgroundLoop, this));
+  return true;
+}
+
+bool SegmentedWriter::RollBack(int64_t index, int64_t size,
+                               const Truncator& truncate) {
+  CHECK(thread_ == nullptr) << path_ << " is already open";
+  SegmentManifest manifest;
+  if (!manifest.Load(manifest_path_)) {
+    return false;
+  }
+  std::deque<SegmentInfo>& segments = manifest.segments();
+  while (!segments.empty() && segments.back().index > index) {
+    segments.pop_back();
+  }
+  // The checkpoint is usually in the segment the previous run was writing,
+  // which it did not list.
+  ListUnclosedSegments(path_, index, &manifest);
+  if (!segments.empty() && segments.back().index == index) {
+    // The end time is kept as an upper bound.
+    segments.back().size = size;
+  }
+  if (!manifest.Save(manifest_path_)) {
+    return false;
+  }
+  // Deleted once unlisted. Segments are numbered without gaps.
+  for (int64_t i = index + 1; access(SegmentPath(path_, i).c_str(), F_OK) == 0;
+       ++i) {
+    RemoveSegment(SegmentPath(path_, i));
+  }
+  const std::string path = SegmentPath(path_, index);
+  if (access(path.c_str(), F_OK) != 0) {
+    return true;
+  }
+  return truncate(path, size);
+}
+
+bool SegmentedWriter::ShouldRotate(int64_t time_us) const {
+  if (current_info_.size == 0) {
+    return false;
+  }
+  if (options_.max_segment_bytes > 0 &&
+      current_info_.size >= options_.max_segment_bytes) {
+    return true;
+  }
+  return options_.max_segment_duration_us > 0 && time_us >= 0 &&
+         current_info_.start_time_us >= 0 &&
+         time_us - current_info_.start_time_us >=
+             options_.max_segment_duration_us;
+}
+
+bool SegmentedWriter::Rotate() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // The next segment is normally open already.
+  opened_cv_.wait(lock, [this] { return next_ != nullptr || next_failed_; });
+  if (next_ == nullptr) {
+    // Retries on the next rotation.
+    next_failed_ = false;
+    work_cv_.notify_one();
+    return false;
+  }
+  retired_.emplace_back(std::move(current_), current_info_);
+  current_ = std::move(next_);
+  current_info_ = SegmentInfo();
+  current_info_.index = next_index_;
+  current_info_.path = SegmentPath(path_, next_index_);
+  ++next_index_;
+  work_cv_.notify_one();
+  return true;
+}
+
+void SegmentedWriter::Written(int64_t size, int64_t time_us) {
+  current_info_.size += size;
+  if (time_us >= 0) {
+    if (current_info_.start_time_us < 0) {
+      current_info_.start_time_us = time_us;
+    }
+    current_info_.end_time_us = std::max(current_info_.end_time_us, time_us);
+  }
+}
+
+void SegmentedWriter::Close() {
+  if (thread_ == nullptr) {
+    return;
+  }
+  std::unique_ptr<IOWriter> empty;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (current_info_.size > 0) {
+      retired_.emplace_back(std::move(current_), current_info_);
+    } else {
+      empty = std::move(current_);
+    }
+    closing_ = true;
+    work_cv_.notify_one();
+  }
+  thread_->join();
+  thread_.reset();
+  if (empty != nullptr) {
+    empty->Close();
+    RemoveSegment(current_info_.path);
+  }
+}
+
+std::unique_ptr<IOWriter> SegmentedWriter::OpenSegment(int64_t index) {
+  const std::string path = SegmentPath(path_, index);
+  std::unique_ptr<IOWriter> writer = writer_factory_(path);
+  if (!writer->Open()) {
+    LOG(ERROR) << "Failed to open segment " << path;
+    return nullptr;
+  }
+  return writer;
+}
+
+void SegmentedWriter::RetireSegment(std::unique_ptr<IOWriter> writer,
+                                    const SegmentInfo& info) {
+  writer->Close();
+  manifest_.segments().push_back(info);
+  std::vector<std::string> expired;
+  while (options_.max_segments > 0 &&
+         manifest_.segments().size() >
+             static_cast<size_t>(options_.max_segments)) {
+    expired.push_back(manifest_.segments().front().path);
+    manifest_.segments().pop_front();
+  }
+  manifest_.Save(manifest_path_);
+  // Deleted once unlisted. Readers that have them open can still read them.
+  for (const std::string& path : expired) {
+    RemoveSegment(path);
+  }
+}
+
+void SegmentedWriter::BackgroundLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    work_cv_.wait(lock, [this] {
+      return closing_ || (next_ == nullptr && !next_failed_) ||
+             !retired_.empty();
+    });
+    // Opening the next segment comes first, as rotation may be waiting.
+    if (!closing_ && next_ == nullptr && !next_failed_) {
+      int64_t index = next_index_;
+      lock.unlock();
+      std::unique_ptr<IOWriter> next = OpenSegment(index);
+      lock.lock();
+      next_ = std::move(next);
+      next_failed_ = (next_ == nullptr);
+      opened_cv_.notify_all();
+    } else if (!retired_.empty()) {
+      std::unique_ptr<IOWriter> writer = std::move(retired_.front().first);
+      SegmentInfo info = retired_.front().second;
+      retired_.pop_front();
+      lock.unlock();
+      RetireSegment(std::move(writer), info);
+      lock.lock();
+    } else if (closing_) {
+      break;
+    }
+  }
+  // Deletes the next segment, opened but unused.
+  if (next_ != nullptr) {
+    next_->Close();
+    next_.reset();
+    RemoveSegment(SegmentPath(path_, next_index_));
+  }
+}
+
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,194 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_SEGMENTED_WRITER_H_
+#define API_VIDEO_CLIENT_CPP_SEGMENTED_WRITER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "client/cpp/io_writer.h"
+
+namespace api {
+namespace video {
+
+// A closed segment of a segmented file.
+struct SegmentInfo {
+  // Sequence number of the segment.
+  int64_t index = 0;
+  // Segment file path.
+  std::string path;
+  // Media time range of the segment (microseconds), -1 if unknown.
+  int64_t start_time_us = -1;
+  int64_t end_time_us = -1;
+  // Size in bytes.
+  int64_t size = 0;
+};
+
+// Gets the path of segment `index` of `path`: "dir/video-000012.mp4" for
+// "dir/video.mp4".
+std::string SegmentPath(const std::string& path, int64_t index);
+
+// Gets the path of the manifest of `path`.
+std::string SegmentManifestPath(const std::string& path);
+
+// Lists the closed segments of a segmented file, oldest first. It is a text
+// file next to the segments, with a "<index> <start_time_us> <end_time_us>
+// <size> <file name>" line per segment. It is replaced atomically and only
+// lists closed segments, so readers can open any segment it lists.
+class SegmentManifest {
+ public:
+  // Loads the manifest at `path`. A missing manifest is empty.
+  bool Load(const std::string& path);
+
+  // Saves the manifest to `path`.
+  bool Save(const std::string& path) const;
+
+  // Finds the segments that may have media times in [start_time_us,
+  // end_time_us], including those with unknown times.
+  std::vector<SegmentInfo> FindSegments(int64_t start_time_us,
+                                        int64_t end_time_us) const;
+
+  std::deque<SegmentInfo>& segments() { return segments_; }
+  const std::deque<SegmentInfo>& segments() const { return segments_; }
+
+ private:
+  std::deque<SegmentInfo> segments_;
+};
+
+// Writes a long-running output as numbered segments, rotated by size or
+// media duration, with a manifest (see SegmentManifest). Segments are
+// written by IOWriters from a factory, e.g. FileWriter or ProtoWriter.
+//
+// Rotation never waits for file system calls: a background thread opens
+// the next segment ahead of time, and closes, lists and deletes old
+// segments. Writes come from a single thread.
+class SegmentedWriter {
+ public:
+  struct Options {
+    // If positive, a segment is closed once it has this many bytes.
+    int64_t max_segment_bytes = 0;
+    // If positive, a segment is closed once it spans this much media time
+    // (microseconds).
+    int64_t max_segment_duration_us = 0;
+    // If positive, only this many closed segments are kept, and older ones
+    // are deleted.
+    int max_segments = 0;
+  };
+
+  // Makes the writer of a segment at `path`, not yet open.
+  using WriterFactory =
+      std::function<std::unique_ptr<IOWriter>(const std::string& path)>;
+
+  // Truncates the segment at `path` to `size` bytes.
+  using Truncator =
+      std::function<bool(const std::string& path, int64_t size)>;
+
+  SegmentedWriter(const std::string& path, const Options& options,
+                  WriterFactory writer_factory);
+  ~SegmentedWriter();
+
+  // Disallows copy and assign.
+  SegmentedWriter(const SegmentedWriter&) = delete;
+  SegmentedWriter& operator=(const SegmentedWriter&) = delete;
+
+  // Opens the first segment. Numbering continues after the segments of a
+  // previous run, which are kept: those it did not close are listed, with
+  // unknown media times.
+  bool Open();
+
+  // Rolls the segments of a previous run back to the first `size` bytes of
+  // segment `index`, e.g. to resume from a checkpoint: later segments are
+  // unlisted and deleted, including one that the previous run did not
+  // close, and `truncate` cuts segment `index` if it still exists, listing
+  // it if the previous run did not. Must be called before Open(), which
+  // then starts a new segment.
+  bool RollBack(int64_t index, int64_t size, const Truncator& truncate);
+
+  // Whether the current segment is due to be closed before writing data
+  // at media time `time_us`, -1 if unknown. An empty segment never is.
+  bool ShouldRotate(int64_t time_us) const;
+
+  // Closes the current segment and switches to the next one. On failure,
+  // writes continue to the current segment.
+  bool Rotate();
+
+  // Gets the writer of the current segment.
+  IOWriter* writer() const { return current_.get(); }
+
+  // Gets the path and the index of the current segment.
+  const std::string& segment_path() const { return current_info_.path; }
+  int64_t segment_index() const { return current_info_.index; }
+
+  // Records `size` bytes written to the current segment, at media times up
+  // to `time_us`, -1 if unknown.
+  void Written(int64_t size, int64_t time_us);
+
+  // Closes the current segment and waits for all segments to be listed.
+  void Close();
+
+ private:
+  // Makes and opens the writer of segment `index`. Returns null on error.
+  std::unique_ptr<IOWriter> OpenSegment(int64_t index);
+
+  // Closes a segment, lists it and deletes segments past retention.
+  void RetireSegment(std::unique_ptr<IOWriter> writer,
+                     const SegmentInfo& info);
+
+  // Background thread loop.
+  void BackgroundLoop();
+
+  std::string path_;
+  std::string manifest_path_;
+  Options options_;
+  WriterFactory writer_factory_;
+  // Current segment. Used by the writing thread.
+  std::unique_ptr<IOWriter> current_;
+  SegmentInfo current_info_;
+  // Closed segments. Used by the background thread once open.
+  SegmentManifest manifest_;
+
+  std::mutex mutex_;
+  // Signals the background thread that there is work.
+  std::condition_variable work_cv_;
+  // Signals that the next segment is open, or failed to open.
+  std::condition_variable opened_cv_;
+  // Next segment, opened ahead of time.
+  std::unique_ptr<IOWriter> next_;
+  int64_t next_index_ = 0;
+  bool next_failed_ = false;
+  // Segments to close.
+  std::deque<std::pair<std::unique_ptr<IOWriter>, SegmentInfo>> retired_;
+  bool closing_ = false;
+  std::unique_ptr<std::thread> thread_;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_SEGMENTED_WRITER_H_
@@ -0,0 +1,254 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/segmented_writer.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "client/cpp/file_writer.h"
+#include "client/cpp/segmented_file_writer.h"
+#include "gtest/gtest.h"
+
+namespace api {
+namespace video {
+namespace {
+
+std::unique_ptr<IOWriter> MakeFileWriter(const std::string& path) {
+  return std::unique_ptr<IOWriter>(new FileWriter(path));
+}
+
+int64_t FileSize(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+// Writes `size` bytes at media time `time_us`, rotating first if due.
+void Write(SegmentedWriter* writer, size_t size, int64_t time_us) {
+  if (writer->ShouldRotate(time_us)) {
+    ASSERT_TRUE(writer->Rotate());
+  }
+  std::string data(size, 'x');
+  ASSERT_TRUE(writer->writer()->WriteBytes(size, &data[0]));
+  writer->Written(size, time_us);
+}
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream input(path, std::ifstream::binary);
+  std::stringstream data;
+  data << input.rdbuf();
+  return data.str();
+}
+
+std::string U32(uint32_t v) {
+  std::string s(4, 0);
+  for (int i = 0; i < 4; ++i) {
+    s[i] = static_cast<char>((v >> (24 - 8 * i)) & 255);
+  }
+  return s;
+}
+
+std::string Box(const std::string& type, const std::string& body) {
+  return U32(8 + body.size()) + type + body;
+}
+
+// Builds a fragment of video track 1: a 'moof' box with a version 1 'tfdt',
+// and an 'mdat' box.
+std::string Fragment(uint64_t decode_time) {
+  std::string tfdt = U32(0x01000000) + U32(decode_time >> 32) +
+                     U32(decode_time & 0xffffffff);
+  return Box("moof", Box("traf", Box("tfhd", U32(0) + U32(1)) +
+                                     Box("tfdt", tfdt))) +
+         Box("mdat", std::string(1000, 'x'));
+}
+
+TEST(SegmentedWriterTest, SegmentPath) {
+  EXPECT_EQ("/a/video-000012.mp4", SegmentPath("/a/video.mp4", 12));
+  EXPECT_EQ("/a.b/video-000000", SegmentPath("/a.b/video", 0));
+  EXPECT_EQ("/a/video.mp4.manifest", SegmentManifestPath("/a/video.mp4"));
+}
+
+// Tests rotation by size, and that numbering continues in the next run.
+TEST(SegmentedWriterTest, RotatesBySize) {
+  const std::string path =
+      std::string(getenv("TEST_TMPDIR")) + "/by_size.bin";
+  SegmentedWriter::Options options;
+  options.max_segment_bytes = 250;
+  SegmentedWriter writer(path, options, MakeFileWriter);
+  ASSERT_TRUE(writer.Open());
+  for (int i = 0; i < 10; ++i) {
+    Write(&writer, 100, -1);
+  }
+  writer.Close();
+
+  SegmentManifest manifest;
+  ASSERT_TRUE(manifest.Load(SegmentManifestPath(path)));
+  ASSERT_EQ(4, manifest.segments().size());
+  for (int i = 0; i < 4; ++i) {
+    const SegmentInfo& segment = manifest.segments()[i];
+    EXPECT_EQ(i, segment.index);
+    EXPECT_EQ(SegmentPath(path, i), segment.path);
+    EXPECT_EQ(i < 3 ? 300 : 100, segment.size);
+    EXPECT_EQ(segment.size, FileSize(segment.path));
+    EXPECT_EQ(-1, segment.start_time_us);
+  }
+  // The segment opened ahead of time is deleted.
+  EXPECT_EQ(-1, FileSize(SegmentPath(path, 4)));
+
+  SegmentedWriter next_run(path, options, MakeFileWriter);
+  ASSERT_TRUE(next_run.Open());
+  Write(&next_run, 10, -1);
+  next_run.Close();
+  ASSERT_TRUE(manifest.Load(SegmentManifestPath(path)));
+  ASSERT_EQ(5, manifest.segments().size());
+  EXPECT_EQ(4, manifest.segments().back().index);
+  EXPECT_EQ(10, FileSize(SegmentPath(path, 4)));
+}
+
+// Tests that a segment left unlisted by a crash is listed by the next run,
+// rather than orphaned.
+TEST(SegmentedWriterTest, ListsUnclosedSegments) {
+  const std::string path =
+      std::string(getenv("TEST_TMPDIR")) + "/unclosed.bin";
+  SegmentedWriter::Options options;
+  options.max_segment_bytes = 250;
+  SegmentedWriter writer(path, options, MakeFileWriter);
+  ASSERT_TRUE(writer.Open());
+  for (int i = 0; i < 5; ++i) {
+    Write(&writer, 100, -1);
+  }
+  writer.Close();
+  // Segment 1 was being written when the run stopped.
+  SegmentManifest manifest;
+  ASSERT_TRUE(manifest.Load(SegmentManifestPath(path)));
+  ASSERT_EQ(2, manifest.segments().size());
+  manifest.segments().pop_back();
+  ASSERT_TRUE(manifest.Save(SegmentManifestPath(path)));
+
+  SegmentedWriter next_run(path, options, MakeFileWriter);
+  ASSERT_TRUE(next_run.Open());
+  EXPECT_EQ(2, next_run.segment_index());
+  Write(&next_run, 10, -1);
+  next_run.Close();
+  ASSERT_TRUE(manifest.Load(SegmentManifestPath(path)));
+  ASSERT_EQ(3, manifest.segments().size());
+  const SegmentInfo& unclosed = manifest.segments()[1];
+  EXPECT_EQ(1, unclosed.index);
+  EXPECT_EQ(SegmentPath(path, 1), unclosed.path);
+  EXPECT_EQ(200, unclosed.size);
+  EXPECT_EQ(-1, unclosed.start_time_us);
+  EXPECT_EQ(2, manifest.segments()[2].index);
+}
+
+// Tests rotation by media time, retention and finding segments by time.
+TEST(SegmentedWriterTest, RotatesByTimeWithRetention) {
+  const std::string path =
+      std::string(getenv("TEST_TMPDIR")) + "/by_time.bin";
+  SegmentedWriter::Options options;
+  options.max_segment_duration_us = 1000000;
+  options.max_segments = 3;
+  SegmentedWriter writer(path, options, MakeFileWriter);
+  ASSERT_TRUE(writer.Open());
+  // A write every 100 ms for 10 s: 10 segments of 1 s.
+  for (int i = 0; i < 100; ++i) {
+    Write(&writer, 10, i * 100000);
+  }
+  writer.Close();
+
+  SegmentManifest manifest;
+  ASSERT_TRUE(manifest.Load(SegmentManifestPath(path)));
+  ASSERT_EQ(3, manifest.segments().size());
+  for (int i = 0; i < 3; ++i) {
+    const SegmentInfo& segment = manifest.segments()[i];
+    EXPECT_EQ(7 + i, segment.index);
+    EXPECT_EQ((7 + i) * 1000000, segment.start_time_us);
+    EXPECT_EQ((7 + i) * 1000000 + 900000, segment.end_time_us);
+    EXPECT_EQ(100, FileSize(segment.path));
+  }
+  for (int i = 0; i < 7; ++i) {
+    EXPECT_EQ(-1, FileSize(SegmentPath(path, i)));
+  }
+
+  auto segments = manifest.FindSegments(8500000, 8600000);
+  ASSERT_EQ(1, segments.size());
+  EXPECT_EQ(8, segments[0].index);
+  EXPECT_EQ(2, manifest.FindSegments(7900000, 8000000).size());
+  EXPECT_EQ(0, manifest.FindSegments(0, 6000000).size());
+}
+
+// Tests that a fragmented MP4 stream is cut at fragments, with the init
+// segment at the start of each segment.
+TEST(SegmentedWriterTest, CutsMp4AtFragments) {
+  const std::string path = std::string(getenv("TEST_TMPDIR")) + "/video.mp4";
+  // 'tkhd' and 'mdhd' version 0: track id / timescale at byte 12.
+  std::string tkhd = U32(0) + U32(0) + U32(0) + U32(1) + std::string(8, 0);
+  std::string mdhd = U32(0) + U32(0) + U32(0) + U32(90000) + std::string(8, 0);
+  std::string hdlr = U32(0) + U32(0) + "vide" + std::string(12, 0);
+  std::string init =
+      Box("ftyp", "isom" + U32(0)) +
+      Box("moov", Box("trak", Box("tkhd", tkhd) +
+                                  Box("mdia", Box("mdhd", mdhd) +
+                                                  Box("hdlr", hdlr))));
+  // A fragment per second, from 10 s.
+  std::string stream = init;
+  for (int i = 0; i < 6; ++i) {
+    stream += Fragment((10 + i) * 90000);
+  }
+
+  SegmentedWriter::Options options;
+  options.max_segment_duration_us = 2000000;
+  SegmentedFileWriter writer(path, options);
+  ASSERT_TRUE(writer.Open());
+  // Small writes, so that fragments start in one write and end in another.
+  for (size_t pos = 0; pos < stream.size(); pos += 700) {
+    std::string data = stream.substr(pos, 700);
+    ASSERT_TRUE(writer.WriteBytes(data.size(), &data[0]));
+  }
+  writer.Close();
+
+  SegmentManifest manifest;
+  ASSERT_TRUE(manifest.Load(SegmentManifestPath(path)));
+  ASSERT_EQ(3, manifest.segments().size());
+  std::string fragments;
+  for (int i = 0; i < 3; ++i) {
+    const SegmentInfo& segment = manifest.segments()[i];
+    EXPECT_EQ(i * 2000000, segment.start_time_us);
+    EXPECT_EQ(i * 2000000 + 1000000, segment.end_time_us);
+    std::string data = ReadFile(segment.path);
+    EXPECT_EQ(segment.size, data.size());
+    ASSERT_EQ(init, data.substr(0, init.size()));
+    fragments += data.substr(init.size());
+  }
+  EXPECT_EQ(stream.substr(init.size()), fragments);
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,168 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/shard_merger.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+#include <utility>
+
+namespace api {
+namespace video {
+
+namespace {
+
+using ::google::cloud::videointelligence::v1p3beta1::NormalizedBoundingBox;
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingVideoAnnotationResults;
+using ::google::protobuf::Duration;
+
+// Shot and track ends this close to a shard boundary are taken as cut by it:
+// 1 second.
+constexpr int64_t kBoundaryToleranceUs = 1000000;
+// Minimum overlap of boxes across a boundary to continue a track.
+constexpr float kMinTrackIoU = 0.5;
+
+int64_t DurationToMicros(const Duration& duration) {
+  return duration.seconds() * 1000000 + duration.nanos() / 1000;
+}
+
+float IoU(const NormalizedBoundingBox& a, const NormalizedBoundingBox& b) {
+  float width = std::min(a.right(), b.right()) - std::max(a.left(), b.left());
+  float height = std::min(a.bottom(), b.bottom()) - std::max(a.top(), b.top());
+  if (width <= 0 || height <= 0) {
+    return 0;
+  }
+  float intersection = width * height;
+  float area_a = (a.right() - a.left()) * (a.bottom() - a.top());
+  float area_b = (b.right() - b.left()) * (b.bottom() - b.top());
+  return intersection / (area_a + area_b - intersection);
+}
+
+}  // namespace
+
+void ShardMerger::AddShard(
+    int64_t start_time_us,
+    std::vector<StreamingVideoAnnotationResults> results) {
+  size_t start = results_.size();
+  for (auto& result : results) {
+    results_.push_back(std::move(result));
+  }
+  if (start > 0) {
+    JoinShots(start, start_time_us);
+  }
+  JoinTracks(start, start_time_us);
+}
+
+std::vector<StreamingVideoAnnotationResults> ShardMerger::TakeResults() {
+  std::vector<StreamingVideoAnnotationResults> results;
+  for (auto& result : results_) {
+    if (result.ByteSizeLong() > 0) {
+      results.push_back(std::move(result));
+    }
+  }
+  results_.clear();
+  return results;
+}
+
+void ShardMerger::JoinShots(size_t start, int64_t start_time_us) {
+  // Finds the last shot before the boundary and the first one after it.
+  google::cloud::videointelligence::v1p3beta1::VideoSegment* last = nullptr;
+  for (size_t i = start; i > 0 && last == nullptr; --i) {
+    auto* shots = results_[i - 1].mutable_shot_annotations();
+    if (!shots->empty()) {
+      last = &(*shots)[shots->size() - 1];
+    }
+  }
+  for (size_t i = start; i < results_.size() && last != nullptr; ++i) {
+    auto* shots = results_[i].mutable_shot_annotations();
+    if (shots->empty()) {
+      continue;
+    }
+    const auto& first = (*shots)[0];
+    if (std::abs(DurationToMicros(last->end_time_offset()) - start_time_us) <=
+            kBoundaryToleranceUs &&
+        std::abs(DurationToMicros(first.start_time_offset()) - start_time_us) <=
+            kBoundaryToleranceUs) {
+      *last->mutable_end_time_offset() = first.end_time_offset();
+      shots->erase(shots->begin());
+    }
+    return;
+  }
+}
+
+void ShardMerger::JoinTracks(size_t start, int64_t start_time_us) {
+  std::map<int64_t, int64_t> track_ids;
+  std::set<int64_t> continued;
+  std::map<int64_t, TrackEnd> track_ends;
+  for (size_t i = start; i < results_.size(); ++i) {
+    for (auto& object : *results_[i].mutable_object_annotations()) {
+      if (object.track_info_case() !=
+              google::cloud::videointelligence::v1p3beta1::
+                  ObjectTrackingAnnotation::kTrackId ||
+          object.frames().empty()) {
+        continue;
+      }
+      auto it = track_ids.find(object.track_id());
+      if (it == track_ids.end()) {
+        // A new track in this shard continues a track of the previous shard
+        // if it starts at the boundary where that one ended, on the same
+        // entity and at about the same place.
+        int64_t track_id = -1;
+        const auto& frame = object.frames(0);
+        if (DurationToMicros(frame.time_offset()) - start_time_us <=
+            kBoundaryToleranceUs) {
+          float best_iou = kMinTrackIoU;
+          for (const auto& end : track_ends_) {
+            if (continued.count(end.first) == 0 &&
+                start_time_us - end.second.time_us <= kBoundaryToleranceUs &&
+                end.second.entity.entity_id() == object.entity().entity_id() &&
+                end.second.entity.description() ==
+                    object.entity().description()) {
+              float iou = IoU(end.second.box, frame.normalized_bounding_box());
+              if (iou >= best_iou) {
+                best_iou = iou;
+                track_id = end.first;
+              }
+            }
+          }
+        }
+        if (track_id >= 0) {
+          continued.insert(track_id);
+        } else {
+          track_id = next_track_id_++;
+        }
+        it = track_ids.emplace(object.track_id(), track_id).first;
+      }
+      object.set_track_id(it->second);
+
+      const auto& frame = object.frames(object.frames_size() - 1);
+      TrackEnd& end = track_ends[it->second];
+      end.time_us = DurationToMicros(frame.time_offset());
+      end.entity = object.entity();
+      end.box = frame.normalized_bounding_box();
+    }
+  }
+  track_ends_.swap(track_ends);
+}
+
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,87 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_SHARD_MERGER_H_
+#define API_VIDEO_CLIENT_CPP_SHARD_MERGER_H_
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "proto/video_intelligence_streaming.pb.h"
+
+namespace api {
+namespace video {
+
+// Merges annotation results of consecutive shards of one video, annotated
+// over separate streaming sessions, into a single time-ordered sequence.
+// A shot cut by a shard boundary is joined back into one shot, and object
+// tracks are renumbered so that ids are unique across shards, with a track
+// that continues across a boundary keeping its id.
+class ShardMerger {
+ public:
+  ShardMerger() = default;
+  ~ShardMerger() = default;
+
+  // Disallows copy and assign.
+  ShardMerger(const ShardMerger&) = delete;
+  ShardMerger& operator=(const ShardMerger&) = delete;
+
+  // Appends the results of the next shard, which starts at `start_time_us`.
+  // Time offsets in `results` must already be on the video timeline.
+  void AddShard(int64_t start_time_us,
+                std::vector<google::cloud::videointelligence::v1p3beta1::
+                                StreamingVideoAnnotationResults>
+                    results);
+
+  // Gets the merged results. Results emptied by a join are left out.
+  std::vector<google::cloud::videointelligence::v1p3beta1::
+                  StreamingVideoAnnotationResults>
+  TakeResults();
+
+ private:
+  // Last frame of a track, as candidate for continuing in the next shard.
+  struct TrackEnd {
+    int64_t time_us;
+    google::cloud::videointelligence::v1p3beta1::Entity entity;
+    google::cloud::videointelligence::v1p3beta1::NormalizedBoundingBox box;
+  };
+
+  // Joins the first shot of the shard starting at `start` into the last
+  // merged shot.
+  void JoinShots(size_t start, int64_t start_time_us);
+
+  // Renumbers the tracks of the shard starting at `start`.
+  void JoinTracks(size_t start, int64_t start_time_us);
+
+  // Merged results.
+  std::vector<google::cloud::videointelligence::v1p3beta1::
+                  StreamingVideoAnnotationResults>
+      results_;
+  // Next unused merged track id.
+  int64_t next_track_id_ = 0;
+  // Ends of the tracks of the last shard, by merged track id.
+  std::map<int64_t, TrackEnd> track_ends_;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_SHARD_MERGER_H_
@@ -0,0 +1,98 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/shard_merger.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace api {
+namespace video {
+namespace {
+
+using ::google::cloud::videointelligence::v1p3beta1::
+    StreamingVideoAnnotationResults;
+
+void SetSeconds(int64_t seconds, google::protobuf::Duration* duration) {
+  duration->set_seconds(seconds);
+}
+
+StreamingVideoAnnotationResults Shot(int64_t start, int64_t end) {
+  StreamingVideoAnnotationResults results;
+  auto* shot = results.add_shot_annotations();
+  SetSeconds(start, shot->mutable_start_time_offset());
+  SetSeconds(end, shot->mutable_end_time_offset());
+  return results;
+}
+
+StreamingVideoAnnotationResults Object(int64_t track_id, int64_t time,
+                                       const std::string& entity, float left) {
+  StreamingVideoAnnotationResults results;
+  auto* object = results.add_object_annotations();
+  object->set_track_id(track_id);
+  object->mutable_entity()->set_description(entity);
+  auto* frame = object->add_frames();
+  SetSeconds(time, frame->mutable_time_offset());
+  auto* box = frame->mutable_normalized_bounding_box();
+  box->set_left(left);
+  box->set_top(0.2);
+  box->set_right(left + 0.2);
+  box->set_bottom(0.4);
+  return results;
+}
+
+TEST(ShardMergerTest, JoinsShotCutByBoundary) {
+  ShardMerger merger;
+  merger.AddShard(0, {Shot(0, 4), Shot(4, 10)});
+  merger.AddShard(10000000, {Shot(10, 12), Shot(12, 20)});
+  std::vector<StreamingVideoAnnotationResults> results = merger.TakeResults();
+  ASSERT_EQ(3, results.size());
+  EXPECT_EQ(0, results[0].shot_annotations(0).start_time_offset().seconds());
+  EXPECT_EQ(4, results[1].shot_annotations(0).start_time_offset().seconds());
+  EXPECT_EQ(12, results[1].shot_annotations(0).end_time_offset().seconds());
+  EXPECT_EQ(12, results[2].shot_annotations(0).start_time_offset().seconds());
+}
+
+TEST(ShardMergerTest, RenumbersAndContinuesTracks) {
+  ShardMerger merger;
+  merger.AddShard(0, {Object(0, 9, "car", 0.1), Object(1, 10, "dog", 0.5)});
+  // Track 0 continues the car, track 1 is a new car elsewhere and track 2 is
+  // a new dog.
+  merger.AddShard(10000000,
+                  {Object(0, 10, "car", 0.12), Object(1, 10, "car", 0.7),
+                   Object(2, 10, "dog", 0.1)});
+  std::vector<StreamingVideoAnnotationResults> results = merger.TakeResults();
+  ASSERT_EQ(5, results.size());
+  EXPECT_EQ(0, results[0].object_annotations(0).track_id());
+  EXPECT_EQ(1, results[1].object_annotations(0).track_id());
+  EXPECT_EQ(0, results[2].object_annotations(0).track_id());
+  EXPECT_EQ(2, results[3].object_annotations(0).track_id());
+  EXPECT_EQ(3, results[4].object_annotations(0).track_id());
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,263 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/spill_queue.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+namespace {
+
+// Size of the record length prefix: uint32_t.
+constexpr size_t kRecordHeaderSize = 4;
+
+// Reads exactly `size` bytes at `offset`. Returns false on error or EOF.
+bool PreadFully(int fd, char* data, size_t size, size_t offset) {
+  while (size > 0) {
+    ssize_t bytes_read = pread(fd, data, size, offset);
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read <= 0) {
+      return false;
+    }
+    data += bytes_read;
+    size -= bytes_read;
+    offset += bytes_read;
+  }
+  return true;
+}
+
+}  // namespace
+
+SpillQueue::SpillQueue(const std::string& spill_dir, size_t max_memory_chunks,
+                       size_t segment_bytes)
+    : spill_dir_(spill_dir),
+      max_memory_chunks_(max_memory_chunks),
+      segment_bytes_(segment_bytes) {}
+
+SpillQueue::~SpillQueue() {
+  for (auto& segment : segments_) {
+    RemoveSegment(segment.get());
+  }
+}
+
+bool SpillQueue::Open() {
+  if (mkdir(spill_dir_.c_str(), 0755) != 0 && errno != EEXIST) {
+    LOG(ERROR) << "Failed to create spill directory " << spill_dir_ << ": "
+               << strerror(errno);
+    return false;
+  }
+  if (access(spill_dir_.c_str(), W_OK) != 0) {
+    LOG(ERROR) << "Spill directory " << spill_dir_ << " is not writable.";
+    return false;
+  }
+  return true;
+}
+
+bool SpillQueue::Push(std::string data) {
+  std::lock_guard<std::mutex> lock(m_);
+  if (closed_ || failed_) {
+    return false;
+  }
+  // Once anything is on disk, later chunks must follow it to keep order.
+  if (spilled_chunks_ == 0 && memory_queue_.size() < max_memory_chunks_) {
+    memory_queue_.push_back(std::move(data));
+  } else {
+    if (!SpillLocked(data)) {
+      failed_ = true;
+      cond_var_element_pushed_.notify_all();
+      return false;
+    }
+    if (spilled_chunks_ == 1) {
+      LOG(WARNING) << "Uplink is falling behind, spilling video chunks to "
+                   << spill_dir_;
+    }
+  }
+  cond_var_element_pushed_.notify_one();
+  return true;
+}
+
+bool SpillQueue::Pop(std::string* data) {
+  CHECK(data != nullptr);
+  Segment* segment = nullptr;
+  size_t offset = 0;
+  {
+    std::unique_lock<std::mutex> lock(m_);
+    cond_var_element_pushed_.wait(lock, [this] {
+      return !memory_queue_.empty() || spilled_chunks_ > 0 || closed_ ||
+             failed_;
+    });
+    if (failed_) {
+      return false;
+    }
+    if (!memory_queue_.empty()) {
+      *data = std::move(memory_queue_.front());
+      memory_queue_.pop_front();
+      return true;
+    }
+    if (spilled_chunks_ == 0) {
+      return false;
+    }
+    segment = segments_.front().get();
+    offset = segment->read_offset;
+  }
+
+  // Records before `write_offset` are complete and never rewritten, so the
+  // disk read happens without blocking the producer.
+  char header[kRecordHeaderSize];
+  if (!PreadFully(segment->fd, header, kRecordHeaderSize, offset)) {
+    LOG(ERROR) << "Failed to read spill segment " << segment->path;
+    std::lock_guard<std::mutex> lock(m_);
+    failed_ = true;
+    return false;
+  }
+  size_t bytes_read = static_cast<uint8_t>(header[0]) |
+                      (static_cast<uint8_t>(header[1]) << 8) |
+                      (static_cast<uint8_t>(header[2]) << 16) |
+                      (static_cast<uint32_t>(static_cast<uint8_t>(header[3]))
+                       << 24);
+  data->resize(bytes_read);
+  if (bytes_read > 0 && !PreadFully(segment->fd, &(*data)[0], bytes_read,
+                                    offset + kRecordHeaderSize)) {
+    LOG(ERROR) << "Failed to read spill segment " << segment->path;
+    std::lock_guard<std::mutex> lock(m_);
+    failed_ = true;
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(m_);
+  segment->read_offset = offset + kRecordHeaderSize + bytes_read;
+  --spilled_chunks_;
+  if (segment->read_offset == segment->write_offset) {
+    if (segments_.size() > 1) {
+      RemoveSegment(segment);
+      segments_.pop_front();
+    } else {
+      // Reuses the preallocated tail segment from the beginning.
+      segment->read_offset = 0;
+      segment->write_offset = 0;
+    }
+  }
+  if (spilled_chunks_ == 0) {
+    LOG(INFO) << "Uplink has caught up, spilled video chunks are drained.";
+  }
+  return true;
+}
+
+void SpillQueue::Close() {
+  std::lock_guard<std::mutex> lock(m_);
+  closed_ = true;
+  cond_var_element_pushed_.notify_all();
+}
+
+size_t SpillQueue::Size() {
+  std::lock_guard<std::mutex> lock(m_);
+  return memory_queue_.size() + spilled_chunks_;
+}
+
+size_t SpillQueue::SpilledSize() {
+  std::lock_guard<std::mutex> lock(m_);
+  return spilled_chunks_;
+}
+
+bool SpillQueue::failed() {
+  std::lock_guard<std::mutex> lock(m_);
+  return failed_;
+}
+
+bool SpillQueue::SpillLocked(const std::string& data) {
+  size_t record_bytes = kRecordHeaderSize + data.size();
+  if (segments_.empty() ||
+      (segments_.back()->write_offset > 0 &&
+       segments_.back()->write_offset + record_bytes > segment_bytes_)) {
+    if (!AddSegmentLocked()) {
+      return false;
+    }
+  }
+  Segment* segment = segments_.back().get();
+
+  char header[kRecordHeaderSize];
+  header[0] = data.size() & 255;
+  header[1] = (data.size() >> 8) & 255;
+  header[2] = (data.size() >> 16) & 255;
+  header[3] = (data.size() >> 24) & 255;
+  struct iovec iov[2];
+  iov[0].iov_base = header;
+  iov[0].iov_len = kRecordHeaderSize;
+  iov[1].iov_base = const_cast<char*>(data.data());
+  iov[1].iov_len = data.size();
+  ssize_t bytes_written;
+  do {
+    bytes_written = pwritev(segment->fd, iov, 2, segment->write_offset);
+  } while (bytes_written < 0 && errno == EINTR);
+  if (bytes_written != static_cast<ssize_t>(record_bytes)) {
+    LOG(ERROR) << "Failed to write spill segment " << segment->path << ": "
+               << strerror(errno);
+    return false;
+  }
+  segment->write_offset += record_bytes;
+  ++spilled_chunks_;
+  return true;
+}
+
+bool SpillQueue::AddSegmentLocked() {
+  char name[32];
+  snprintf(name, sizeof(name), "/spill-%06d.log", next_segment_id_++);
+  std::unique_ptr<Segment> segment(new Segment());
+  segment->path = spill_dir_ + name;
+  segment->fd =
+      open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (segment->fd == -1) {
+    LOG(ERROR) << "Failed to open spill segment " << segment->path << ": "
+               << strerror(errno);
+    return false;
+  }
+  // Preallocates the whole segment so appends don't fragment the file or
+  // update its size on every write. Not fatal if unsupported.
+  if (fallocate(segment->fd, 0, 0, segment_bytes_) != 0) {
+    LOG(WARNING) << "Failed to preallocate spill segment " << segment->path
+                 << ": " << strerror(errno);
+  }
+  segments_.push_back(std::move(segment));
+  return true;
+}
+
+void SpillQueue::RemoveSegment(Segment* segment) {
+  if (segment->fd != -1) {
+    close(segment->fd);
+    segment->fd = -1;
+    unlink(segment->path.c_str());
+  }
+}
+
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,127 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_SPILL_QUEUE_H_
+#define API_VIDEO_CLIENT_CPP_SPILL_QUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+// Implements a FIFO of data chunks that never blocks its producer.
+// Up to `max_memory_chunks` chunks are kept in memory. Once that threshold is
+// exceeded, new chunks are appended to a segmented on-disk log under
+// `spill_dir` and are drained back in order when the consumer catches up.
+// Spill segments are preallocated and written sequentially; fully drained
+// segments are deleted.
+//
+// Push() and Pop() can run concurrently, but there must be only one consumer
+// thread calling Pop().
+class SpillQueue {
+ public:
+  SpillQueue(const std::string& spill_dir, size_t max_memory_chunks,
+             size_t segment_bytes);
+  ~SpillQueue();
+
+  // Disallows copy and assign.
+  SpillQueue(const SpillQueue&) = delete;
+  SpillQueue& operator=(const SpillQueue&) = delete;
+
+  // Checks that the spill directory is usable.
+  bool Open();
+
+  // Appends a chunk to the queue. Returns false if the queue has been closed
+  // or has failed, e.g. because the chunk could not be spilled to disk.
+  bool Push(std::string data);
+
+  // Pops the oldest chunk. Blocks until a chunk is available. Returns false
+  // once the queue is closed and fully drained, or has failed, e.g. because
+  // a spilled chunk could not be read back. Check failed() to tell them
+  // apart.
+  bool Pop(std::string* data);
+
+  // Marks the end of input. Pending chunks can still be popped.
+  void Close();
+
+  // Gets total number of queued chunks (in memory and on disk).
+  size_t Size();
+
+  // Gets number of chunks currently spilled to disk.
+  size_t SpilledSize();
+
+  // Whether spilling a chunk or reading one back failed. Chunks are lost
+  // then, so the queue neither takes nor gives any more.
+  bool failed();
+
+ private:
+  // A preallocated on-disk log file. Records are framed as a 4-byte
+  // little-endian length followed by the payload, as in ProtoWriter.
+  struct Segment {
+    std::string path;
+    int fd = -1;
+    size_t write_offset = 0;
+    size_t read_offset = 0;
+  };
+
+  // Appends a chunk to the tail segment, opening a new one if needed.
+  // Must be called with `m_` held.
+  bool SpillLocked(const std::string& data);
+
+  // Opens and preallocates a new tail segment. Must be called with `m_` held.
+  bool AddSegmentLocked();
+
+  // Closes and deletes a segment file.
+  void RemoveSegment(Segment* segment);
+
+  // Spill directory.
+  std::string spill_dir_;
+  // In-memory threshold (number of chunks).
+  const size_t max_memory_chunks_;
+  // Preallocated size of each spill segment (bytes).
+  const size_t segment_bytes_;
+  // Sequence number of the next spill segment.
+  int next_segment_id_ = 0;
+  // Chunks kept in memory. They are always older than spilled chunks.
+  std::deque<std::string> memory_queue_;
+  // Spill segments, oldest first.
+  std::deque<std::unique_ptr<Segment>> segments_;
+  // Number of chunks currently spilled to disk.
+  size_t spilled_chunks_ = 0;
+  // Whether Close() has been called.
+  bool closed_ = false;
+  // Whether a spill segment failed to be written or read.
+  bool failed_ = false;
+  // Mutex.
+  std::mutex m_;
+  // Condition variable signaled on push and close.
+  std::condition_variable cond_var_element_pushed_;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  // API_VIDEO_CLIENT_CPP_SPILL_QUEUE_H_
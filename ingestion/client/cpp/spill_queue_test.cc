@@ -0,0 +1,118 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/spill_queue.h"
+
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace api {
+namespace video {
+namespace {
+
+std::string MakeChunk(int i) { return std::string(100 + i, 'a' + i % 26); }
+
+// Tests that chunks beyond the memory threshold are spilled and drained back
+// in order.
+TEST(SpillQueueTest, SpillAndDrainInOrder) {
+  const std::string dir = std::string(getenv("TEST_TMPDIR")) + "/spill";
+  // Small segments so that several of them are used.
+  SpillQueue q(dir, 2, 1024);
+  ASSERT_TRUE(q.Open());
+  for (int i = 0; i < 50; ++i) {
+    ASSERT_TRUE(q.Push(MakeChunk(i)));
+  }
+  EXPECT_EQ(50, q.Size());
+  EXPECT_EQ(48, q.SpilledSize());
+
+  std::string data;
+  for (int i = 0; i < 25; ++i) {
+    ASSERT_TRUE(q.Pop(&data));
+    EXPECT_EQ(MakeChunk(i), data);
+  }
+  // Pushes while chunks are still on disk go behind them.
+  ASSERT_TRUE(q.Push(MakeChunk(50)));
+  q.Close();
+  EXPECT_FALSE(q.Push(MakeChunk(51)));
+  for (int i = 25; i <= 50; ++i) {
+    ASSERT_TRUE(q.Pop(&data));
+    EXPECT_EQ(MakeChunk(i), data);
+  }
+  EXPECT_FALSE(q.Pop(&data));
+  EXPECT_EQ(0, q.Size());
+}
+
+// Tests that a spilled chunk that can't be read back fails the queue, rather
+// than ending it.
+TEST(SpillQueueTest, FailsOnSegmentReadError) {
+  const std::string dir = std::string(getenv("TEST_TMPDIR")) + "/spill_fail";
+  SpillQueue q(dir, 1, 1024);
+  ASSERT_TRUE(q.Open());
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(q.Push(MakeChunk(i)));
+  }
+  ASSERT_EQ(2, q.SpilledSize());
+  // Loses the spilled chunks.
+  ASSERT_EQ(0, truncate((dir + "/spill-000000.log").c_str(), 0));
+  q.Close();
+
+  std::string data;
+  ASSERT_TRUE(q.Pop(&data));
+  EXPECT_EQ(MakeChunk(0), data);
+  EXPECT_FALSE(q.failed());
+  EXPECT_FALSE(q.Pop(&data));
+  EXPECT_TRUE(q.failed());
+  EXPECT_FALSE(q.Pop(&data));
+}
+
+// Tests a concurrent producer and consumer.
+TEST(SpillQueueTest, ConcurrentPushPop) {
+  const std::string dir = std::string(getenv("TEST_TMPDIR")) + "/spill_mt";
+  SpillQueue q(dir, 4, 4096);
+  ASSERT_TRUE(q.Open());
+  const int kNumChunks = 2000;
+  std::thread producer([&q] {
+    for (int i = 0; i < kNumChunks; ++i) {
+      q.Push(MakeChunk(i));
+    }
+    q.Close();
+  });
+  std::string data;
+  int count = 0;
+  while (q.Pop(&data)) {
+    ASSERT_EQ(MakeChunk(count), data);
+    ++count;
+  }
+  producer.join();
+  EXPECT_EQ(kNumChunks, count);
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
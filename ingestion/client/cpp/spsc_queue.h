@@ -0,0 +1,242 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_SPSC_QUEUE_H_
+#define API_VIDEO_CLIENT_CPP_SPSC_QUEUE_H_
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include "client/cpp/queue_stats.h"
+
+namespace api {
+namespace video {
+
+// Implements a bounded lock-free queue for one producer thread and one
+// consumer thread, with the Push/TryPush/Pop/Size surface of SyncQueue.
+//
+// Elements live in a power-of-two ring of default-constructed slots that is
+// allocated once. The producer and consumer indexes sit on their own cache
+// lines, and each side keeps a private copy of the other's index so that it
+// only reads the shared one when the ring looks full or empty. A blocked
+// Push() or Pop() spins for a while, then sleeps on a futex that the other
+// side only wakes when a waiter is flagged.
+//
+// `Stats` is the statistics policy, see queue_stats.h. The depth recorded on
+// push is an upper bound, as seen by the producer.
+template <class T, class Stats = NoQueueStats>
+class SpscQueue {
+ public:
+  // Constructs an empty queue holding up to `max_size` elements, rounded up
+  // to a power of two.
+  explicit SpscQueue(size_t max_size)
+      : capacity_(RoundUpToPowerOfTwo(max_size)),
+        mask_(capacity_ - 1),
+        slots_(new T[capacity_]),
+        stamps_(new typename Stats::Stamp[capacity_]) {}
+
+  // Disallows copy and assign.
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // Pushes an element, waiting while the queue is full. Producer only.
+  void Push(T& val) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (!HasSpace(tail)) {
+      typename Stats::Stamp since = Stats::Now();
+      Wait(&producer_waiting_, [this, tail] { return HasSpace(tail); });
+      stats_.ProducerBlocked(since);
+    }
+    Store(tail, &val);
+    Wake(&consumer_waiting_);
+  }
+
+  // Tries to push an element. Returns false if the queue is full, leaving
+  // `val` untouched. Producer only.
+  bool TryPush(T& val) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (!HasSpace(tail)) {
+      return false;
+    }
+    Store(tail, &val);
+    Wake(&consumer_waiting_);
+    return true;
+  }
+
+  // Pops an element, waiting while the queue is empty. Consumer only.
+  T Pop() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (!HasElement(head)) {
+      typename Stats::Stamp since = Stats::Now();
+      Wait(&consumer_waiting_, [this, head] { return HasElement(head); });
+      stats_.ConsumerStarved(since);
+    }
+    T val = std::move(slots_[head & mask_]);
+    Release(head);
+    Wake(&producer_waiting_);
+    return val;
+  }
+
+  // Tries to pop an element into `val`. Returns false if the queue is
+  // empty. Consumer only.
+  bool TryPop(T* val) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (!HasElement(head)) {
+      return false;
+    }
+    *val = std::move(slots_[head & mask_]);
+    Release(head);
+    Wake(&producer_waiting_);
+    return true;
+  }
+
+  // Gets queue size. Exact only when called from the producer or consumer
+  // while the other side is idle.
+  size_t Size() const {
+    size_t head = head_.load(std::memory_order_acquire);
+    return tail_.load(std::memory_order_acquire) - head;
+  }
+
+  // Gets the number of slots.
+  size_t capacity() const { return capacity_; }
+
+  // Gets the statistics, e.g. to Register() them.
+  Stats* stats() { return &stats_; }
+
+ private:
+  // Size of a cache line, to keep the producer and consumer state apart.
+  static constexpr size_t kCacheLineSize = 64;
+  // Checks of the other side's index before sleeping on the futex, on
+  // machines with more than one CPU.
+  static constexpr int kSpinCount = 1024;
+
+  static size_t RoundUpToPowerOfTwo(size_t n) {
+    size_t power = 1;
+    while (power < n) {
+      power <<= 1;
+    }
+    return power;
+  }
+
+  static void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+
+  // Stores the element at `tail` and publishes it. Producer only.
+  void Store(size_t tail, T* val) {
+    slots_[tail & mask_] = std::move(*val);
+    stamps_[tail & mask_] = Stats::Now();
+    tail_.store(tail + 1, std::memory_order_release);
+    stats_.Pushed(tail + 1 - head_cache_);
+  }
+
+  // Frees the slot of the element at `head` once it is moved out. Consumer
+  // only.
+  void Release(size_t head) {
+    typename Stats::Stamp pushed = stamps_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    stats_.Popped(tail_cache_ - head - 1, pushed);
+  }
+
+  // Whether the producer has room for the element at `tail`.
+  bool HasSpace(size_t tail) {
+    if (tail - head_cache_ < capacity_) {
+      return true;
+    }
+    head_cache_ = head_.load(std::memory_order_acquire);
+    return tail - head_cache_ < capacity_;
+  }
+
+  // Whether the consumer has the element at `head`.
+  bool HasElement(size_t head) {
+    if (head < tail_cache_) {
+      return true;
+    }
+    tail_cache_ = tail_.load(std::memory_order_acquire);
+    return head < tail_cache_;
+  }
+
+  // Waits until `ready` returns true: spins first, then flags `waiting` and
+  // sleeps on it. The fences pair with the one in Wake(): either the waiter
+  // sees the other side's update, or the other side sees the flag.
+  template <class Ready>
+  static void Wait(std::atomic<int>* waiting, Ready ready) {
+    static const int spin_count =
+        std::thread::hardware_concurrency() > 1 ? kSpinCount : 0;
+    for (int i = 0; i < spin_count; ++i) {
+      if (ready()) {
+        return;
+      }
+      CpuRelax();
+    }
+    while (true) {
+      waiting->store(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (ready()) {
+        waiting->store(0, std::memory_order_relaxed);
+        return;
+      }
+      syscall(SYS_futex, reinterpret_cast<int*>(waiting), FUTEX_WAIT_PRIVATE,
+              1, nullptr, nullptr, 0);
+    }
+  }
+
+  // Wakes the other side if it sleeps on `waiting`.
+  static void Wake(std::atomic<int>* waiting) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting->load(std::memory_order_relaxed) != 0 &&
+        waiting->exchange(0, std::memory_order_relaxed) != 0) {
+      syscall(SYS_futex, reinterpret_cast<int*>(waiting), FUTEX_WAKE_PRIVATE,
+              1, nullptr, nullptr, 0);
+    }
+  }
+
+  const size_t capacity_;
+  const size_t mask_;
+  const std::unique_ptr<T[]> slots_;
+  // Times the elements were pushed.
+  const std::unique_ptr<typename Stats::Stamp[]> stamps_;
+  // Statistics.
+  Stats stats_;
+
+  // Index of the next element pushed, and the producer's copy of head_.
+  alignas(kCacheLineSize) std::atomic<size_t> tail_{0};
+  size_t head_cache_ = 0;
+  // Index of the next element popped, and the consumer's copy of tail_.
+  alignas(kCacheLineSize) std::atomic<size_t> head_{0};
+  size_t tail_cache_ = 0;
+  // Set while the consumer or producer sleeps.
+  alignas(kCacheLineSize) std::atomic<int> consumer_waiting_{0};
+  alignas(kCacheLineSize) std::atomic<int> producer_waiting_{0};
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  // API_VIDEO_CLIENT_CPP_SPSC_QUEUE_H_
@@ -0,0 +1,106 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/spsc_queue.h"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace api {
+namespace video {
+namespace {
+
+// Tests that the capacity is rounded up to a power of two.
+TEST(SpscQueueTest, Capacity) {
+  EXPECT_EQ(1, SpscQueue<int>(1).capacity());
+  EXPECT_EQ(4, SpscQueue<int>(3).capacity());
+  EXPECT_EQ(8, SpscQueue<int>(8).capacity());
+}
+
+// Tests pushing and popping in order, and wrapping around the ring.
+TEST(SpscQueueTest, Order) {
+  SpscQueue<int> q(4);
+  for (int i = 1; i <= 4; ++i) {
+    int a = i;
+    EXPECT_TRUE(q.TryPush(a));
+  }
+  int full = 5;
+  EXPECT_FALSE(q.TryPush(full));
+  EXPECT_EQ(5, full);
+  EXPECT_EQ(4, q.Size());
+  EXPECT_EQ(1, q.Pop());
+  EXPECT_EQ(2, q.Pop());
+  EXPECT_TRUE(q.TryPush(full));
+  int a = 6;
+  q.Push(a);
+  EXPECT_EQ(4, q.Size());
+  for (int i = 3; i <= 6; ++i) {
+    EXPECT_EQ(i, q.Pop());
+  }
+  int b;
+  EXPECT_FALSE(q.TryPop(&b));
+  EXPECT_EQ(0, q.Size());
+}
+
+// Tests queue with unique_ptr.
+TEST(SpscQueueTest, UniquePtr) {
+  SpscQueue<std::unique_ptr<int>> q(2);
+  std::unique_ptr<int> a(new int(100));
+  q.Push(a);
+  EXPECT_EQ(nullptr, a);
+  std::unique_ptr<int> b;
+  EXPECT_TRUE(q.TryPop(&b));
+  EXPECT_EQ(100, *b);
+}
+
+// Tests a producer and a consumer thread blocking on a small queue, so that
+// both sides sleep and wake each other.
+TEST(SpscQueueTest, Threads) {
+  constexpr int kCount = 200000;
+  SpscQueue<std::unique_ptr<int>> q(4);
+  std::thread producer([&q] {
+    for (int i = 0; i < kCount; ++i) {
+      std::unique_ptr<int> val(new int(i));
+      q.Push(val);
+    }
+  });
+  for (int i = 0; i < kCount; ++i) {
+    std::unique_ptr<int> val = q.Pop();
+    ASSERT_EQ(i, *val);
+    if (i % 10000 == 0) {
+      // Lets the producer fill the queue and sleep.
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  producer.join();
+  EXPECT_EQ(0, q.Size());
+}
+
+}  // namespace
+}  // namespace video
+}  // namespace api
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -22,6 +22,9 @@
 
 #include <google/protobuf/util/json_util.h>
 
+#include <unistd.h>
+
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <iostream>
@@ -30,22 +33,110 @@
 #include <thread>
 #include <vector>
 
+#include "client/cpp/annotation_util.h"
 #include "client/cpp/file_reader.h"
 #include "client/cpp/file_writer.h"
 #include "client/cpp/media_player.h"
+#include "client/cpp/mp4_fragment_parser.h"
 #include "client/cpp/pipe_reader.h"
-#include "client/cpp/proto_processor.h"
 #include "client/cpp/proto_writer.h"
+#include "client/cpp/queue_stats.h"
+#include "client/cpp/result_cache.h"
+#include "client/cpp/result_sinks.h"
+#include "client/cpp/scratch_dir.h"
+#include "client/cpp/segmented_file_writer.h"
+#include "client/cpp/segmented_writer.h"
+#include "client/cpp/shard_merger.h"
+#include "client/cpp/spill_queue.h"
+#include "client/cpp/upload_checkpoint.h"
+#include "client/cpp/video_recorder.h"
+#include "client/cpp/video_sharder.h"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
+DEFINE_string(cache_dir, "",
+              "Directory of the result cache. If set, annotating the same "
+              "video file with the same config replays cached responses. "
+              "Disabled if empty.");
+DEFINE_bool(cache_replay_paced, false,
+            "Whether cached responses are replayed at their original pace, "
+            "instead of immediately.");
+DEFINE_int32(checkpoint_interval_sec, 10,
+             "Seconds between upload checkpoints.");
+DEFINE_string(checkpoint_path, "",
+              "Upload checkpoint file. If set, a failed file upload resumes "
+              "from the last checkpoint when rerun. Disabled if empty.");
+DEFINE_int32(chunk_size_kb, 1024,
+             "Max size of the video content chunks read and sent (KBytes).");
+DEFINE_bool(compress_results, false,
+            "Whether the annotation result file is written in zlib-"
+            "compressed blocks. A resumed file must use the same setting.");
 DEFINE_string(config, "", "Config request JSON object.");
+DEFINE_string(csv_result_path, "",
+              "Path of annotation results in CSV format, one record per "
+              "shot, label, explicit content frame or object box.");
 DEFINE_bool(enable_player, false, "Enable live visualizer.");
 DEFINE_string(endpoint, "dns:///videointelligence.googleapis.com",
               "API endpoint to connect to.");
+DEFINE_string(jsonl_result_path, "",
+              "Path of annotation results in JSON Lines format, one record "
+              "per shot, label, explicit content frame or object box.");
 DEFINE_string(local_storage_annotation_result, "",
               "Local Storage: annotation result path.");
+DEFINE_int32(local_storage_max_segments, 0,
+             "If positive, only this many segments of each local storage "
+             "file are kept, and older ones are deleted.");
+DEFINE_int32(local_storage_segment_mb, 0,
+             "If positive, local storage files are rotated into numbered "
+             "segments of about this many MBytes, listed in <file>.manifest.");
+DEFINE_int32(local_storage_segment_sec, 0,
+             "If positive, local storage files are rotated into numbered "
+             "segments of about this many seconds of media, listed in "
+             "<file>.manifest.");
 DEFINE_string(local_storage_video, "", "Local Storage: video path.");
+DEFINE_bool(local_storage_video_remux, false,
+            "Whether local storage video is remuxed into fragmented MP4 "
+            "segments, with a time index of keyframes per segment.");
+DEFINE_int32(num_shards, 1,
+             "Number of shards a video file is split into and annotated "
+             "concurrently. Shards are not supported for pipe input.");
+DEFINE_int32(player_buffer_kb, 64,
+             "Size of the buffer the live visualizer demuxes video content "
+             "from (KBytes).");
+DEFINE_bool(player_lossless, false,
+            "Whether the live visualizer gets all video content, slowing the "
+            "upload down to its pace once it falls behind. Otherwise it skips "
+            "the content it falls behind on.");
+DEFINE_int32(queue_stats_interval_sec, 0,
+             "Logs the depth and timings of the client's internal queues at "
+             "this interval, and at the end (0: never).");
+DEFINE_int32(result_index_interval, 0,
+             "If positive, a time index of the annotation result file is "
+             "written to <file>.idx, with an entry every this many results.");
+DEFINE_int32(result_sync_interval_ms, 0,
+             "If positive, the annotation result file is written and "
+             "fsync()ed at least this often (in milliseconds).");
+DEFINE_int32(result_sync_records, 0,
+             "If positive, the annotation result file is fsync()ed every "
+             "this many results.");
+DEFINE_int32(session_rollover_sec, 0,
+             "Seconds before the gRPC deadline at which a new session is "
+             "opened and the stream is cut over at the next fragment boundary. "
+             "Requires fragmented MP4 input. Disabled if 0.");
+DEFINE_string(shard_dir, "/tmp",
+              "Directory in which each run creates its own directory of "
+              "temporary shard files.");
+DEFINE_int32(sink_batch_size, 16,
+             "Max number of responses a result sink handles at a time.");
+DEFINE_int32(sink_queue_size, 256,
+             "Max number of responses queued for each result sink.");
+DEFINE_string(spill_dir, "",
+              "Directory for spilling video chunks to disk when the uplink "
+              "falls behind. Disabled if empty.");
+DEFINE_int32(spill_memory_chunks, 16,
+             "Spill queue: max number of in-memory video chunks.");
+DEFINE_int32(spill_segment_mb, 256,
+             "Spill queue: preallocated size of each segment (MBytes).");
 DEFINE_int32(timeout, 3600, "GRPC deadline (default: 1 hour).");
 DEFINE_bool(use_pipe, false, "Whether reading video contents from a pipe.");
 DEFINE_string(video_path, "", "Input video path.");
@@ -75,29 +166,64 @@ using ::grpc::ClientReaderWriter;
 
 void StartMediaPlayer(api::video::MediaPlayer* player) { player->Init(); }
 
+// Gets the segment options of local storage files.
+SegmentedWriter::Options LocalStorageSegmentOptions() {
+  SegmentedWriter::Options options;
+  options.max_segment_bytes =
+      static_cast<int64_t>(FLAGS_local_storage_segment_mb) << 20;
+  options.max_segment_duration_us =
+      static_cast<int64_t>(FLAGS_local_storage_segment_sec) * 1000000;
+  options.max_segments = FLAGS_local_storage_max_segments;
+  return options;
+}
+
+// Whether local storage files are segmented.
+bool IsLocalStorageSegmented() {
+  return FLAGS_local_storage_segment_mb > 0 ||
+         FLAGS_local_storage_segment_sec > 0;
+}
+
+// Gets the maximum size of the data chunks read.
+size_t DataChunkBytes() {
+  return static_cast<size_t>(FLAGS_chunk_size_kb) << 10;
+}
+
+// Gets what the video content queues of the player do once it falls
+// behind.
+OverflowPolicy PlayerPolicy() {
+  return FLAGS_player_lossless ? OverflowPolicy::kBlock
+                               : OverflowPolicy::kDropOldest;
+}
+
 }  // namespace
 
-// Maximum data chunks read: 1 MByte.
-constexpr int kDataChunk = 1 * 1024 * 1024;
+// Chunks kept for the local storage writer and the player to catch up.
+constexpr size_t kChunkRingSize = 32;
 
 bool StreamingClient::Init(int* argc_ptr, char*** argv_ptr) {
   gflags::ParseCommandLineFlags(argc_ptr, argv_ptr, true);
+  if (FLAGS_chunk_size_kb <= 0) {
+    LOG(ERROR) << "--chunk_size_kb must be positive.";
+    return false;
+  }
 
-  auto ssl_credentials = grpc::GoogleDefaultCredentials();
-  channel_ = grpc::CreateChannel(FLAGS_endpoint, ssl_credentials);
-  LOG(INFO) << "Connecting to " << FLAGS_endpoint << "...";
+  if (channel_ == nullptr) {
+    auto ssl_credentials = grpc::GoogleDefaultCredentials();
+    channel_ = grpc::CreateChannel(FLAGS_endpoint, ssl_credentials);
+    LOG(INFO) << "Connecting to " << FLAGS_endpoint << "...";
+  }
 
   // Creates a stub call.
   stub_ = StreamingVideoIntelligenceService::NewStub(channel_);
 
-  std::chrono::system_clock::time_point timeout =
-      std::chrono::system_clock::now() + std::chrono::seconds(FLAGS_timeout);
-  context_.set_deadline(timeout);
-
-  // Inits and starts a gRPC client.
-  stream_ = std::shared_ptr<ClientReaderWriter<StreamingAnnotateVideoRequest,
-                                               StreamingAnnotateVideoResponse>>(
-      stub_->StreamingAnnotateVideo(&context_));
+  // Inits and starts a gRPC client. Shards open their own sessions.
+  if (FLAGS_num_shards > 1 && FLAGS_use_pipe) {
+    LOG(WARNING) << "Shards are not supported for pipe input.";
+    FLAGS_num_shards = 1;
+  }
+  if (FLAGS_num_shards <= 1) {
+    session_ = OpenSession(/*time_offset_us=*/0);
+  }
   grpc_connectivity_state state = channel_->GetState(/*try_to_connect*/ true);
   if (state != GRPC_CHANNEL_READY) {
     LOG(ERROR) << "grpc_connectivity_state error: " << std::to_string(state);
@@ -105,28 +231,184 @@ bool StreamingClient::Init(int* argc_ptr, char*** argv_ptr) {
   }
 
   // Creates media player.
-  if (FLAGS_enable_player) {
-    player_ = new MediaPlayer(FLAGS_font_type);
+  if (FLAGS_enable_player && FLAGS_num_shards > 1) {
+    LOG(WARNING) << "Live visualizer is disabled with shards.";
+  } else if (FLAGS_enable_player) {
+    player_ = new MediaPlayer(
+        FLAGS_font_type, static_cast<size_t>(FLAGS_player_buffer_kb) << 10,
+        PlayerPolicy());
   }
 
   return true;
 }
 
+StreamingClient::StreamingClient() = default;
+
 StreamingClient::~StreamingClient() {
+  if (logging_queue_stats_) {
+    QueueStatsRegistry::Get()->StopLogging();
+  }
   if (player_ != nullptr) {
     delete player_;
   }
 }
 
+void StreamingClient::UseChannel(std::shared_ptr<grpc::Channel> channel) {
+  channel_ = std::move(channel);
+}
+
+void StreamingClient::UseInput(std::unique_ptr<IOReader> reader) {
+  input_ = std::move(reader);
+}
+
+void StreamingClient::AddResultCallback(
+    std::function<void(const SharedResponse& resp)> callback,
+    OverflowPolicy policy) {
+  result_callbacks_.emplace_back(std::move(callback), policy);
+}
+
 bool StreamingClient::Run() {
-  if (!SendConfig()) {
+  if (!LoadConfig() || !LoadCheckpoint() || !OpenCache()) {
     return false;
   }
-  std::thread reader([this] { ReadResponse(); });
-  bool status = SendContent();
-  reader.join();
+  if (FLAGS_local_storage_annotation_result != "") {
+    const std::string& path = FLAGS_local_storage_annotation_result;
+    ProtoWriter::Options options;
+    options.sync_interval_ms = FLAGS_result_sync_interval_ms;
+    options.sync_records = FLAGS_result_sync_records;
+    options.index_interval = FLAGS_result_index_interval;
+    options.compress = FLAGS_compress_results;
+    if (IsLocalStorageSegmented()) {
+      result_segments_.reset(new SegmentedWriter(
+          path, LocalStorageSegmentOptions(),
+          [options](const std::string& segment_path) {
+            return std::unique_ptr<IOWriter>(
+                new ProtoWriter(segment_path, options));
+          }));
+      if (resume_point_ != nullptr) {
+        // Drops the results written after the checkpoint, as they are
+        // received again. A resumed run then starts a new segment.
+        const int64_t latest_time_us = resume_acknowledged_time_us_;
+        CHECK(result_segments_->RollBack(
+            resume_result_segment_, resume_result_bytes_,
+            [options, latest_time_us](const std::string& segment_path,
+                                      int64_t size) {
+              ProtoWriter writer(segment_path, options);
+              if (!writer.OpenAt(size, latest_time_us)) {
+                return false;
+              }
+              writer.Close();
+              return true;
+            }))
+            << "Failed to continue writing to " << path;
+      }
+      CHECK(result_segments_->Open()) << "Failed to write to " << path;
+    } else if (resume_point_ != nullptr && resume_result_bytes_ > 0) {
+      result_writer_.reset(new ProtoWriter(path, options));
+      CHECK(result_writer_->OpenAt(resume_result_bytes_,
+                                   resume_acknowledged_time_us_))
+          << "Failed to continue writing to " << path;
+    } else {
+      result_writer_.reset(new ProtoWriter(path, options));
+      CHECK(result_writer_->Open()) << "Failed to write to " << path;
+    }
+  }
+  StartSinks();
+  if (FLAGS_queue_stats_interval_sec > 0) {
+    QueueStatsRegistry::Get()->StartLogging(
+        std::chrono::seconds(FLAGS_queue_stats_interval_sec));
+    logging_queue_stats_ = true;
+  }
+  start_time_ = std::chrono::steady_clock::now();
+  bool status = true;
+  std::shared_ptr<CachedResult> cached_result(new CachedResult());
+  if (result_cache_ != nullptr && LookupCache(cached_result.get())) {
+    status = ReplayCache(cached_result);
+  } else if (FLAGS_num_shards > 1) {
+    status = AnnotateShards();
+  } else {
+    if (resume_point_ != nullptr) {
+      session_->time_offset_us = resume_point_->time_offset_us;
+    }
+    {
+      std::lock_guard<std::mutex> lock(checkpoint_mutex_);
+      next_checkpoint_time_ =
+          std::chrono::steady_clock::now() +
+          std::chrono::seconds(FLAGS_checkpoint_interval_sec);
+    }
+    if (!StartSession(session_.get())) {
+      return false;
+    }
+    status = SendContent();
+    if (!FinishSession(session_.get())) {
+      status = false;
+    }
+    for (auto& thread : retiring_threads_) {
+      thread.join();
+    }
+    if (!retired_status_) {
+      status = false;
+    }
+  }
 
-  auto grpc_status = stream_->Finish();
+  LOG(INFO) << "Received " << total_responses_received_ << " responses.";
+  dispatcher_->Close();
+  if (player_thread_ != nullptr) {
+    player_thread_->join();
+  }
+  if (logging_queue_stats_) {
+    QueueStatsRegistry::Get()->StopLogging();
+    logging_queue_stats_ = false;
+    LOG(INFO) << "Queue stats:\n" << QueueStatsRegistry::Get()->Report();
+  }
+  if (result_writer_ != nullptr) {
+    result_writer_->Close();
+  }
+  if (result_segments_ != nullptr) {
+    result_segments_->Close();
+  }
+  if (status && cache_entry_ != nullptr) {
+    result_cache_->Store(
+        ResultCache::Key(config_req_, content_digest_), *cache_entry_);
+  }
+  if (status && FLAGS_checkpoint_path != "") {
+    // The upload is complete, so a rerun must start over.
+    unlink(FLAGS_checkpoint_path.c_str());
+  }
+  return status;
+}
+
+std::unique_ptr<StreamingClient::Session> StreamingClient::OpenSession(
+    int64_t time_offset_us) {
+  std::unique_ptr<Session> session(new Session());
+  session->deadline =
+      std::chrono::system_clock::now() + std::chrono::seconds(FLAGS_timeout);
+  session->context.set_deadline(session->deadline);
+  session->stream = stub_->StreamingAnnotateVideo(&session->context);
+  session->time_offset_us = time_offset_us;
+  return session;
+}
+
+bool StreamingClient::StartSession(Session* session) {
+  if (!SendConfig(session)) {
+    return false;
+  }
+  session->reader.reset(new std::thread([this, session] {
+    ReadResponse(session);
+  }));
+  return true;
+}
+
+bool StreamingClient::FinishSession(Session* session) {
+  bool status = true;
+  if (!session->stream->WritesDone()) {
+    LOG(ERROR) << "Failed to mark WritesDone in gRPC stream.";
+    status = false;
+  }
+  if (session->reader != nullptr) {
+    session->reader->join();
+  }
+  auto grpc_status = session->stream->Finish();
   if (!grpc_status.ok()) {
     LOG(ERROR) << "StreamingAnnotateVideo RPC failed: Code("
                << grpc_status.error_code()
@@ -136,58 +418,330 @@ bool StreamingClient::Run() {
   return status;
 }
 
-void StreamingClient::ReadResponse() {
-  StreamingAnnotateVideoResponse resp;
-  int total_responses_received = 0;
-  bool enable_local_storage_annotation_result =
-      (FLAGS_local_storage_annotation_result != "");
-  std::unique_ptr<ProtoWriter> writer;
-  if (enable_local_storage_annotation_result) {
-    writer.reset(new ProtoWriter(FLAGS_local_storage_annotation_result));
-    CHECK(writer->Open()) << "Failed to write to "
-                          << FLAGS_local_storage_annotation_result;
-  }
-
-  std::unique_ptr<std::thread> player_thread;
-  while (stream_->Read(&resp)) {
-    // Start playing video when first response is received.
-    if (total_responses_received == 0 && FLAGS_enable_player) {
-      player_thread.reset(new std::thread(StartMediaPlayer, player_));
+void StreamingClient::ReadResponse(Session* session) {
+  while (true) {
+    // Each response is parsed into its own arena and then shared by all
+    // consumers, so it is never copied.
+    std::shared_ptr<StreamingAnnotateVideoResponse> resp = NewArenaResponse();
+    if (!session->stream->Read(resp.get())) {
+      break;
+    }
+    if (resp->has_annotation_results()) {
+      ShiftTimeOffsets(session->time_offset_us,
+                       resp->mutable_annotation_results());
     }
-    total_responses_received++;
-    ProtoProcessor::Process(feature_, resp.annotation_results());
 
-    if (player_ != nullptr) {
-      player_->InsertAnnotationResponse(resp);
+    if (session->buffer_results) {
+      if (resp->has_error()) {
+        LOG(ERROR) << "Received an error: " << resp->error().message();
+      } else {
+        session->results.push_back(resp->annotation_results());
+      }
+      continue;
     }
 
-    if (resp.has_error()) {
-      LOG(ERROR) << "Received an error: " << resp.error().message();
-    } else if (enable_local_storage_annotation_result) {
-      writer->WriteProto(resp.annotation_results());
+    std::lock_guard<std::mutex> lock(response_mutex_);
+    if (cache_entry_ != nullptr) {
+      if (resp->has_error()) {
+        // Errors are not cached, so the video is annotated again next time.
+        cache_entry_.reset();
+      } else {
+        CachedResponse* cached = cache_entry_->add_responses();
+        cached->set_elapsed_ms(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start_time_)
+                .count());
+        *cached->mutable_response() = *resp;
+      }
     }
+    HandleResponse(std::move(resp));
   }
-  LOG(INFO) << "Received " << total_responses_received << " responses.";
-  if (player_thread != nullptr) {
-    player_thread->join();
+}
+
+void StreamingClient::HandleResponse(
+    std::shared_ptr<const StreamingAnnotateVideoResponse> resp) {
+  int64_t latest_time_us = GetLatestTimeOffsetUs(resp->annotation_results());
+  if (latest_time_us >= 0 && latest_time_us <= resume_acknowledged_time_us_) {
+    // Already logged before the upload was resumed.
+    return;
   }
-  if (enable_local_storage_annotation_result) {
-    writer->Close();
+  acknowledged_time_us_ = std::max(acknowledged_time_us_, latest_time_us);
+  if (resp->annotation_results_uri() != "" && resume_point_ == nullptr) {
+    // Identifies a new upload by where the service stores its results.
+    std::lock_guard<std::mutex> lock(checkpoint_mutex_);
+    if (upload_session_id_ != "") {
+      upload_session_id_ = resp->annotation_results_uri();
+    }
+  }
+
+  // Start playing video when first response is received.
+  if (total_responses_received_ == 0 && player_ != nullptr) {
+    player_thread_.reset(new std::thread(StartMediaPlayer, player_));
+  }
+  total_responses_received_++;
+  if (resp->has_error()) {
+    LOG(ERROR) << "Received an error: " << resp->error().message();
+  }
+  dispatcher_->Publish(resp);
+  if (result_writer_ == nullptr && result_segments_ == nullptr) {
+    // Otherwise the result file sink checkpoints what it has written.
+    MaybeWriteCheckpoint(acknowledged_time_us_, 0, 0);
+  }
+}
+
+void StreamingClient::StartSinks() {
+  dispatcher_.reset(new ResultDispatcher());
+  const size_t queue_size = FLAGS_sink_queue_size;
+  const size_t batch_size = FLAGS_sink_batch_size;
+
+  // Logging is best effort: it keeps the latest results if it falls behind.
+  dispatcher_->AddSink("log",
+                       std::unique_ptr<ResultSink>(new LogSink(feature_)),
+                       queue_size, batch_size, OverflowPolicy::kDropOldest);
+  if (result_writer_ != nullptr) {
+    ProtoFileSink::WrittenCallback written_callback;
+    ProtoFileSink::DueCallback due_callback;
+    if (upload_session_id_ != "") {
+      written_callback = [this](int64_t latest_time_us, int64_t file_size) {
+        MaybeWriteCheckpoint(
+            std::max(latest_time_us, resume_acknowledged_time_us_), 0,
+            file_size);
+      };
+      due_callback = [this] { return CheckpointDue(); };
+    }
+    dispatcher_->AddSink(
+        "proto_file",
+        std::unique_ptr<ResultSink>(new ProtoFileSink(
+            result_writer_.get(), written_callback, due_callback)),
+        queue_size, batch_size, OverflowPolicy::kBlock);
+  }
+  if (result_segments_ != nullptr) {
+    SegmentedProtoFileSink::WrittenCallback written_callback;
+    SegmentedProtoFileSink::DueCallback due_callback;
+    if (upload_session_id_ != "") {
+      written_callback = [this](int64_t latest_time_us, int64_t segment_index,
+                                int64_t segment_size) {
+        MaybeWriteCheckpoint(
+            std::max(latest_time_us, resume_acknowledged_time_us_),
+            segment_index, segment_size);
+      };
+      due_callback = [this] { return CheckpointDue(); };
+    }
+    std::unique_ptr<ResultSink> sink(new SegmentedProtoFileSink(
+        result_segments_.get(), written_callback, due_callback));
+    dispatcher_->AddSink("proto_file", std::move(sink), queue_size,
+                         batch_size, OverflowPolicy::kBlock);
+  }
+  if (FLAGS_jsonl_result_path != "") {
+    std::unique_ptr<EncodedFileSink> sink(new EncodedFileSink(
+        FLAGS_jsonl_result_path, ResultEncoder::Format::kJsonl));
+    CHECK(sink->Open()) << "Failed to write to " << FLAGS_jsonl_result_path;
+    dispatcher_->AddSink("jsonl", std::move(sink), queue_size, batch_size,
+                         OverflowPolicy::kBlock);
+  }
+  if (FLAGS_csv_result_path != "") {
+    std::unique_ptr<EncodedFileSink> sink(new EncodedFileSink(
+        FLAGS_csv_result_path, ResultEncoder::Format::kCsv));
+    CHECK(sink->Open()) << "Failed to write to " << FLAGS_csv_result_path;
+    dispatcher_->AddSink("csv", std::move(sink), queue_size, batch_size,
+                         OverflowPolicy::kBlock);
+  }
+  if (player_ != nullptr) {
+    // The player queue drops its oldest responses when full, so this never
+    // blocks.
+    MediaPlayer* player = player_;
+    dispatcher_->AddSink("player",
+                         std::unique_ptr<ResultSink>(new CallbackSink(
+                             [player](const SharedResponse& resp) {
+                               player->InsertAnnotationResponse(resp);
+                             })),
+                         queue_size, batch_size, OverflowPolicy::kBlock);
+  }
+  for (auto& callback : result_callbacks_) {
+    dispatcher_->AddSink(
+        "callback",
+        std::unique_ptr<ResultSink>(new CallbackSink(callback.first)),
+        queue_size, batch_size, callback.second);
   }
 }
 
-bool StreamingClient::SendConfig() {
+bool StreamingClient::LoadConfig() {
   std::ifstream input(FLAGS_config);
   std::stringstream config_req_json;
   while (input >> config_req_json.rdbuf()) {
   }
 
   // All the config details must be sent in the first request.
-  StreamingAnnotateVideoRequest config_req;
-  JsonStringToMessage(config_req_json.str(), &config_req);
-  feature_ = config_req.video_config().feature();
-  if (!stream_->Write(config_req)) {
-    LOG(ERROR) << "Failed to send config: " << config_req.ShortDebugString();
+  if (!JsonStringToMessage(config_req_json.str(), &config_req_).ok()) {
+    LOG(ERROR) << "Failed to parse config: " << FLAGS_config;
+    return false;
+  }
+  feature_ = config_req_.video_config().feature();
+  return true;
+}
+
+bool StreamingClient::LoadCheckpoint() {
+  if (FLAGS_checkpoint_path == "") {
+    return true;
+  }
+  if (FLAGS_use_pipe || FLAGS_num_shards > 1) {
+    LOG(WARNING) << "Upload checkpoints are not supported for pipe input or "
+                 << "shards.";
+    return true;
+  }
+
+  UploadCheckpoint checkpoint;
+  if (!ReadUploadCheckpoint(FLAGS_checkpoint_path, &checkpoint) ||
+      checkpoint.video_path() != FLAGS_video_path) {
+    // Starts a new upload.
+    upload_session_id_ =
+        std::to_string(getpid()) + "-" +
+        std::to_string(
+            std::chrono::system_clock::now().time_since_epoch().count());
+    return true;
+  }
+  upload_session_id_ = checkpoint.session_id();
+
+  std::unique_ptr<ResumePoint> point(new ResumePoint());
+  if (!FindResumePoint(FLAGS_video_path, checkpoint, point.get())) {
+    return false;
+  }
+  if (point->offset == 0) {
+    LOG(INFO) << "Restarting upload " << upload_session_id_
+              << " from the beginning.";
+    return true;
+  }
+  LOG(INFO) << "Resuming upload " << upload_session_id_ << " at byte "
+            << point->offset << ", media time " << point->time_offset_us / 1e6
+            << "s.";
+  resume_point_ = std::move(point);
+  resume_result_segment_ = checkpoint.annotation_result_segment();
+  resume_result_bytes_ = checkpoint.annotation_result_bytes();
+  resume_acknowledged_time_us_ = checkpoint.acknowledged_time_us();
+  acknowledged_time_us_ = checkpoint.acknowledged_time_us();
+  return true;
+}
+
+bool StreamingClient::CheckpointDue() {
+  std::lock_guard<std::mutex> lock(checkpoint_mutex_);
+  return std::chrono::steady_clock::now() >= next_checkpoint_time_;
+}
+
+void StreamingClient::MaybeWriteCheckpoint(int64_t acknowledged_time_us,
+                                           int64_t result_segment,
+                                           int64_t result_bytes) {
+  std::lock_guard<std::mutex> lock(checkpoint_mutex_);
+  if (upload_session_id_ == "" ||
+      std::chrono::steady_clock::now() < next_checkpoint_time_) {
+    return;
+  }
+  next_checkpoint_time_ = std::chrono::steady_clock::now() +
+                          std::chrono::seconds(FLAGS_checkpoint_interval_sec);
+
+  UploadCheckpoint checkpoint;
+  checkpoint.set_video_path(FLAGS_video_path);
+  checkpoint.set_session_id(upload_session_id_);
+  checkpoint.set_byte_offset(content_offset_);
+  checkpoint.set_acknowledged_time_us(acknowledged_time_us);
+  checkpoint.set_annotation_result_segment(result_segment);
+  checkpoint.set_annotation_result_bytes(result_bytes);
+  WriteUploadCheckpoint(FLAGS_checkpoint_path, checkpoint);
+}
+
+bool StreamingClient::OpenCache() {
+  if (FLAGS_cache_dir == "") {
+    return true;
+  }
+  // A pipe can only be hashed while streaming, so its responses could be
+  // stored but never looked up.
+  if (FLAGS_num_shards > 1 || FLAGS_use_pipe || resume_point_ != nullptr) {
+    LOG(WARNING) << "Result cache is not supported for shards, pipes or "
+                 << "resumed uploads.";
+    return true;
+  }
+  result_cache_.reset(new ResultCache(FLAGS_cache_dir));
+  if (!result_cache_->Open()) {
+    return false;
+  }
+  cache_entry_.reset(new CachedResult());
+  return true;
+}
+
+bool StreamingClient::LookupCache(CachedResult* cached_result) {
+  FileReader reader(FLAGS_video_path);
+  if (!reader.Open()) {
+    // Without a digest the responses cannot be stored either.
+    std::lock_guard<std::mutex> lock(response_mutex_);
+    cache_entry_.reset();
+    return false;
+  }
+  ContentHasher hasher;
+  std::vector<char> buffer(DataChunkBytes() + 1, 0);
+  size_t num_bytes_read;
+  while ((num_bytes_read =
+              reader.ReadBytes(DataChunkBytes(), buffer.data())) > 0) {
+    hasher.Update(buffer.data(), num_bytes_read);
+  }
+  reader.Close();
+  // Kept to store the responses on a miss, so the file is hashed once.
+  content_digest_ = hasher.Digest();
+  const std::string key = ResultCache::Key(config_req_, content_digest_);
+  if (!result_cache_->Lookup(key, cached_result)) {
+    LOG(INFO) << "Result cache miss: " << key;
+    return false;
+  }
+  LOG(INFO) << "Result cache hit: " << key;
+  return true;
+}
+
+bool StreamingClient::ReplayCache(
+    std::shared_ptr<const CachedResult> cached_result) {
+  // Nothing is sent, so the session opened by Init() is cancelled.
+  session_->context.TryCancel();
+  session_->stream->Finish();
+  {
+    std::lock_guard<std::mutex> lock(response_mutex_);
+    cache_entry_.reset();
+  }
+
+  // The player needs the video as well as the annotations.
+  std::unique_ptr<std::thread> player_feeder;
+  if (player_ != nullptr) {
+    player_feeder.reset(new std::thread([this] {
+      FileReader reader(FLAGS_video_path);
+      if (!reader.Open()) {
+        player_->EndStreamData();
+        return;
+      }
+      std::shared_ptr<const std::string> chunk;
+      while (ReadContent(&reader, nullptr, &chunk)) {
+        player_->InsertStreamData(std::move(chunk));
+      }
+      reader.Close();
+      player_->EndStreamData();
+    }));
+  }
+
+  auto replay_start_time = std::chrono::steady_clock::now();
+  for (const CachedResponse& cached : cached_result->responses()) {
+    if (FLAGS_cache_replay_paced) {
+      std::this_thread::sleep_until(
+          replay_start_time + std::chrono::milliseconds(cached.elapsed_ms()));
+    }
+    std::lock_guard<std::mutex> lock(response_mutex_);
+    // Shares the cached result instead of copying the response out of it.
+    HandleResponse(std::shared_ptr<const StreamingAnnotateVideoResponse>(
+        cached_result, &cached.response()));
+  }
+  if (player_feeder != nullptr) {
+    player_feeder->join();
+  }
+  return true;
+}
+
+bool StreamingClient::SendConfig(Session* session) {
+  if (!session->stream->Write(config_req_)) {
+    LOG(ERROR) << "Failed to send config: " << config_req_.ShortDebugString();
     return false;
   }
   return true;
@@ -196,51 +750,133 @@ bool StreamingClient::SendConfig() {
 bool StreamingClient::SendContent() {
   bool status = true;
 
-  std::unique_ptr<IOReader> reader;
-  if (FLAGS_use_pipe) {
+  std::unique_ptr<IOReader> reader = std::move(input_);
+  if (reader != nullptr) {
+    CHECK(reader->Open()) << "Failed to open the content input";
+  } else if (FLAGS_use_pipe) {
     reader.reset(new PipeReader(FLAGS_video_path));
+    CHECK(reader->Open()) << "Failed to read from " << FLAGS_video_path;
   } else {
-    reader.reset(new FileReader(FLAGS_video_path));
+    FileReader* file_reader = new FileReader(FLAGS_video_path);
+    reader.reset(file_reader);
+    CHECK(reader->Open()) << "Failed to read from " << FLAGS_video_path;
+    if (resume_point_ != nullptr) {
+      CHECK(file_reader->Seek(resume_point_->offset))
+          << "Failed to resume reading " << FLAGS_video_path;
+      content_offset_ = resume_point_->offset;
+    }
   }
-  CHECK(reader->Open()) << "Failed to read from " << FLAGS_video_path;
 
   std::unique_ptr<IOWriter> writer;
   bool enable_local_storage_video = (FLAGS_local_storage_video != "");
   if (enable_local_storage_video) {
-    writer.reset(new FileWriter(FLAGS_local_storage_video));
+    if (FLAGS_local_storage_video_remux) {
+      writer.reset(new VideoRecorder(FLAGS_local_storage_video,
+                                     LocalStorageSegmentOptions()));
+    } else if (IsLocalStorageSegmented()) {
+      writer.reset(new SegmentedFileWriter(FLAGS_local_storage_video,
+                                           LocalStorageSegmentOptions()));
+    } else {
+      writer.reset(new FileWriter(FLAGS_local_storage_video));
+    }
     CHECK(writer->Open()) << "Failed to write to " << FLAGS_local_storage_video;
   }
 
-  int requests_sent = 0;
-  long total_bytes_read = 0;
-  std::vector<char> buffer(kDataChunk + 1, 0);
+  // Local storage and the player consume the chunks on their own threads.
+  ChunkRing chunks(kChunkRingSize);
+  chunks.stats()->Register("content_chunks");
+  std::vector<std::thread> chunk_consumers;
+  StartChunkConsumers(&chunks, writer.get(), &chunk_consumers);
+  ChunkRing* chunk_ring = chunk_consumers.empty() ? nullptr : &chunks;
 
-  while (true) {
-    size_t num_bytes_read = reader->ReadBytes(kDataChunk, buffer.data());
-    if (num_bytes_read == 0) {
-      break;
+  // With a spill queue, chunks are read on a separate thread so that a slow
+  // uplink never back-pressures the video source.
+  std::unique_ptr<SpillQueue> spill_queue;
+  std::unique_ptr<std::thread> read_thread;
+  if (FLAGS_spill_dir != "") {
+    spill_queue.reset(new SpillQueue(FLAGS_spill_dir, FLAGS_spill_memory_chunks,
+                                     static_cast<size_t>(FLAGS_spill_segment_mb)
+                                         << 20));
+    CHECK(spill_queue->Open()) << "Failed to spill to " << FLAGS_spill_dir;
+    read_thread.reset(new std::thread([this, &reader, chunk_ring,
+                                       &spill_queue] {
+      std::shared_ptr<const std::string> chunk;
+      while (ReadContent(reader.get(), chunk_ring, &chunk)) {
+        // The spill queue owns what it holds, as it may write it to disk.
+        // It fails if it can't, which the sender sees.
+        if (!spill_queue->Push(*chunk)) {
+          break;
+        }
+      }
+      spill_queue->Close();
+    }));
+  }
+
+  std::unique_ptr<Mp4FragmentParser> parser;
+  if (FLAGS_session_rollover_sec > 0) {
+    parser.reset(new Mp4FragmentParser());
+  }
+
+  // A resumed upload starts mid-file, so the init segment goes first.
+  if (resume_point_ != nullptr) {
+    const std::string& init_segment = resume_point_->init_segment;
+    if (parser != nullptr) {
+      std::vector<Mp4Fragment> fragments;
+      parser->Parse(init_segment.data(), init_segment.size(), &fragments);
+      first_fragment_time_us_ = resume_point_->first_fragment_time_us;
     }
-    std::string data(buffer.data(), num_bytes_read);
     if (player_ != nullptr) {
-      player_->InsertStreamData(data);
+      player_->InsertStreamData(init_segment);
+    }
+    if (!WriteContent(session_.get(), init_segment)) {
+      status = false;
+    }
+  }
+
+  // Sent from the same buffer that local storage and the player share.
+  std::shared_ptr<const std::string> chunk;
+
+  while (status) {
+    if (spill_queue != nullptr) {
+      std::string spilled;
+      if (!spill_queue->Pop(&spilled)) {
+        // Chunks were lost: the upload is incomplete, not done.
+        if (spill_queue->failed()) {
+          LOG(ERROR) << "Failed to spill video chunks, stopped sending.";
+          status = false;
+        }
+        break;
+      }
+      chunk = std::make_shared<const std::string>(std::move(spilled));
+    } else if (!ReadContent(reader.get(), chunk_ring, &chunk)) {
+      break;
     }
-    StreamingAnnotateVideoRequest req;
-    req.set_input_content(data);
-    if (!stream_->Write(req)) {
-      LOG(ERROR) << "Failed to send content: " << req.ShortDebugString();
+    const std::string& data = *chunk;
+    size_t sent = 0;
+    if (parser != nullptr &&
+        !MaybeRolloverSession(parser.get(), data, &sent)) {
       status = false;
       break;
     }
-    if (enable_local_storage_video) {
-      writer->WriteBytes(num_bytes_read, buffer.data());
+    if (sent == 0) {
+      status = WriteContent(session_.get(), data);
+    } else {
+      status = WriteContent(session_.get(), data.substr(sent));
+    }
+    if (!status) {
+      break;
     }
-    total_bytes_read += num_bytes_read;
-    requests_sent++;
+    content_offset_ += data.size();
   }
 
-  if (!stream_->WritesDone()) {
-    LOG(ERROR) << "Failed to mark WritesDone in gRPC stream.";
-    status = false;
+  if (read_thread != nullptr) {
+    // Unblocks the read thread if sending stopped early.
+    spill_queue->Close();
+    read_thread->join();
+  }
+  chunks.Close();
+  for (std::thread& thread : chunk_consumers) {
+    thread.join();
   }
 
   reader->Close();
@@ -248,10 +884,190 @@ bool StreamingClient::SendContent() {
     writer->Close();
   }
 
-  LOG(INFO) << "Sent " << requests_sent << " requests consisting of "
-            << total_bytes_read << " bytes of video data in total.";
+  LOG(INFO) << "Sent " << requests_sent_ << " requests consisting of "
+            << total_bytes_sent_ << " bytes of video data in total.";
   return status;
 }
 
+bool StreamingClient::AnnotateShards() {
+  // Removed with the shards on every return.
+  ScratchDir shard_dir;
+  if (!shard_dir.Create(FLAGS_shard_dir, "shards-")) {
+    return false;
+  }
+  std::vector<VideoShard> shards;
+  if (!ShardVideo(FLAGS_video_path, FLAGS_num_shards, shard_dir.path(),
+                  &shards)) {
+    return false;
+  }
+
+  std::vector<std::unique_ptr<Session>> sessions;
+  std::vector<std::thread> threads;
+  std::atomic<bool> status{true};
+  for (const VideoShard& shard : shards) {
+    sessions.push_back(OpenSession(shard.start_time_us));
+    Session* session = sessions.back().get();
+    session->buffer_results = true;
+    threads.emplace_back([this, session, &shard, &status] {
+      bool shard_status =
+          StartSession(session) && SendFile(session, shard.path);
+      if (!FinishSession(session) || !shard_status) {
+        LOG(ERROR) << "Failed to annotate " << shard.path;
+        status = false;
+      }
+      unlink(shard.path.c_str());
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  LOG(INFO) << "Sent " << requests_sent_ << " requests consisting of "
+            << total_bytes_sent_ << " bytes of video data in total.";
+
+  ShardMerger merger;
+  for (size_t i = 0; i < shards.size(); ++i) {
+    total_responses_received_ += sessions[i]->results.size();
+    merger.AddShard(shards[i].start_time_us,
+                    std::move(sessions[i]->results));
+  }
+  for (auto& results : merger.TakeResults()) {
+    std::shared_ptr<StreamingAnnotateVideoResponse> resp(
+        new StreamingAnnotateVideoResponse());
+    resp->mutable_annotation_results()->Swap(&results);
+    dispatcher_->Publish(resp);
+  }
+  return status;
+}
+
+bool StreamingClient::SendFile(Session* session, const std::string& path) {
+  FileReader reader(path);
+  if (!reader.Open()) {
+    return false;
+  }
+  bool status = true;
+  std::shared_ptr<const std::string> chunk;
+  while (status && ReadContent(&reader, nullptr, &chunk)) {
+    status = WriteContent(session, *chunk);
+  }
+  reader.Close();
+  return status;
+}
+
+bool StreamingClient::ReadContent(IOReader* reader, ChunkRing* chunks,
+                                  std::shared_ptr<const std::string>* chunk) {
+  // Read in place: the chunk is the only copy of the bytes.
+  std::shared_ptr<std::string> data =
+      std::make_shared<std::string>(DataChunkBytes(), '\0');
+  size_t num_bytes_read = reader->ReadBytes(data->size(), &(*data)[0]);
+  if (num_bytes_read == 0) {
+    return false;
+  }
+  data->resize(num_bytes_read);
+  if (chunks != nullptr) {
+    chunks->Publish(data);
+  }
+  *chunk = std::move(data);
+  return true;
+}
+
+void StreamingClient::StartChunkConsumers(ChunkRing* chunks, IOWriter* writer,
+                                          std::vector<std::thread>* threads) {
+  if (writer != nullptr) {
+    ChunkRing::Subscriber* subscriber =
+        chunks->Subscribe(OverflowPolicy::kBlock);
+    threads->emplace_back([subscriber, writer] {
+      std::shared_ptr<const std::string> chunk;
+      while (subscriber->Next(&chunk)) {
+        // Writers do not modify the data.
+        writer->WriteBytes(chunk->size(), const_cast<char*>(chunk->data()));
+      }
+    });
+  }
+  if (player_ != nullptr) {
+    // The player renders in real time, and only starts once annotations
+    // arrive, so it must not hold the upload up unless asked to.
+    ChunkRing::Subscriber* subscriber = chunks->Subscribe(PlayerPolicy());
+    MediaPlayer* player = player_;
+    threads->emplace_back([subscriber, player] {
+      std::shared_ptr<const std::string> chunk;
+      while (subscriber->Next(&chunk)) {
+        // Shares the chunk instead of copying it.
+        player->InsertStreamData(std::move(chunk));
+      }
+      player->EndStreamData();
+    });
+  }
+}
+
+bool StreamingClient::WriteContent(Session* session, const std::string& data) {
+  StreamingAnnotateVideoRequest req;
+  req.set_input_content(data);
+  if (!session->stream->Write(req)) {
+    LOG(ERROR) << "Failed to send content: " << req.ShortDebugString();
+    return false;
+  }
+  total_bytes_sent_ += data.size();
+  requests_sent_++;
+  return true;
+}
+
+bool StreamingClient::MaybeRolloverSession(Mp4FragmentParser* parser,
+                                           const std::string& data,
+                                           size_t* sent) {
+  *sent = 0;
+  if (parser->is_invalid()) {
+    return true;
+  }
+  int64_t chunk_offset = parser->bytes_parsed();
+  std::vector<Mp4Fragment> fragments;
+  if (!parser->Parse(data.data(), data.size(), &fragments)) {
+    LOG(WARNING) << "Session rollover is disabled: input is not a fragmented "
+                 << "MP4 stream.";
+    return true;
+  }
+  if (first_fragment_time_us_ < 0 && !fragments.empty()) {
+    first_fragment_time_us_ = fragments.front().decode_time_us;
+  }
+  if (std::chrono::system_clock::now() +
+          std::chrono::seconds(FLAGS_session_rollover_sec) <
+      session_->deadline) {
+    return true;
+  }
+
+  for (const Mp4Fragment& fragment : fragments) {
+    // The fragment must start within this chunk, so that none of it has been
+    // sent to the current session yet.
+    if (fragment.offset < chunk_offset) {
+      continue;
+    }
+    size_t split = fragment.offset - chunk_offset;
+    if (split > 0 && !WriteContent(session_.get(), data.substr(0, split))) {
+      return false;
+    }
+    *sent = split;
+
+    // Opens the next session before closing the current one so that there
+    // is no gap in annotations.
+    std::unique_ptr<Session> session =
+        OpenSession(fragment.decode_time_us - first_fragment_time_us_);
+    if (!StartSession(session.get()) ||
+        !WriteContent(session.get(), parser->init_segment())) {
+      return false;
+    }
+    LOG(INFO) << "Rolled over to a new session at media time "
+              << session->time_offset_us / 1e6 << "s.";
+    session_.swap(session);
+    Session* retired = session.get();
+    retired_sessions_.push_back(std::move(session));
+    retiring_threads_.emplace_back([this, retired] {
+      if (!FinishSession(retired)) {
+        retired_status_ = false;
+      }
+    });
+    return true;
+  }
+  return true;
+}
+
 }  // namespace video
 }  // namespace api
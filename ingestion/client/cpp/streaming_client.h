@@ -21,9 +21,17 @@
 #ifndef API_VIDEO_CLIENT_CPP_STREAMING_CLIENT_H_
 #define API_VIDEO_CLIENT_CPP_STREAMING_CLIENT_H_
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "client/cpp/broadcast_ring.h"
+#include "client/cpp/result_sink.h"
 #include "glog/logging.h"
 #include "grpc++/grpc++.h"
 #include "proto/video_intelligence_streaming.grpc.pb.h"
@@ -31,54 +39,236 @@
 namespace api {
 namespace video {
 
+class CachedResult;
+class IOReader;
+class IOWriter;
+class Mp4FragmentParser;
+class ProtoWriter;
+class ResultCache;
+class ResultDispatcher;
+class SegmentedWriter;
+struct ResumePoint;
+
 // Define this class because there is a weird conflict
 // between SDL and gRPC library on "Status".
 class MediaPlayer;
 
 class StreamingClient {
  public:
-  StreamingClient() = default;
+  StreamingClient();
   ~StreamingClient();
 
   // Disallows copy and assign.
   StreamingClient(const StreamingClient&) = delete;
   StreamingClient& operator=(const StreamingClient&) = delete;
 
+  // Connects to the service through `channel` instead of --endpoint, e.g.
+  // to a local or test server. Must be called before Init().
+  void UseChannel(std::shared_ptr<grpc::Channel> channel);
+
   // Initializes the client with gRPC connection.
   bool Init(int* argc_ptr, char*** argv_ptr);
 
+  // Reads the video content from `reader` instead of --video_path, e.g. to
+  // stream from another source. The client opens and closes it. Must be
+  // called before Run().
+  void UseInput(std::unique_ptr<IOReader> reader);
+
   // Runs the client.
   bool Run();
 
+  // Adds a function called with every annotation response, on its own
+  // thread behind a queue with the given overflow policy. Must be called
+  // before Run().
+  void AddResultCallback(
+      std::function<void(const SharedResponse& resp)> callback,
+      OverflowPolicy policy);
+
  private:
+  // One StreamingAnnotateVideo call. With session rollover, a long live
+  // stream is sent over several consecutive sessions.
+  struct Session {
+    // gRPC client context.
+    grpc::ClientContext context;
+    // gRPC call deadline.
+    std::chrono::system_clock::time_point deadline;
+    // gRPC stream.
+    std::unique_ptr<grpc::ClientReaderWriter<
+        google::cloud::videointelligence::v1p3beta1::
+            StreamingAnnotateVideoRequest,
+        google::cloud::videointelligence::v1p3beta1::
+            StreamingAnnotateVideoResponse>>
+        stream;
+    // Media time (in microseconds) at which this session's content starts.
+    // It is added to all annotation time offsets returned by this session.
+    int64_t time_offset_us = 0;
+    // Thread reading responses.
+    std::unique_ptr<std::thread> reader;
+    // If set, annotation results are kept in `results` for merging instead
+    // of being handled as they arrive.
+    bool buffer_results = false;
+    std::vector<google::cloud::videointelligence::v1p3beta1::
+                    StreamingVideoAnnotationResults>
+        results;
+  };
+
+  // Opens a new StreamingAnnotateVideo call.
+  std::unique_ptr<Session> OpenSession(int64_t time_offset_us);
+
+  // Sends the config request and starts reading responses of a session.
+  bool StartSession(Session* session);
+
+  // Half-closes a session, waits for its remaining responses and finishes the
+  // call.
+  bool FinishSession(Session* session);
+
   // Reads responses from the stream. NB: It performs a blocking read.
-  void ReadResponse();
+  void ReadResponse(Session* session);
+
+  // Starts the result sinks: log, result files, player and callbacks.
+  void StartSinks();
+
+  // Publishes a response to the result sinks. Requires `response_mutex_`.
+  void HandleResponse(
+      std::shared_ptr<const google::cloud::videointelligence::v1p3beta1::
+                          StreamingAnnotateVideoResponse>
+          resp);
+
+  // Reads streaming config from the config file.
+  bool LoadConfig();
+
+  // Loads the upload checkpoint, if any, and finds where to resume the
+  // upload. Sets `resume_point_` when resuming.
+  bool LoadCheckpoint();
+
+  // Writes an upload checkpoint if it is due, for results up to
+  // `acknowledged_time_us` of which `result_bytes` are in the result log, or
+  // in its segment `result_segment` when it is segmented.
+  void MaybeWriteCheckpoint(int64_t acknowledged_time_us,
+                            int64_t result_segment, int64_t result_bytes);
+
+  // Whether an upload checkpoint is due.
+  bool CheckpointDue();
+
+  // Opens the result cache, if enabled, and prepares to record responses.
+  bool OpenCache();
+
+  // Looks up cached responses for the video file. Returns false on a miss.
+  bool LookupCache(CachedResult* cached_result);
+
+  // Replays cached responses instead of calling the service.
+  bool ReplayCache(std::shared_ptr<const CachedResult> cached_result);
 
   // Write streaming config to the stream.
-  bool SendConfig();
+  bool SendConfig(Session* session);
 
   // Reads content chunks from video path and writes them to the stream.
   bool SendContent();
 
+  // Splits the video file into shards, annotates them over concurrent
+  // sessions and merges the results.
+  bool AnnotateShards();
+
+  // Sends a whole file to a session.
+  bool SendFile(Session* session, const std::string& path);
+
+  // Content chunks shared with the threads that consume them besides the
+  // sender.
+  using ChunkRing =
+      BroadcastRing<std::shared_ptr<const std::string>, QueueStats>;
+
+  // Reads the next content chunk from `reader` into `chunk`, and publishes
+  // the same chunk to `chunks` (if not null). Returns false at the end of
+  // input.
+  bool ReadContent(IOReader* reader, ChunkRing* chunks,
+                   std::shared_ptr<const std::string>* chunk);
+
+  // Subscribes threads to `chunks` that write them to local storage `writer`
+  // (if not null) and insert them into the media player (if enabled). The
+  // threads exit once `chunks` is closed.
+  void StartChunkConsumers(ChunkRing* chunks, IOWriter* writer,
+                           std::vector<std::thread>* threads);
+
+  // Writes a content chunk to a session.
+  bool WriteContent(Session* session, const std::string& data);
+
+  // If the current session is close to its deadline and `data` contains a
+  // fragment boundary, sends the bytes before the boundary, then cuts over to
+  // a new session starting with the init segment. Sets `sent` to the bytes
+  // of `data` sent before the cut; the rest goes to the current session.
+  bool MaybeRolloverSession(Mp4FragmentParser* parser, const std::string& data,
+                            size_t* sent);
+
   // Unique pointer to a StreamingVideoIntelligenceServive stub.
   std::unique_ptr<google::cloud::videointelligence::v1p3beta1::
                       StreamingVideoIntelligenceService::Stub>
       stub_;
   // Shared pointer to the communication channel to the backend.
   std::shared_ptr<grpc::Channel> channel_;
-  // gRPC client context.
-  grpc::ClientContext context_;
-  // Shared pointer to gRPC stream.
-  std::shared_ptr<grpc::ClientReaderWriter<
-      google::cloud::videointelligence::v1p3beta1::
-          StreamingAnnotateVideoRequest,
-      google::cloud::videointelligence::v1p3beta1::
-          StreamingAnnotateVideoResponse>>
-      stream_;
+  // Content input set by UseInput(), null to read --video_path.
+  std::unique_ptr<IOReader> input_;
+  // Current streaming session.
+  std::unique_ptr<Session> session_;
+  // Sessions that have been rolled over, and threads finishing them.
+  std::vector<std::unique_ptr<Session>> retired_sessions_;
+  std::vector<std::thread> retiring_threads_;
+  // Whether all retired sessions finished successfully.
+  std::atomic<bool> retired_status_{true};
+  // Config request sent at the start of every session.
+  google::cloud::videointelligence::v1p3beta1::StreamingAnnotateVideoRequest
+      config_req_;
   // Streaming feature.
   google::cloud::videointelligence::v1p3beta1::StreamingFeature feature_;
+  // Decode time of the first fragment, used as time origin across sessions.
+  int64_t first_fragment_time_us_ = -1;
+  // Content requests and bytes sent over all sessions.
+  std::atomic<int> requests_sent_{0};
+  std::atomic<long> total_bytes_sent_{0};
+  // Serializes response handling when two sessions overlap.
+  std::mutex response_mutex_;
+  int total_responses_received_ = 0;
+  // Local storage for annotation results, in one file or in segments.
+  std::unique_ptr<ProtoWriter> result_writer_;
+  std::unique_ptr<SegmentedWriter> result_segments_;
+  // Result sinks, and user callbacks to add as sinks.
+  std::unique_ptr<ResultDispatcher> dispatcher_;
+  std::vector<std::pair<std::function<void(const SharedResponse& resp)>,
+                        OverflowPolicy>>
+      result_callbacks_;
+  // Upload id kept across resumed runs. Guarded by `checkpoint_mutex_`.
+  std::string upload_session_id_;
+  // Where this run resumes the upload, null when starting from the beginning.
+  std::unique_ptr<ResumePoint> resume_point_;
+  // Size of the annotation result log, or of its segment
+  // `resume_result_segment_`, to continue from when resuming.
+  int64_t resume_result_segment_ = 0;
+  int64_t resume_result_bytes_ = 0;
+  // Results up to this media time were logged before resuming, and are
+  // dropped when received again.
+  int64_t resume_acknowledged_time_us_ = -1;
+  // Latest media time (in microseconds) of received annotations.
+  int64_t acknowledged_time_us_ = -1;
+  // Video file offset after the last content byte sent.
+  std::atomic<int64_t> content_offset_{0};
+  // When the next upload checkpoint is due. Guarded by `checkpoint_mutex_`.
+  std::chrono::steady_clock::time_point next_checkpoint_time_;
+  // Checkpoints are written by the result file sink, so they are not
+  // serialized by `response_mutex_`.
+  std::mutex checkpoint_mutex_;
+  // Result cache, null if disabled.
+  std::unique_ptr<ResultCache> result_cache_;
+  // Digest of the video file from the cache lookup, for storing responses.
+  std::string content_digest_;
+  // Responses recorded for the cache, null if not recording. Guarded by
+  // `response_mutex_`.
+  std::unique_ptr<CachedResult> cache_entry_;
+  // When streaming started.
+  std::chrono::steady_clock::time_point start_time_;
+  // Whether Run() started logging queue stats, and must stop it.
+  bool logging_queue_stats_ = false;
   // Media player.
   MediaPlayer* player_ = nullptr;
+  std::unique_ptr<std::thread> player_thread_;
 };
 
 }  // namespace video
@@ -21,65 +21,216 @@
 #ifndef API_VIDEO_CLIENT_CPP_SYNC_QUEUE_H_
 #define API_VIDEO_CLIENT_CPP_SYNC_QUEUE_H_
 
+#include <chrono>
 #include <climits>
 #include <condition_variable>
 #include <mutex>
 #include <queue>
+#include <utility>
+#include <vector>
+
+#include "client/cpp/queue_stats.h"
 
 namespace api {
 namespace video {
 
+// Result of a timed pop.
+enum class QueueStatus {
+  // An element was popped.
+  kOk,
+  // The timeout expired first.
+  kTimeout,
+  // The queue is closed and drained.
+  kClosed,
+};
+
+// What a bounded queue does with an element when it is full.
+enum class OverflowPolicy {
+  // Waits for room. Nothing is lost, but a slow consumer slows down the
+  // producer.
+  kBlock,
+  // Drops the element being pushed.
+  kDropNewest,
+  // Drops the oldest queued elements to make room.
+  kDropOldest,
+};
+
+// Sizes every element as 1, so that a queue is bounded by its length.
+struct ElementCount {
+  template <class T>
+  size_t operator()(const T&) const {
+    return 1;
+  }
+};
+
+// Sizes a string or other container of bytes by its payload, so that a
+// queue is bounded by the bytes it holds.
+struct PayloadBytes {
+  template <class T>
+  size_t operator()(const T& val) const {
+    return val.size();
+  }
+};
+
 // Implements a thread-safe synchronous queue.
 // More sophisticated implementation is 'ConcurrentLinkedQueue'.
 // https://stackoverflow.com/questions/1426754/linkedblockingqueue-vs-concurrentlinkedqueue
-template <class T>
+//
+// The queue holds up to a total size of elements, as measured by `SizeOf`:
+// by default a number of elements, or e.g. bytes with PayloadBytes. An
+// element larger than the whole budget is still accepted into an empty
+// queue. When the queue is full, pushes follow the overflow policy.
+//
+// `Stats` is the statistics policy, see queue_stats.h.
+//
+// Close() marks the end of the stream: pushes fail from then on, and pops
+// drain what is left, then fail instead of blocking.
+template <class T, class SizeOf = ElementCount, class Stats = NoQueueStats>
 class SyncQueue {
  public:
   // Constructs an empty thread-safe synchronous queue.
-  // Maximum queue size allowed is set in input argument.
-  explicit SyncQueue(size_t max_size = INT_MAX) : max_size_(max_size) {}
+  // Maximum total size allowed is set in input argument.
+  explicit SyncQueue(size_t max_size = INT_MAX,
+                     OverflowPolicy policy = OverflowPolicy::kBlock,
+                     SizeOf size_of = SizeOf())
+      : max_size_(max_size), policy_(policy), size_of_(size_of) {}
 
   // Destructs a synchronous queue.
   ~SyncQueue() = default;
 
-  // Pushes an element into synchronous queue. This method returns only after
-  // successfully pushing the element into the queue.
-  void Push(T& val) {
+  // Pushes an element into synchronous queue, moving from `val`. When the
+  // queue is full, this method returns only after successfully pushing the
+  // element into the queue, unless the policy drops elements. Returns false
+  // if the element is dropped or the queue is closed.
+  bool Push(T& val) { return Emplace(std::move(val)); }
+  bool Push(T&& val) { return Emplace(std::move(val)); }
+
+  // Constructs an element at the back of the queue. Waits and fails like
+  // Push().
+  template <class... Args>
+  bool Emplace(Args&&... args) {
+    Entry entry{T(std::forward<Args>(args)...)};
+    entry.size = size_of_(entry.val);
     std::unique_lock<std::mutex> lock(m_);
-    cond_var_element_popped_.wait(
-        lock, [this] { return q_.size() < this->max_size_; });
-    q_.push(std::move(val));
-    cond_var_element_pushed_.notify_one();
+    if (policy_ == OverflowPolicy::kBlock && !closed_ && !Fits(entry.size)) {
+      typename Stats::Stamp since = Stats::Now();
+      cond_var_element_popped_.wait(
+          lock, [this, &entry] { return closed_ || Fits(entry.size); });
+      stats_.ProducerBlocked(since);
+    }
+    return PushLocked(&entry);
   }
 
   // Tries to push an element into synchronous queue.
-  // It returns true if the element is successfully pushed,
-  // otherwise returns false because queue is full.
+  // It returns true if the element is successfully pushed, otherwise returns
+  // false because queue is full or closed. The kDropOldest policy still
+  // makes room.
   bool TryPush(T& val) {
+    size_t size = size_of_(val);
     std::lock_guard<std::mutex> lock(m_);
-    if (q_.size() < max_size_) {
-      q_.push(std::move(val));
-      cond_var_element_pushed_.notify_one();
-      return true;
+    if (closed_ ||
+        (policy_ != OverflowPolicy::kDropOldest && !Fits(size))) {
+      return false;
     }
-    return false;
+    Entry entry(std::move(val));
+    entry.size = size;
+    return PushLocked(&entry);
   }
 
-  // Pops an element from synchronous queue.
-  T Pop() {
+  // Pushes all elements of `vals` in order, moving from them, and taking the
+  // lock once for as many as fit. Waits and drops like Push(). Returns false
+  // if the queue is closed before all are pushed, or any is dropped.
+  bool PushBatch(std::vector<T>* vals) {
+    bool ok = true;
     std::unique_lock<std::mutex> lock(m_);
-    cond_var_element_pushed_.wait(lock, [this] { return !q_.empty(); });
-    T val = std::move(q_.front());
-    q_.pop();
-    cond_var_element_popped_.notify_one();
+    for (T& val : *vals) {
+      Entry entry(std::move(val));
+      entry.size = size_of_(entry.val);
+      if (policy_ == OverflowPolicy::kBlock && !closed_ &&
+          !Fits(entry.size)) {
+        cond_var_element_pushed_.notify_all();
+        typename Stats::Stamp since = Stats::Now();
+        cond_var_element_popped_.wait(
+            lock, [this, &entry] { return closed_ || Fits(entry.size); });
+        stats_.ProducerBlocked(since);
+      }
+      if (closed_) {
+        return false;
+      }
+      ok = PushLocked(&entry, false) && ok;
+    }
+    cond_var_element_pushed_.notify_all();
+    return ok;
+  }
+
+  // Pops an element from synchronous queue. Returns a default-constructed
+  // element if the queue is closed and drained.
+  T Pop() {
+    T val = T();
+    Pop(&val);
     return val;
   }
 
+  // Pops an element into `val`. Returns false if the queue is closed and
+  // drained.
+  bool Pop(T* val) {
+    std::unique_lock<std::mutex> lock(m_);
+    WaitForElement(&lock);
+    return PopLocked(val);
+  }
+
+  // Pops an element into `val`, waiting for at most `timeout`.
+  template <class Rep, class Period>
+  QueueStatus PopFor(T* val,
+                     const std::chrono::duration<Rep, Period>& timeout) {
+    std::unique_lock<std::mutex> lock(m_);
+    if (!closed_ && q_.empty()) {
+      typename Stats::Stamp since = Stats::Now();
+      bool ready = cond_var_element_pushed_.wait_for(
+          lock, timeout, [this] { return closed_ || !q_.empty(); });
+      stats_.ConsumerStarved(since);
+      if (!ready) {
+        return QueueStatus::kTimeout;
+      }
+    }
+    return PopLocked(val) ? QueueStatus::kOk : QueueStatus::kClosed;
+  }
+
+  // Waits for at least one element, then pops up to `max_n` elements into
+  // `vals`, which is cleared first. Returns the number popped, 0 if the queue
+  // is closed and drained.
+  size_t PopBatch(std::vector<T>* vals, size_t max_n) {
+    vals->clear();
+    std::unique_lock<std::mutex> lock(m_);
+    WaitForElement(&lock);
+    while (vals->size() < max_n && !q_.empty()) {
+      total_size_ -= q_.front().size;
+      vals->push_back(std::move(q_.front().val));
+      typename Stats::Stamp enqueued = q_.front().enqueued;
+      q_.pop();
+      stats_.Popped(q_.size(), enqueued);
+    }
+    if (!vals->empty()) {
+      cond_var_element_popped_.notify_all();
+    }
+    return vals->size();
+  }
+
+  // Closes the queue and wakes all waiters.
+  void Close() {
+    std::lock_guard<std::mutex> lock(m_);
+    closed_ = true;
+    cond_var_element_pushed_.notify_all();
+    cond_var_element_popped_.notify_all();
+  }
+
   void Clear() {
     std::lock_guard<std::mutex> lock(m_);
     while (!q_.empty()) {
       q_.pop();
     }
+    total_size_ = 0;
+    cond_var_element_popped_.notify_all();
   }
 
   // Gets queue size.
@@ -88,11 +239,104 @@ class SyncQueue {
     return q_.size();
   }
 
+  // Gets the total size of the queued elements, as measured by `SizeOf`.
+  size_t TotalSize() {
+    std::lock_guard<std::mutex> lock(m_);
+    return total_size_;
+  }
+
+  // Gets the number of elements dropped by the overflow policy.
+  size_t Dropped() {
+    std::lock_guard<std::mutex> lock(m_);
+    return dropped_;
+  }
+
+  // Gets the statistics, e.g. to Register() them.
+  Stats* stats() { return &stats_; }
+
  private:
+  // A queued element with its size.
+  struct Entry {
+    explicit Entry(T value) : val(std::move(value)) {}
+
+    T val;
+    size_t size = 0;
+    typename Stats::Stamp enqueued;
+  };
+
+  // Waits until the queue has an element or is closed.
+  void WaitForElement(std::unique_lock<std::mutex>* lock) {
+    if (!closed_ && q_.empty()) {
+      typename Stats::Stamp since = Stats::Now();
+      cond_var_element_pushed_.wait(
+          *lock, [this] { return closed_ || !q_.empty(); });
+      stats_.ConsumerStarved(since);
+    }
+  }
+
+  // Whether an element of `size` fits. Must be called with `m_` held.
+  bool Fits(size_t size) const {
+    return q_.empty() || total_size_ + size <= max_size_;
+  }
+
+  // Pushes `entry` if the queue is open, applying the overflow policy if it
+  // is full. Must be called with `m_` held, and with kBlock only once the
+  // entry fits.
+  bool PushLocked(Entry* entry, bool notify = true) {
+    if (closed_) {
+      return false;
+    }
+    if (!Fits(entry->size)) {
+      if (policy_ != OverflowPolicy::kDropOldest) {
+        ++dropped_;
+        return false;
+      }
+      while (!Fits(entry->size)) {
+        total_size_ -= q_.front().size;
+        q_.pop();
+        ++dropped_;
+      }
+    }
+    total_size_ += entry->size;
+    entry->enqueued = Stats::Now();
+    q_.push(std::move(*entry));
+    stats_.Pushed(q_.size());
+    if (notify) {
+      cond_var_element_pushed_.notify_one();
+    }
+    return true;
+  }
+
+  // Pops the front element into `val` if any. Must be called with `m_` held.
+  bool PopLocked(T* val) {
+    if (q_.empty()) {
+      return false;
+    }
+    total_size_ -= q_.front().size;
+    *val = std::move(q_.front().val);
+    typename Stats::Stamp enqueued = q_.front().enqueued;
+    q_.pop();
+    stats_.Popped(q_.size(), enqueued);
+    cond_var_element_popped_.notify_one();
+    return true;
+  }
+
   // Storage queue.
-  std::queue<T> q_;
-  // Queue max size.
-  const int max_size_;
+  std::queue<Entry> q_;
+  // Queue max total size.
+  const size_t max_size_;
+  // What to do when the queue is full.
+  const OverflowPolicy policy_;
+  // Sizes elements.
+  SizeOf size_of_;
+  // Total size of the queued elements.
+  size_t total_size_ = 0;
+  // Elements dropped by the overflow policy.
+  size_t dropped_ = 0;
+  // Statistics.
+  Stats stats_;
+  // Whether Close() has been called.
+  bool closed_ = false;
   // Mutex.
   mutable std::mutex m_;
   // Condition variables.
@@ -20,10 +20,13 @@
 
 #include "client/cpp/sync_queue.h"
 
+#include <chrono>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -167,6 +170,113 @@ TEST_F(SyncQueueTest, SyncQueueUniquePtrPush) {
   new_thread.join();
   EXPECT_EQ(2, q_no_elements_->Size());
 }
+
+// Tests pushing and popping in batches, with batches larger than the queue.
+TEST(SyncQueueBatchTest, PushPopBatch) {
+  SyncQueue<int> q(3);
+  std::thread producer([&q] {
+    std::vector<int> vals = {1, 2, 3, 4, 5, 6, 7};
+    EXPECT_TRUE(q.PushBatch(&vals));
+    q.Close();
+  });
+  std::vector<int> popped;
+  std::vector<int> batch;
+  while (q.PopBatch(&batch, 2) > 0) {
+    EXPECT_LE(batch.size(), 2);
+    popped.insert(popped.end(), batch.begin(), batch.end());
+  }
+  producer.join();
+  EXPECT_EQ(std::vector<int>({1, 2, 3, 4, 5, 6, 7}), popped);
+}
+
+// Tests timed pops.
+TEST(SyncQueueBatchTest, PopFor) {
+  SyncQueue<int> q;
+  int val = 0;
+  EXPECT_EQ(QueueStatus::kTimeout,
+            q.PopFor(&val, std::chrono::milliseconds(1)));
+  q.Push(5);
+  EXPECT_EQ(QueueStatus::kOk, q.PopFor(&val, std::chrono::milliseconds(1)));
+  EXPECT_EQ(5, val);
+  q.Close();
+  EXPECT_EQ(QueueStatus::kClosed,
+            q.PopFor(&val, std::chrono::milliseconds(1)));
+}
+
+// Tests that Close() wakes blocked producers and consumers, and that pending
+// elements are still drained.
+TEST(SyncQueueBatchTest, Close) {
+  SyncQueue<std::unique_ptr<int>> q(1);
+  EXPECT_TRUE(q.Emplace(new int(1)));
+  std::thread producer([&q] {
+    // Blocks until closed.
+    EXPECT_FALSE(q.Emplace(new int(2)));
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  q.Close();
+  producer.join();
+  std::unique_ptr<int> val;
+  EXPECT_TRUE(q.Pop(&val));
+  EXPECT_EQ(1, *val);
+  EXPECT_FALSE(q.Pop(&val));
+  EXPECT_EQ(nullptr, q.Pop());
+
+  SyncQueue<int> empty;
+  std::thread consumer([&empty] {
+    int val;
+    // Blocks until closed.
+    EXPECT_FALSE(empty.Pop(&val));
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  empty.Close();
+  consumer.join();
+  int a = 1;
+  EXPECT_FALSE(empty.TryPush(a));
+}
+
+// Tests a queue bounded in bytes.
+TEST(SyncQueueBudgetTest, PayloadBytes) {
+  SyncQueue<std::string, PayloadBytes> q(10);
+  std::string a(6, 'a');
+  std::string b(6, 'b');
+  EXPECT_TRUE(q.TryPush(a));
+  EXPECT_FALSE(q.TryPush(b));
+  EXPECT_EQ(6, b.size());
+  EXPECT_EQ(6, q.TotalSize());
+  EXPECT_EQ(std::string(6, 'a'), q.Pop());
+  // An element over the whole budget still goes into an empty queue.
+  EXPECT_TRUE(q.Push(std::string(20, 'c')));
+  EXPECT_EQ(20, q.TotalSize());
+
+  // A blocked push goes through once enough bytes are popped.
+  std::thread producer([&q] { EXPECT_TRUE(q.Push(std::string(4, 'd'))); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(1, q.Size());
+  EXPECT_EQ(20, q.Pop().size());
+  producer.join();
+  EXPECT_EQ(4, q.TotalSize());
+  EXPECT_EQ(0, q.Dropped());
+}
+
+// Tests the dropping overflow policies.
+TEST(SyncQueueBudgetTest, Drop) {
+  SyncQueue<std::string, PayloadBytes> newest(10, OverflowPolicy::kDropNewest);
+  EXPECT_TRUE(newest.Push(std::string(6, 'a')));
+  EXPECT_FALSE(newest.Push(std::string(6, 'b')));
+  EXPECT_TRUE(newest.Push(std::string(4, 'c')));
+  EXPECT_EQ(1, newest.Dropped());
+  EXPECT_EQ(std::string(6, 'a'), newest.Pop());
+
+  SyncQueue<std::string, PayloadBytes> oldest(10, OverflowPolicy::kDropOldest);
+  EXPECT_TRUE(oldest.Push(std::string(3, 'a')));
+  EXPECT_TRUE(oldest.Push(std::string(3, 'b')));
+  std::vector<std::string> batch = {std::string(3, 'c'), std::string(8, 'd')};
+  EXPECT_TRUE(oldest.PushBatch(&batch));
+  EXPECT_EQ(3, oldest.Dropped());
+  EXPECT_EQ(8, oldest.TotalSize());
+  EXPECT_EQ(std::string(8, 'd'), oldest.Pop());
+}
+
 }  // namespace
 }  // namespace video
 }  // namespace api
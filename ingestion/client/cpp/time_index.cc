@@ -0,0 +1,153 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/time_index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+namespace {
+
+using ::google::protobuf::io::CodedInputStream;
+using ::google::protobuf::io::CodedOutputStream;
+
+constexpr char kMagic[] = "AVTIDX01";
+constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+
+int64_t ReadInt64(const char* data) {
+  uint64_t value;
+  CodedInputStream::ReadLittleEndian64FromArray(
+      reinterpret_cast<const uint8_t*>(data), &value);
+  return static_cast<int64_t>(value);
+}
+
+}  // namespace
+
+std::string TimeIndexPath(const std::string& path) { return path + ".idx"; }
+
+void AppendTimeIndexHeader(std::string* out) {
+  out->append(kMagic, kMagicSize);
+}
+
+void AppendTimeIndexEntry(int64_t time_us, int64_t offset, std::string* out) {
+  uint8_t entry[kTimeIndexEntrySize];
+  uint8_t* end = CodedOutputStream::WriteLittleEndian64ToArray(
+      static_cast<uint64_t>(time_us), entry);
+  CodedOutputStream::WriteLittleEndian64ToArray(static_cast<uint64_t>(offset),
+                                                end);
+  out->append(reinterpret_cast<char*>(entry), kTimeIndexEntrySize);
+}
+
+bool TruncateTimeIndex(const std::string& path, int64_t max_offset) {
+  size_t num_entries = 0;
+  {
+    TimeIndex index;
+    if (!index.Open(path)) {
+      return false;
+    }
+    // Entry offsets increase, so the entries to keep are a prefix.
+    while (num_entries < index.size() &&
+           index.entry_offset(num_entries) < max_offset) {
+      ++num_entries;
+    }
+  }
+  off_t size = kMagicSize + num_entries * kTimeIndexEntrySize;
+  if (truncate(path.c_str(), size) != 0) {
+    LOG(ERROR) << "Failed to truncate " << path << ": " << strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+TimeIndex::~TimeIndex() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), data_size_);
+  }
+}
+
+bool TimeIndex::Open(const std::string& path) {
+  CHECK(data_ == nullptr) << "Time index is already open";
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(ERROR) << "Failed to open time index " << path << ": "
+               << strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(kMagicSize)) {
+    LOG(ERROR) << "Invalid time index " << path;
+    close(fd);
+    return false;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "Failed to map time index " << path << ": "
+               << strerror(errno);
+    return false;
+  }
+  data_ = static_cast<const char*>(data);
+  data_size_ = st.st_size;
+  if (memcmp(data_, kMagic, kMagicSize) != 0) {
+    LOG(ERROR) << "Invalid time index " << path;
+    return false;
+  }
+  // A partially written last entry is ignored.
+  num_entries_ = (data_size_ - kMagicSize) / kTimeIndexEntrySize;
+  return true;
+}
+
+int64_t TimeIndex::FindOffset(int64_t time_us) const {
+  // Finds the last entry with a time before `time_us`: all records before
+  // it are earlier.
+  size_t begin = 0;
+  size_t end = num_entries_;
+  while (begin < end) {
+    size_t middle = begin + (end - begin) / 2;
+    if (entry_time_us(middle) < time_us) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  return begin > 0 ? entry_offset(begin - 1) : 0;
+}
+
+int64_t TimeIndex::entry_time_us(size_t i) const {
+  return ReadInt64(data_ + kMagicSize + i * kTimeIndexEntrySize);
+}
+
+int64_t TimeIndex::entry_offset(size_t i) const {
+  return ReadInt64(data_ + kMagicSize + i * kTimeIndexEntrySize + 8);
+}
+
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,92 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_TIME_INDEX_H_
+#define API_VIDEO_CLIENT_CPP_TIME_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace api {
+namespace video {
+
+// A time index is a sidecar file of a proto log, mapping media time to byte
+// offsets so that a reader can seek to a time without parsing the log from
+// the start. It has an 8-byte magic followed by fixed-size entries, which
+// can be binary searched in place:
+//   int64 time_us  Latest media time of all records before `offset`, or -1.
+//   int64 offset   Byte offset of a record in the log.
+// Both are little-endian. Entries are written every N records, in log
+// order, with non-decreasing times.
+
+// Size of an index entry.
+constexpr size_t kTimeIndexEntrySize = 16;
+
+// Gets the path of the time index of the log at `path`.
+std::string TimeIndexPath(const std::string& path);
+
+// Appends the index magic to `out`.
+void AppendTimeIndexHeader(std::string* out);
+
+// Appends an index entry to `out`.
+void AppendTimeIndexEntry(int64_t time_us, int64_t offset, std::string* out);
+
+// Truncates the index at `path` to the entries with offsets below
+// `max_offset`, when its log is truncated to `max_offset` bytes. Returns
+// false if the index can't be read or truncated.
+bool TruncateTimeIndex(const std::string& path, int64_t max_offset);
+
+// A memory-mapped time index.
+class TimeIndex {
+ public:
+  TimeIndex() = default;
+  ~TimeIndex();
+
+  // Disallows copy and assign.
+  TimeIndex(const TimeIndex&) = delete;
+  TimeIndex& operator=(const TimeIndex&) = delete;
+
+  // Maps the index at `path`.
+  bool Open(const std::string& path);
+
+  // Gets the offset of a record such that all records with media times from
+  // `time_us` are at or after it. It's the latest such indexed record, found
+  // in O(log n).
+  int64_t FindOffset(int64_t time_us) const;
+
+  // Gets the number of entries.
+  size_t size() const { return num_entries_; }
+
+  // Gets the time and offset of the i-th entry.
+  int64_t entry_time_us(size_t i) const;
+  int64_t entry_offset(size_t i) const;
+
+ private:
+  // Mapped file, null if not open.
+  const char* data_ = nullptr;
+  size_t data_size_ = 0;
+  size_t num_entries_ = 0;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_TIME_INDEX_H_
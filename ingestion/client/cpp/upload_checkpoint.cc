@@ -0,0 +1,129 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/upload_checkpoint.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#include "client/cpp/mp4_fragment_parser.h"
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+namespace {
+// Read size while scanning boxes: 64 KBytes.
+constexpr int kScanChunk = 64 * 1024;
+}  // namespace
+
+bool ReadUploadCheckpoint(const std::string& path,
+                          UploadCheckpoint* checkpoint) {
+  CHECK(checkpoint != nullptr);
+  std::ifstream input(path, std::ifstream::binary);
+  if (!input.is_open()) {
+    return false;
+  }
+  if (!checkpoint->ParseFromIstream(&input)) {
+    LOG(ERROR) << "Failed to parse checkpoint " << path;
+    return false;
+  }
+  return true;
+}
+
+bool WriteUploadCheckpoint(const std::string& path,
+                           const UploadCheckpoint& checkpoint) {
+  // Writes a temporary file and renames it, so that a crash never leaves a
+  // partially written checkpoint behind.
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream output(tmp_path, std::ofstream::binary);
+    if (!output.is_open() || !checkpoint.SerializeToOstream(&output)) {
+      LOG(ERROR) << "Failed to write checkpoint " << tmp_path;
+      return false;
+    }
+  }
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG(ERROR) << "Failed to rename checkpoint " << tmp_path << " to " << path;
+    return false;
+  }
+  return true;
+}
+
+bool FindResumePoint(const std::string& video_path,
+                     const UploadCheckpoint& checkpoint, ResumePoint* point) {
+  CHECK(point != nullptr);
+  *point = ResumePoint();
+  std::ifstream input(video_path, std::ifstream::binary);
+  if (!input.is_open()) {
+    LOG(ERROR) << "Failed to open read file " << video_path;
+    return false;
+  }
+
+  // Only box headers and metadata are read; media data is seeked over.
+  Mp4FragmentParser parser;
+  std::vector<Mp4Fragment> fragments;
+  std::vector<char> buffer(kScanChunk);
+  while (parser.bytes_parsed() < checkpoint.byte_offset()) {
+    uint64_t skip = parser.skippable_bytes();
+    if (skip > 0) {
+      skip = std::min<uint64_t>(
+          skip, checkpoint.byte_offset() - parser.bytes_parsed());
+      input.seekg(skip, std::ifstream::cur);
+      parser.Skip(skip);
+      continue;
+    }
+    input.read(buffer.data(), buffer.size());
+    if (input.gcount() <= 0) {
+      break;
+    }
+    fragments.clear();
+    if (!parser.Parse(buffer.data(), input.gcount(), &fragments)) {
+      LOG(WARNING) << video_path << " is not a fragmented MP4 file, upload "
+                   << "restarts from the beginning.";
+      *point = ResumePoint();
+      return true;
+    }
+    for (const Mp4Fragment& fragment : fragments) {
+      if (point->first_fragment_time_us < 0) {
+        point->first_fragment_time_us = fragment.decode_time_us;
+      }
+      int64_t time_offset_us =
+          fragment.decode_time_us - point->first_fragment_time_us;
+      if (fragment.offset > checkpoint.byte_offset() ||
+          time_offset_us > checkpoint.acknowledged_time_us()) {
+        return true;
+      }
+      point->offset = fragment.offset;
+      point->time_offset_us = time_offset_us;
+      point->init_segment = parser.init_segment();
+    }
+    // Parsing over-reads past skippable media data; rewinds to the parser.
+    input.clear();
+    input.seekg(parser.bytes_parsed(), std::ifstream::beg);
+  }
+  return true;
+}
+
+}  // namespace video
+}  // namespace api
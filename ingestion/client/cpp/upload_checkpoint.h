@@ -0,0 +1,63 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_UPLOAD_CHECKPOINT_H_
+#define API_VIDEO_CLIENT_CPP_UPLOAD_CHECKPOINT_H_
+
+#include <cstdint>
+#include <string>
+
+#include "proto/upload_checkpoint.pb.h"
+
+namespace api {
+namespace video {
+
+// Where a resumed upload starts.
+struct ResumePoint {
+  // Byte offset in the video file of the first content byte to send.
+  int64_t offset = 0;
+  // Media time (in microseconds) of the content at `offset`.
+  int64_t time_offset_us = 0;
+  // Decode time of the first fragment in the file, which is media time 0.
+  int64_t first_fragment_time_us = -1;
+  // Container init segment to send before resuming mid-file. Empty when
+  // resuming from the beginning of the file.
+  std::string init_segment;
+};
+
+// Reads a checkpoint file. Returns false if it doesn't exist or is corrupted.
+bool ReadUploadCheckpoint(const std::string& path,
+                          UploadCheckpoint* checkpoint);
+
+// Atomically replaces a checkpoint file.
+bool WriteUploadCheckpoint(const std::string& path,
+                           const UploadCheckpoint& checkpoint);
+
+// Finds where to resume uploading a fragmented MP4 file: the last fragment
+// (which starts with a keyframe) that was fully sent and whose media time is
+// not later than the acknowledged media time of `checkpoint`. Falls back to
+// the beginning of the file if there is no such fragment.
+bool FindResumePoint(const std::string& video_path,
+                     const UploadCheckpoint& checkpoint, ResumePoint* point);
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_UPLOAD_CHECKPOINT_H_
@@ -0,0 +1,302 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/video_recorder.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+#include <libavutil/avutil.h>
+}
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "client/cpp/file_writer.h"
+#include "client/cpp/fmp4_muxer.h"
+#include "client/cpp/time_index.h"
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+namespace {
+
+// Size of the AVIO buffers: 64 KBytes.
+constexpr int kIoBufferSize = 64 * 1024;
+// Max input queued for remuxing: 64 MBytes. Writes wait beyond it.
+constexpr size_t kMaxInputBytes = 64 << 20;
+
+// Makes a custom AVIO context that reads or writes through `opaque`.
+AVIOContext* AllocIo(void* opaque,
+                     int (*read)(void* opaque, uint8_t* buffer, int size),
+                     int (*write)(void* opaque, uint8_t* buffer, int size)) {
+  uint8_t* buffer = static_cast<uint8_t*>(av_malloc(kIoBufferSize));
+  if (buffer == nullptr) {
+    return nullptr;
+  }
+  AVIOContext* io = avio_alloc_context(buffer, kIoBufferSize,
+                                       write != nullptr, opaque, read, write,
+                                       nullptr);
+  if (io == nullptr) {
+    av_free(buffer);
+  }
+  return io;
+}
+
+// Frees a custom AVIO context and its buffer.
+void FreeIo(AVIOContext** io) {
+  if (*io != nullptr) {
+    av_freep(&(*io)->buffer);
+    av_freep(io);
+  }
+}
+
+}  // namespace
+
+VideoRecorder::VideoRecorder(const std::string& path,
+                             const SegmentedWriter::Options& options)
+    : IOWriter(path),
+      segments_(path, options, [](const std::string& segment_path) {
+        return std::unique_ptr<IOWriter>(new FileWriter(segment_path));
+      }),
+      input_(kMaxInputBytes) {
+  input_.stats()->Register("video_recorder_input");
+}
+
+VideoRecorder::~VideoRecorder() { Close(); }
+
+bool VideoRecorder::Open() {
+  CHECK(thread_ == nullptr) << "Video recorder is already open";
+  // Closing ends the input for good.
+  CHECK(!failed_) << "Video recorder can only be opened once";
+  if (!segments_.Open()) {
+    return false;
+  }
+  chunk_.clear();
+  chunk_offset_ = 0;
+  input_ended_ = false;
+  thread_.reset(new std::thread(&VideoRecorder::RemuxLoop, this));
+  return true;
+}
+
+bool VideoRecorder::WriteBytes(size_t bytes_written, char* data) {
+  CHECK(data != nullptr);
+  if (failed_) {
+    return false;
+  }
+  if (bytes_written > 0) {
+    // Fails if remuxing stopped meanwhile.
+    return input_.Emplace(data, bytes_written);
+  }
+  return true;
+}
+
+void VideoRecorder::Close() {
+  if (thread_ == nullptr) {
+    return;
+  }
+  input_.Close();
+  thread_->join();
+  thread_.reset();
+  input_.Clear();
+  segments_.Close();
+}
+
+void VideoRecorder::RemuxLoop() {
+  bool status = OpenInput() && OpenMuxer();
+  // Time origin of the recording, from its first keyframe.
+  int64_t first_pts = AV_NOPTS_VALUE;
+  AVPacket* packet = av_packet_alloc();
+  int error = 0;
+  while (status && (error = av_read_frame(input_context_, packet)) >= 0) {
+    int64_t pts = (packet->pts != AV_NOPTS_VALUE) ? packet->pts : packet->dts;
+    if (packet->stream_index != input_stream_->index ||
+        pts == AV_NOPTS_VALUE ||
+        (first_pts == AV_NOPTS_VALUE && !(packet->flags & AV_PKT_FLAG_KEY))) {
+      av_packet_unref(packet);
+      continue;
+    }
+    if (first_pts == AV_NOPTS_VALUE) {
+      first_pts = pts;
+    }
+    int64_t time_us =
+        av_rescale_q(pts - first_pts, input_stream_->time_base, AV_TIME_BASE_Q);
+
+    // Segments start at keyframes. If the next segment fails to open, the
+    // current one goes on, from a new init segment.
+    if ((packet->flags & AV_PKT_FLAG_KEY) && segments_.ShouldRotate(time_us)) {
+      status = CloseMuxer();
+      segments_.Rotate();
+      status = status && OpenMuxer();
+    }
+    if (status) {
+      // Timestamps run on across segments, so that fragment decode times
+      // are media times.
+      if (packet->pts != AV_NOPTS_VALUE) {
+        packet->pts -= first_pts;
+      }
+      if (packet->dts != AV_NOPTS_VALUE) {
+        packet->dts -= first_pts;
+      }
+      status = WritePacket(packet, time_us);
+    }
+    av_packet_unref(packet);
+  }
+  av_packet_free(&packet);
+  if (status && error < 0 && error != AVERROR_EOF) {
+    LOG(ERROR) << "Failed to read video stream: " << AvError(error);
+    status = false;
+  }
+  if (output_context_ != nullptr && !CloseMuxer()) {
+    status = false;
+  }
+  if (input_context_ != nullptr) {
+    avformat_close_input(&input_context_);
+  }
+  FreeIo(&input_io_);
+  FreeIo(&output_io_);
+  if (!status) {
+    LOG(ERROR) << "Failed to record video, stopped recording.";
+  }
+  // Nothing reads the input any more, whether it ended or not: writers
+  // must neither block on it nor queue more.
+  failed_ = true;
+  input_.Close();
+}
+
+bool VideoRecorder::OpenInput() {
+  input_io_ = AllocIo(this, &VideoRecorder::ReadInput, nullptr);
+  input_context_ = avformat_alloc_context();
+  if (input_io_ == nullptr || input_context_ == nullptr) {
+    LOG(ERROR) << "Failed to allocate video demuxer";
+    return false;
+  }
+  input_context_->pb = input_io_;
+  input_context_->flags |= AVFMT_FLAG_CUSTOM_IO;
+  // On failure, the context is freed.
+  int error = avformat_open_input(&input_context_, nullptr, nullptr, nullptr);
+  if (error < 0) {
+    LOG(ERROR) << "Failed to open video stream: " << AvError(error);
+    return false;
+  }
+  int video_index = -1;
+  if (avformat_find_stream_info(input_context_, nullptr) >= 0) {
+    video_index = av_find_best_stream(input_context_, AVMEDIA_TYPE_VIDEO, -1,
+                                      -1, nullptr, 0);
+  }
+  if (video_index < 0) {
+    LOG(ERROR) << "Failed to find video stream";
+    return false;
+  }
+  input_stream_ = input_context_->streams[video_index];
+  return true;
+}
+
+bool VideoRecorder::OpenMuxer() {
+  if (output_io_ == nullptr) {
+    output_io_ = AllocIo(this, nullptr, &VideoRecorder::WriteOutput);
+    if (output_io_ == nullptr) {
+      LOG(ERROR) << "Failed to allocate video muxer";
+      return false;
+    }
+  }
+  // Parses the output from the init section on.
+  parser_.reset(new Mp4FragmentParser());
+  index_.clear();
+  AppendTimeIndexHeader(&index_);
+  return OpenFmp4Muxer(segments_.segment_path(), input_stream_, output_io_,
+                       &output_context_, &output_stream_);
+}
+
+bool VideoRecorder::CloseMuxer() {
+  bool status = CloseFmp4Muxer(&output_context_);
+  output_stream_ = nullptr;
+
+  // Written before the segment is listed, so that listed segments have
+  // their index.
+  const std::string index_path = TimeIndexPath(segments_.segment_path());
+  std::ofstream output(index_path, std::ofstream::binary);
+  output.write(index_.data(), index_.size());
+  if (!output.good()) {
+    LOG(ERROR) << "Failed to write time index " << index_path;
+    status = false;
+  }
+  return status;
+}
+
+bool VideoRecorder::WritePacket(AVPacket* packet, int64_t time_us) {
+  av_packet_rescale_ts(packet, input_stream_->time_base,
+                       output_stream_->time_base);
+  packet->stream_index = output_stream_->index;
+  packet->pos = -1;
+  segments_.Written(0, time_us);
+  int error = av_interleaved_write_frame(output_context_, packet);
+  if (error < 0) {
+    LOG(ERROR) << "Failed to write " << segments_.segment_path() << ": "
+               << AvError(error);
+    return false;
+  }
+  return true;
+}
+
+int VideoRecorder::ReadInput(void* opaque, uint8_t* buffer, int size) {
+  VideoRecorder* recorder = static_cast<VideoRecorder*>(opaque);
+  if (recorder->chunk_offset_ == recorder->chunk_.size()) {
+    if (recorder->input_ended_) {
+      return AVERROR_EOF;
+    }
+    recorder->chunk_offset_ = 0;
+    if (!recorder->input_.Pop(&recorder->chunk_)) {
+      recorder->chunk_.clear();
+      recorder->input_ended_ = true;
+      return AVERROR_EOF;
+    }
+  }
+  size_t read = std::min<size_t>(
+      size, recorder->chunk_.size() - recorder->chunk_offset_);
+  memcpy(buffer, recorder->chunk_.data() + recorder->chunk_offset_, read);
+  recorder->chunk_offset_ += read;
+  return read;
+}
+
+int VideoRecorder::WriteOutput(void* opaque, uint8_t* buffer, int size) {
+  VideoRecorder* recorder = static_cast<VideoRecorder*>(opaque);
+  char* data = reinterpret_cast<char*>(buffer);
+  if (!recorder->segments_.writer()->WriteBytes(size, data)) {
+    return AVERROR(EIO);
+  }
+  // Media times are those of the packets, see WritePacket().
+  recorder->segments_.Written(size, -1);
+  std::vector<Mp4Fragment> fragments;
+  recorder->parser_->Parse(data, size, &fragments);
+  for (const Mp4Fragment& fragment : fragments) {
+    // Each fragment starts with a keyframe, and frames before it are
+    // earlier.
+    AppendTimeIndexEntry(fragment.decode_time_us - 1, fragment.offset,
+                         &recorder->index_);
+  }
+  return size;
+}
+
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,118 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_VIDEO_RECORDER_H_
+#define API_VIDEO_CLIENT_CPP_VIDEO_RECORDER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "client/cpp/io_writer.h"
+#include "client/cpp/mp4_fragment_parser.h"
+#include "client/cpp/segmented_writer.h"
+#include "client/cpp/sync_queue.h"
+
+struct AVFormatContext;
+struct AVIOContext;
+struct AVPacket;
+struct AVStream;
+
+namespace api {
+namespace video {
+
+// Records a video stream as fragmented MP4 segments (see SegmentedWriter).
+// The input, in any container libavformat can demux from a stream, is
+// remuxed (not re-encoded) on a background thread: the video stream only,
+// with a fragment per keyframe and media times from the first keyframe, as
+// annotation times are. Segments are cut at keyframes, and each segment
+// has a time index of its keyframes (see time_index.h), so that
+// FindRecordingSeekPoint() (see recording_seek.h) finds where to play any
+// media time from.
+class VideoRecorder : public IOWriter {
+ public:
+  VideoRecorder(const std::string& path,
+                const SegmentedWriter::Options& options);
+  virtual ~VideoRecorder();
+
+  // Disallows copy and assign.
+  VideoRecorder(const VideoRecorder&) = delete;
+  VideoRecorder& operator=(const VideoRecorder&) = delete;
+
+  // Opens the first segment and starts remuxing.
+  bool Open();
+
+  // Queues bytes of the input stream. Returns false once remuxing stopped,
+  // on failure or at the end of the input.
+  bool WriteBytes(size_t bytes_written, char* data);
+
+  // Ends the input, and waits until it is remuxed. The recorder can't be
+  // opened again.
+  void Close();
+
+ private:
+  // Remuxer thread loop.
+  void RemuxLoop();
+
+  // Opens the input and finds its video stream.
+  bool OpenInput();
+
+  // Starts a muxer, writing the init segment to the current segment.
+  bool OpenMuxer();
+
+  // Writes the rest of the current segment and its time index.
+  bool CloseMuxer();
+
+  // Writes a video packet at media time `time_us`.
+  bool WritePacket(AVPacket* packet, int64_t time_us);
+
+  // AVIO callbacks: reads queued input, and writes to the current segment.
+  static int ReadInput(void* opaque, uint8_t* buffer, int size);
+  static int WriteOutput(void* opaque, uint8_t* buffer, int size);
+
+  SegmentedWriter segments_;
+  // Input chunks, bounded in bytes. Closing the queue ends the input.
+  SyncQueue<std::string, PayloadBytes, QueueStats> input_;
+  // Chunk being demuxed, and its bytes demuxed so far.
+  std::string chunk_;
+  size_t chunk_offset_ = 0;
+  bool input_ended_ = false;
+  // Demuxer and its video stream.
+  AVIOContext* input_io_ = nullptr;
+  AVFormatContext* input_context_ = nullptr;
+  AVStream* input_stream_ = nullptr;
+  // Muxer of the current segment, and the output it writes through.
+  AVIOContext* output_io_ = nullptr;
+  AVFormatContext* output_context_ = nullptr;
+  AVStream* output_stream_ = nullptr;
+  // Finds the fragments of the current segment, for its time index.
+  std::unique_ptr<Mp4FragmentParser> parser_;
+  std::string index_;
+  // Set once remuxing stopped, and nothing reads the input any more.
+  std::atomic<bool> failed_{false};
+  std::unique_ptr<std::thread> thread_;
+};
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_VIDEO_RECORDER_H_
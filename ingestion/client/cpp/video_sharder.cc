@@ -0,0 +1,165 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client/cpp/video_sharder.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+#include <libavutil/avutil.h>
+}
+
+#include <cstdio>
+
+#include "client/cpp/fmp4_muxer.h"
+#include "glog/logging.h"
+
+namespace api {
+namespace video {
+
+namespace {
+
+// Writes one shard.
+class ShardWriter {
+ public:
+  ShardWriter() = default;
+  ~ShardWriter() { Close(); }
+
+  // Disallows copy and assign.
+  ShardWriter(const ShardWriter&) = delete;
+  ShardWriter& operator=(const ShardWriter&) = delete;
+
+  // Creates a fragmented MP4 file for the video stream `input`, whose
+  // timestamps are shifted by -`start_pts`.
+  bool Open(const std::string& path, const AVStream* input, int64_t start_pts) {
+    input_time_base_ = input->time_base;
+    start_pts_ = start_pts;
+    return OpenFmp4Muxer(path, input, nullptr, &output_, &stream_);
+  }
+
+  // Writes a packet of the video stream.
+  bool Write(AVPacket* packet) {
+    if (packet->pts != AV_NOPTS_VALUE) {
+      packet->pts -= start_pts_;
+    }
+    if (packet->dts != AV_NOPTS_VALUE) {
+      packet->dts -= start_pts_;
+    }
+    av_packet_rescale_ts(packet, input_time_base_, stream_->time_base);
+    packet->stream_index = stream_->index;
+    packet->pos = -1;
+    int error = av_interleaved_write_frame(output_, packet);
+    if (error < 0) {
+      LOG(ERROR) << "Failed to write shard: " << AvError(error);
+      return false;
+    }
+    return true;
+  }
+
+  // Finishes the file.
+  bool Close() { return CloseFmp4Muxer(&output_); }
+
+ private:
+  AVFormatContext* output_ = nullptr;
+  AVStream* stream_ = nullptr;
+  AVRational input_time_base_;
+  int64_t start_pts_ = 0;
+};
+
+}  // namespace
+
+bool ShardVideo(const std::string& video_path, int num_shards,
+                const std::string& shard_dir, std::vector<VideoShard>* shards) {
+  CHECK(shards != nullptr);
+  CHECK_GT(num_shards, 0);
+  shards->clear();
+
+  AVFormatContext* input = nullptr;
+  int error = avformat_open_input(&input, video_path.c_str(), nullptr, nullptr);
+  if (error < 0) {
+    LOG(ERROR) << "Failed to open " << video_path << ": " << AvError(error);
+    return false;
+  }
+  int video_index = -1;
+  if (avformat_find_stream_info(input, nullptr) >= 0) {
+    video_index =
+        av_find_best_stream(input, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+  }
+  if (video_index < 0 || input->duration == AV_NOPTS_VALUE) {
+    LOG(ERROR) << "Failed to find video stream and duration of "
+               << video_path;
+    avformat_close_input(&input);
+    return false;
+  }
+  const AVStream* video = input->streams[video_index];
+  int64_t shard_duration_us = input->duration / num_shards;
+
+  bool status = true;
+  ShardWriter writer;
+  // Time origin of the video, from its first keyframe.
+  int64_t first_pts = AV_NOPTS_VALUE;
+  AVPacket* packet = av_packet_alloc();
+  while (status && av_read_frame(input, packet) >= 0) {
+    int64_t pts = (packet->pts != AV_NOPTS_VALUE) ? packet->pts : packet->dts;
+    if (packet->stream_index != video_index || pts == AV_NOPTS_VALUE ||
+        (first_pts == AV_NOPTS_VALUE && !(packet->flags & AV_PKT_FLAG_KEY))) {
+      av_packet_unref(packet);
+      continue;
+    }
+    if (first_pts == AV_NOPTS_VALUE) {
+      first_pts = pts;
+    }
+
+    // Cuts at the first keyframe past the end of the current shard.
+    int64_t time_us =
+        av_rescale_q(pts - first_pts, video->time_base, AV_TIME_BASE_Q);
+    if ((packet->flags & AV_PKT_FLAG_KEY) &&
+        static_cast<int>(shards->size()) < num_shards &&
+        (shards->empty() ||
+         time_us >= shard_duration_us * static_cast<int64_t>(shards->size()))) {
+      char name[32];
+      snprintf(name, sizeof(name), "/shard-%03d.mp4",
+               static_cast<int>(shards->size()));
+      VideoShard shard;
+      shard.path = shard_dir + name;
+      shard.start_time_us = time_us;
+      status = writer.Close() && writer.Open(shard.path, video, pts);
+      shards->push_back(shard);
+    }
+    if (status) {
+      status = writer.Write(packet);
+    }
+    av_packet_unref(packet);
+  }
+  if (!writer.Close()) {
+    status = false;
+  }
+  av_packet_free(&packet);
+  avformat_close_input(&input);
+
+  if (status) {
+    LOG(INFO) << "Split " << video_path << " into " << shards->size()
+              << " shards.";
+  }
+  return status && !shards->empty();
+}
+
+}  // namespace video
+}  // namespace api
@@ -0,0 +1,49 @@
+// Copyright (c) 2019 Google LLC
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef API_VIDEO_CLIENT_CPP_VIDEO_SHARDER_H_
+#define API_VIDEO_CLIENT_CPP_VIDEO_SHARDER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace api {
+namespace video {
+
+// A segment of a video file, cut at a keyframe.
+struct VideoShard {
+  // Fragmented MP4 file holding the segment, with its own init section.
+  std::string path;
+  // Media time (in microseconds) at which the segment starts in the video.
+  int64_t start_time_us;
+};
+
+// Splits the video stream of `video_path` at keyframes into up to
+// `num_shards` segments of about equal duration, remuxed (not re-encoded)
+// into fragmented MP4 files in `shard_dir`. Timestamps of each segment start
+// at 0. Other streams, e.g. audio, are dropped.
+bool ShardVideo(const std::string& video_path, int num_shards,
+                const std::string& shard_dir, std::vector<VideoShard>* shards);
+
+}  // namespace video
+}  // namespace api
+
+#endif  //  API_VIDEO_CLIENT_CPP_VIDEO_SHARDER_H_
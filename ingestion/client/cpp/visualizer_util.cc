@@ -111,6 +111,7 @@ void UpdateLabelDetectionSDLRenderer(const StreamingAnnotateVideoResponse& resp,
     if (texture != nullptr) {
       SDL_Rect label_rect = {10, 10, surface->w, surface->h};
       SDL_RenderCopy(sdl_renderer, texture, nullptr, &label_rect);
+      SDL_DestroyTexture(texture);
     }
     SDL_FreeSurface(surface);
   }
@@ -171,6 +172,9 @@ void UpdateObjectTrackingSDLRenderer(const StreamingAnnotateVideoResponse& resp,
   for (uint32_t i = 0; i < textures.size() && i < box_text_rects.size(); i++) {
     SDL_RenderCopy(sdl_renderer, textures[i], nullptr, &box_text_rects[i]);
   }
+  for (SDL_Texture* texture : textures) {
+    SDL_DestroyTexture(texture);
+  }
 }
 
 }  // namespace